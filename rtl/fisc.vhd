@@ -159,7 +159,7 @@ ARCHITECTURE RTL OF FISC IS
 	signal io_int_id_reg   : std_logic_vector(7 downto 0);
 	signal io_int_type     : std_logic_vector(1 downto 0);
 	signal io_int_type_reg : std_logic_vector(1 downto 0);
-	signal io_int_ack      : std_logic := '0';
+	signal io_int_ack      : std_logic := '1'; -- High while waiting for interrupts, low while servicing one
 	signal io_int_ack_id   : std_logic_vector(7 downto 0) := (others => '0');
 	---------------------------
 	
@@ -176,6 +176,55 @@ ARCHITECTURE RTL OF FISC IS
 	-- CPU Finite State Machine --
 	signal cpu_state : std_logic_vector(2 downto 0) := s_fetching;
 	------------------------------
+
+	-- The Memory, IO Controller and MMU are implemented on the C side. They are components so that a synthesis of the
+	-- core into Verilog keeps them as black boxes, which rtl/verilator fills in:
+	COMPONENT Memory IS
+		GENERIC(
+			depth               : integer := 50000000;
+			max_cycles          : integer := 0;
+			stop_on_halt        : integer := 1;
+			stop_pc             : integer := -1;
+			checkpoint_interval : integer := 0
+		);
+		PORT(
+			clk            : in  std_logic;
+			en             : in  std_logic_vector(1 downto 0);
+			wr             : in  std_logic;
+			rd             : in  std_logic_vector(1 downto 0);
+			ready          : out std_logic_vector(1 downto 0);
+			address1       : in  std_logic_vector(22 downto 0);
+			address2       : in  std_logic_vector(22 downto 0);
+			data_in        : in  std_logic_vector(63 downto 0);
+			data_out1      : out std_logic_vector(63 downto 0);
+			data_out2      : out std_logic_vector(63 downto 0);
+			access_width   : in  std_logic_vector(1 downto 0);
+			alignment_flag : in  std_logic
+		);
+	END COMPONENT;
+
+	COMPONENT IO_Controller IS
+		PORT(
+			clk         : in  std_logic;
+			int_en      : out std_logic;
+			int_id      : out std_logic_vector(7 downto 0);
+			int_type    : out std_logic_vector(1 downto 0);
+			int_ack     : in  std_logic;
+			int_ack_id  : in  std_logic_vector(7 downto 0);
+			ex_enabled  : in  std_logic;
+			int_enabled : in  std_logic
+		);
+	END COMPONENT;
+
+	COMPONENT MMU IS
+		PORT(
+			clk     : in  std_logic;
+			en      : in  std_logic;
+			pdp     : in  std_logic_vector(FISC_INTEGER_SZ-1 downto 0);
+			pfla    : out std_logic_vector(FISC_INTEGER_SZ-1 downto 0);
+			pfla_wr : out std_logic
+		);
+	END COMPONENT;
 BEGIN
 	-- Main Memory Wire Assignments:
 	accessing_main_memory <= '0' WHEN mem_ready > "00" ELSE '1'; 
@@ -330,18 +379,18 @@ BEGIN
 	);
 	
 	-- Declare Main Memory: --
-	Main_Memory : ENTITY work.Memory PORT MAP(
+	Main_Memory : Memory PORT MAP(
 		clk, mem_en, mem_wr, mem_rd, mem_ready,
 		mem_address1, mem_address2, mem_data_in, mem_data_out1, mem_data_out2, mem_access_width, ae_flag
 	);
 	
 	-- Declare IO Controller:
-	IO_Controller1: ENTITY work.IO_Controller PORT MAP(
+	IO_Controller1: IO_Controller PORT MAP(
 		clk, io_int_en, io_int_id, io_int_type, io_int_ack, io_int_ack_id, ien_flags(0), ien_flags(1)
 	);
 	
 	-- Declare MMU:
-	MMU1: ENTITY work.MMU PORT MAP(
+	MMU1: MMU PORT MAP(
 		clk, pg_flag, pdp_out, mmu_pfla, mmu_pfla_wr
 	);
 	
@@ -0,0 +1,23 @@
+LIBRARY IEEE;
+USE IEEE.std_logic_1164.all;
+USE work.FISC_VHPI.all;
+
+-- GHDL architecture of the IO Controller (rtl/io_controller.vhd). Being analyzed after it, it is the one which the design binds to
+ARCHITECTURE VHPI OF IO_Controller IS
+BEGIN
+	process
+		variable en    : std_logic;
+		variable id    : vm_byte;
+		variable itype : vm_bits2;
+		variable drive : integer;
+	begin
+		vm_io_controller_init;
+		loop
+			wait on clk;
+			vm_io_controller_on_clk(clk, en, id, itype, int_ack, int_ack_id, ex_enabled, int_enabled, drive);
+			if vm_driven(drive, 0) then int_en   <= en    after vm_delay(drive, 0); end if;
+			if vm_driven(drive, 1) then int_id   <= id    after vm_delay(drive, 1); end if;
+			if vm_driven(drive, 2) then int_type <= itype after vm_delay(drive, 2); end if;
+		end loop;
+	end process;
+END ARCHITECTURE VHPI;
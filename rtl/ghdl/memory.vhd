@@ -0,0 +1,22 @@
+LIBRARY IEEE;
+USE IEEE.std_logic_1164.all;
+USE work.FISC_VHPI.all;
+
+-- GHDL architecture of the Memory (rtl/memory.vhd). Being analyzed after it, it is the one which the design binds to
+ARCHITECTURE VHPI OF Memory IS
+BEGIN
+	process
+		variable dout1, dout2 : vm_word;
+		variable rdy          : vm_bits2;
+		variable drive        : integer;
+	begin
+		vm_memory_init(depth, max_cycles, stop_on_halt, stop_pc, checkpoint_interval);
+		loop
+			wait on clk;
+			vm_memory_on_clk(clk, en, wr, rd, rdy, address1, address2, data_in, dout1, dout2, access_width, alignment_flag, drive);
+			if vm_driven(drive, 0) then data_out1 <= dout1 after vm_delay(drive, 0); end if;
+			if vm_driven(drive, 1) then data_out2 <= dout2 after vm_delay(drive, 1); end if;
+			if vm_driven(drive, 2) then ready     <= rdy   after vm_delay(drive, 2); end if;
+		end loop;
+	end process;
+END ARCHITECTURE VHPI;
@@ -0,0 +1,17 @@
+LIBRARY IEEE;
+USE IEEE.std_logic_1164.all;
+USE work.FISC_VHPI.all;
+
+-- GHDL architecture of the MMU (rtl/mmu.vhd). Being analyzed after it, it is the one which the design binds to
+ARCHITECTURE VHPI OF MMU IS
+BEGIN
+	process(en)
+	begin
+		vm_mmu_on_en(en);
+	end process;
+
+	process(pdp)
+	begin
+		vm_mmu_on_pdp(pdp);
+	end process;
+END ARCHITECTURE VHPI;
@@ -0,0 +1,96 @@
+LIBRARY IEEE;
+USE IEEE.std_logic_1164.all;
+
+-- Foreign subprograms of the GHDL backend of the virtual machine (src/vmachine/sim_ghdl.c), which the architectures
+-- in this directory call instead of ModelSim's foreign architectures. GHDL links them in at elaboration time
+PACKAGE FISC_VHPI IS
+	subtype vm_bits2   is std_logic_vector(1 downto 0);
+	subtype vm_byte    is std_logic_vector(7 downto 0);
+	subtype vm_address is std_logic_vector(22 downto 0);
+	subtype vm_word    is std_logic_vector(63 downto 0);
+
+	-- One tick of ModelSim's resolution, which is what a delay of 1 on the C side means (see src/vmachine/sim.h):
+	constant VM_DELAY : time := 1 ns;
+
+	-- The C side tells which outputs it drove through 'drive', with two bits per output (in the order of the ports):
+	function vm_driven(drive : integer; output : integer) return boolean;
+	function vm_delay(drive : integer; output : integer) return time;
+
+	procedure vm_memory_init(depth, max_cycles, stop_on_halt, stop_pc, checkpoint_interval : integer);
+	attribute foreign of vm_memory_init : procedure is "VHPIDIRECT vm_memory_init";
+
+	procedure vm_memory_on_clk(
+		clk : std_logic; en : vm_bits2; wr : std_logic; rd : vm_bits2; ready : out vm_bits2;
+		address1, address2 : vm_address; data_in : vm_word; data_out1, data_out2 : out vm_word;
+		access_width : vm_bits2; alignment_flag : std_logic; drive : out integer
+	);
+	attribute foreign of vm_memory_on_clk : procedure is "VHPIDIRECT vm_memory_on_clk";
+
+	procedure vm_mmu_on_en(en : std_logic);
+	attribute foreign of vm_mmu_on_en : procedure is "VHPIDIRECT vm_mmu_on_en";
+
+	procedure vm_mmu_on_pdp(pdp : vm_word);
+	attribute foreign of vm_mmu_on_pdp : procedure is "VHPIDIRECT vm_mmu_on_pdp";
+
+	procedure vm_io_controller_init;
+	attribute foreign of vm_io_controller_init : procedure is "VHPIDIRECT vm_io_controller_init";
+
+	procedure vm_io_controller_on_clk(
+		clk : std_logic; int_en : out std_logic; int_id : out vm_byte; int_type : out vm_bits2;
+		int_ack : std_logic; int_ack_id : vm_byte; ex_enabled, int_enabled : std_logic; drive : out integer
+	);
+	attribute foreign of vm_io_controller_on_clk : procedure is "VHPIDIRECT vm_io_controller_on_clk";
+END FISC_VHPI;
+
+PACKAGE BODY FISC_VHPI IS
+	function vm_driven(drive : integer; output : integer) return boolean is
+	begin
+		return (drive / 4**output) mod 2 = 1;
+	end function;
+
+	function vm_delay(drive : integer; output : integer) return time is
+	begin
+		if (drive / 4**output / 2) mod 2 = 1 then
+			return VM_DELAY;
+		end if;
+		return 0 ns;
+	end function;
+
+	-- The bodies of the foreign subprograms are never called:
+	procedure vm_memory_init(depth, max_cycles, stop_on_halt, stop_pc, checkpoint_interval : integer) is
+	begin
+		assert false report "VHPIDIRECT vm_memory_init" severity failure;
+	end procedure;
+
+	procedure vm_memory_on_clk(
+		clk : std_logic; en : vm_bits2; wr : std_logic; rd : vm_bits2; ready : out vm_bits2;
+		address1, address2 : vm_address; data_in : vm_word; data_out1, data_out2 : out vm_word;
+		access_width : vm_bits2; alignment_flag : std_logic; drive : out integer
+	) is
+	begin
+		assert false report "VHPIDIRECT vm_memory_on_clk" severity failure;
+	end procedure;
+
+	procedure vm_mmu_on_en(en : std_logic) is
+	begin
+		assert false report "VHPIDIRECT vm_mmu_on_en" severity failure;
+	end procedure;
+
+	procedure vm_mmu_on_pdp(pdp : vm_word) is
+	begin
+		assert false report "VHPIDIRECT vm_mmu_on_pdp" severity failure;
+	end procedure;
+
+	procedure vm_io_controller_init is
+	begin
+		assert false report "VHPIDIRECT vm_io_controller_init" severity failure;
+	end procedure;
+
+	procedure vm_io_controller_on_clk(
+		clk : std_logic; int_en : out std_logic; int_id : out vm_byte; int_type : out vm_bits2;
+		int_ack : std_logic; int_ack_id : vm_byte; ex_enabled, int_enabled : std_logic; drive : out integer
+	) is
+	begin
+		assert false report "VHPIDIRECT vm_io_controller_on_clk" severity failure;
+	end procedure;
+END FISC_VHPI;
@@ -1,5 +1,6 @@
 LIBRARY IEEE;
 USE IEEE.std_logic_1164.all;
+USE work.FISC_PLATFORM.all;
 
 ENTITY IO_Controller IS
 	PORT(
@@ -17,7 +18,7 @@ END IO_Controller;
 ARCHITECTURE RTL OF IO_Controller IS
 	-- The IO Controller is implemented on the C side
 	attribute foreign : string;
-	attribute foreign of rtl : architecture is "io_controller_init_vhd bin/libvm.dll";
+	attribute foreign of rtl : architecture is "io_controller_init_vhd " & VM_LIBRARY;
 BEGIN
 
 END ARCHITECTURE RTL;
\ No newline at end of file
@@ -1,7 +1,16 @@
 LIBRARY IEEE;
 USE IEEE.std_logic_1164.all;
+USE work.FISC_PLATFORM.all;
 
 ENTITY Memory IS
+	GENERIC(
+		depth               : integer := 50000000; -- Size of the Main Memory in bytes (the environment variable FISC_MEMORY_DEPTH overrides it)
+		-- Run control (see src/vmachine/runctl.h). The foreign attribute's parameters override these:
+		max_cycles          : integer := 0;        -- Stop after this many clock cycles (0: no limit)
+		stop_on_halt        : integer := 1;        -- Stop once the core spins on a HALT instruction
+		stop_pc             : integer := -1;       -- Stop when the core fetches this address (-1: never)
+		checkpoint_interval : integer := 0         -- Take a checkpoint every this many clock cycles (0: never)
+	);
 	PORT(
 		clk            : in  std_logic;
 		en             : in  std_logic_vector(1 downto 0);
@@ -19,9 +28,9 @@ ENTITY Memory IS
 END Memory;
 
 ARCHITECTURE RTL OF Memory IS
-	-- The Memory is implemented on the C side
+	-- The Memory is implemented on the C side. Run control parameters ("name=value") may follow the library's path
 	attribute foreign : string;
-	attribute foreign of rtl : architecture is "memory_init bin/libvm.dll";
+	attribute foreign of rtl : architecture is "memory_init " & VM_LIBRARY;
 BEGIN
 	
 END ARCHITECTURE RTL;
\ No newline at end of file
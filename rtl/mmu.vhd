@@ -1,6 +1,7 @@
 LIBRARY IEEE;
 USE IEEE.std_logic_1164.all;
 USE work.FISC_DEFINES.all;
+USE work.FISC_PLATFORM.all;
 
 ENTITY MMU IS
 	PORT(
@@ -15,7 +16,7 @@ END MMU;
 ARCHITECTURE RTL OF MMU IS
 	-- The MMU is implemented on the C side
 	attribute foreign : string;
-	attribute foreign of rtl : architecture is "mmu_init bin/libvm.dll";
+	attribute foreign of rtl : architecture is "mmu_init " & VM_LIBRARY;
 BEGIN
 	
 END ARCHITECTURE RTL;
\ No newline at end of file
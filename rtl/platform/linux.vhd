@@ -0,0 +1,6 @@
+-- Host dependent settings of the virtual machine. The makefile compiles either this file or rtl/platform/windows.vhd,
+-- depending on the host which builds the library (see toolchain/makefile.mak)
+PACKAGE FISC_PLATFORM IS
+	-- The library which implements the foreign architectures of the Memory, MMU and IO Controller:
+	constant VM_LIBRARY : string := "bin/libvm.so";
+END FISC_PLATFORM;
@@ -0,0 +1,43 @@
+// Verilator shell of the IO Controller (rtl/io_controller.vhd), which the core instantiates as a black box once it is
+// converted into Verilog. The IO Controller is implemented on the C side (src/vmachine/sim_verilator.c)
+module io_controller (
+	input  logic       clk,
+	output logic       int_en,
+	output logic [7:0] int_id,
+	output logic [1:0] int_type,
+	input  logic       int_ack,
+	input  logic [7:0] int_ack_id,
+	input  logic       ex_enabled,
+	input  logic       int_enabled
+);
+	import "DPI-C" context function void vm_io_controller_init();
+	import "DPI-C" function int vm_io_controller_on_clk(
+		input bit clk, input bit int_ack, input int int_ack_id, input bit ex_enabled, input bit int_enabled,
+		output bit int_en, output int int_id, output int int_type
+	);
+
+	bit en;
+	int id, itype, drive;
+
+	initial begin
+		int_en   = 1'b0;
+		int_id   = 8'h00;
+		int_type = 2'b00;
+		vm_io_controller_init();
+	end
+
+	always @(posedge clk or negedge clk) begin
+		drive = vm_io_controller_on_clk(clk, int_ack, int'(int_ack_id), ex_enabled, int_enabled, en, id, itype);
+		if (drive[0]) int_en   <= en;
+		if (drive[2]) int_id   <= id[7:0];
+		if (drive[4]) int_type <= itype[1:0];
+	end
+
+	// The outputs which were delayed into the next edge. The harness assigns them right before it (sim_verilator_main.cpp):
+	export "DPI-C" function vm_io_controller_apply;
+	function void vm_io_controller_apply(input bit apply_en, input int apply_id, input int apply_type, input int apply_drive);
+		if (apply_drive[0]) int_en   = apply_en;
+		if (apply_drive[2]) int_id   = apply_id[7:0];
+		if (apply_drive[4]) int_type = apply_type[1:0];
+	endfunction
+endmodule
@@ -0,0 +1,52 @@
+// Verilator shell of the Memory (rtl/memory.vhd), which the core instantiates as a black box once it is converted into
+// Verilog. The Memory is implemented on the C side (src/vmachine/sim_verilator.c), which runs on both edges of the clock
+module memory #(
+	parameter integer depth               = 50000000,
+	parameter integer max_cycles          = 0,
+	parameter integer stop_on_halt        = 1,
+	parameter integer stop_pc             = -1,
+	parameter integer checkpoint_interval = 0
+) (
+	input  logic        clk,
+	input  logic [1:0]  en,
+	input  logic        wr,
+	input  logic [1:0]  rd,
+	output logic [1:0]  ready,
+	input  logic [22:0] address1,
+	input  logic [22:0] address2,
+	input  logic [63:0] data_in,
+	output logic [63:0] data_out1,
+	output logic [63:0] data_out2,
+	input  logic [1:0]  access_width,
+	input  logic        alignment_flag
+);
+	import "DPI-C" context function void vm_memory_init(input int depth, input int max_cycles, input int stop_on_halt, input int stop_pc, input int checkpoint_interval);
+	import "DPI-C" function int vm_memory_on_clk(
+		input bit clk, input int en, input bit wr, input int rd, input longint address1, input longint address2, input longint data_in,
+		input int access_width, input bit alignment_flag, output longint data_out1, output longint data_out2, output int ready
+	);
+
+	longint dout1, dout2;
+	int     rdy, drive;
+
+	initial begin
+		ready = 2'b00;
+		vm_memory_init(depth, max_cycles, stop_on_halt, stop_pc, checkpoint_interval);
+	end
+
+	always @(posedge clk or negedge clk) begin
+		drive = vm_memory_on_clk(clk, int'(en), wr, int'(rd), longint'(address1), longint'(address2), data_in,
+			int'(access_width), alignment_flag, dout1, dout2, rdy);
+		if (drive[0]) data_out1 <= dout1;
+		if (drive[2]) data_out2 <= dout2;
+		if (drive[4]) ready     <= rdy[1:0];
+	end
+
+	// The outputs which were delayed into the next edge. The harness assigns them right before it (sim_verilator_main.cpp):
+	export "DPI-C" function vm_memory_apply;
+	function void vm_memory_apply(input longint apply_dout1, input longint apply_dout2, input int apply_rdy, input int apply_drive);
+		if (apply_drive[0]) data_out1 = apply_dout1;
+		if (apply_drive[2]) data_out2 = apply_dout2;
+		if (apply_drive[4]) ready     = apply_rdy[1:0];
+	endfunction
+endmodule
@@ -0,0 +1,18 @@
+// Verilator shell of the MMU (rtl/mmu.vhd), which the core instantiates as a black box once it is converted into
+// Verilog. The MMU is implemented on the C side (src/vmachine/sim_verilator.c)
+module mmu (
+	input  logic        clk,
+	input  logic        en,
+	input  logic [63:0] pdp,
+	output logic [63:0] pfla,
+	output logic        pfla_wr
+);
+	import "DPI-C" function void vm_mmu_on_en(input bit en);
+	import "DPI-C" function void vm_mmu_on_pdp(input longint pdp);
+
+	assign pfla    = 64'h0;
+	assign pfla_wr = 1'b0;
+
+	always @(en)  vm_mmu_on_en(en);
+	always @(pdp) vm_mmu_on_pdp(pdp);
+endmodule
@@ -0,0 +1,112 @@
+/*
+ * block_cache.c
+ *
+ *  Created on: 04/01/2017
+ *      Author: Miguel
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+#include "block_cache.h"
+#include "../vmachine/address_space.h"
+#include "../vmachine/bus.h"
+#include "../vmachine/defines.h"
+#include "../vmachine/mmu.h"
+
+iss_block_t block_cache[BLOCK_CACHE_ENTRIES];
+
+/* Block Cache statistics: */
+uint64_t block_hits          = 0;
+uint64_t block_translations  = 0;
+uint64_t block_invalidations = 0;
+
+#define BLOCK_INDEX(ppc) (((ppc) >> 2) & (BLOCK_CACHE_ENTRIES-1))
+
+/* Is this the last instruction of a basic block? Besides branches, this covers every instruction which
+ * may change how the next PC is translated (MSR toggles paging, LPDP changes the directory) */
+static char ends_block(uint8_t op) {
+	switch(op) {
+		case OP_B: case OP_BL: case OP_BR: case OP_BCOND: case OP_CBZ: case OP_CBNZ:
+		case OP_RETI: case OP_SINT: case OP_HALT: case OP_MSR: case OP_LPDP:
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+void block_cache_init(void) {
+	memset(block_cache, 0, sizeof(block_cache));
+	bus_clear_code();
+	code_write_hook = block_cache_invalidate;
+}
+
+void block_cache_flush(void) {
+	for(int i = 0; i < BLOCK_CACHE_ENTRIES; i++)
+		block_cache[i].valid = 0;
+	bus_clear_code();
+}
+
+/* Forgets every translation into host code (the JIT's code buffer was recycled) */
+void block_cache_drop_jit(void) {
+	for(int i = 0; i < BLOCK_CACHE_ENTRIES; i++) {
+		block_cache[i].jit   = 0;
+		block_cache[i].execs = 0;
+	}
+}
+
+/* Runs whenever a write lands on a page which holds translated code */
+void block_cache_invalidate(uint64_t code_page) {
+	for(int i = 0; i < BLOCK_CACHE_ENTRIES; i++) {
+		iss_block_t * blk = &block_cache[i];
+		if(blk->valid
+			&& (blk->ppc >> CODE_PAGE_SHIFT) <= code_page
+			&& ((blk->ppc + blk->count * 4 - 1) >> CODE_PAGE_SHIFT) >= code_page)
+		{
+			blk->valid = 0;
+			block_invalidations++;
+		}
+	}
+	bitmap_clear(&code_pages, code_page);
+}
+
+/* Decodes the basic block which starts at the physical address ppc */
+static void block_translate(iss_block_t * blk, uint64_t ppc) {
+	uint64_t addr = ppc;
+
+	blk->ppc   = ppc;
+	blk->count = 0;
+	blk->execs = 0;
+	blk->jit   = 0;
+	do {
+		iss_decode((uint32_t)read_memory(addr, SZ_32), &blk->insns[blk->count]);
+		addr += 4;
+	} while(!ends_block(blk->insns[blk->count++].op)
+		&& blk->count < BLOCK_MAX_INSNS
+		&& (addr & (PAGE_SIZE-1))          /* The next (virtual) page may not be physically contiguous */
+		&& address_decode(addr) == SPACE_MMEM
+		&& addr + 4 <= memory_depth);
+
+	blk->valid = 1;
+	bus_mark_code(ppc, blk->count * 4);
+	block_translations++;
+}
+
+/* Returns the decoded block which starts at the physical address ppc, or 0 if the code can't be cached (it lives in the IO space) */
+iss_block_t * block_cache_lookup(uint64_t ppc) {
+	if(address_decode(ppc) != SPACE_MMEM || ppc + 4 > memory_depth)
+		return 0;
+
+	iss_block_t * blk = &block_cache[BLOCK_INDEX(ppc)];
+	if(blk->valid && blk->ppc == ppc) {
+		block_hits++;
+		return blk;
+	}
+
+	block_translate(blk, ppc);
+	return blk;
+}
+
+void block_cache_print_stats(void) {
+	printf("\n> Block Cache: %" PRIu64 " hits, %" PRIu64 " translations, %" PRIu64 " invalidations", block_hits, block_translations, block_invalidations);
+}
@@ -0,0 +1,34 @@
+/*
+ * block_cache.h
+ *
+ *  Created on: 04/01/2017
+ *      Author: Miguel
+ */
+
+#ifndef SRC_ISS_BLOCK_CACHE_H_
+#define SRC_ISS_BLOCK_CACHE_H_
+
+#include <stdint.h>
+#include "iss.h"
+
+#define BLOCK_CACHE_ENTRIES 4096 /* Number of entries of the (direct mapped) Basic Block Cache. Must be a power of 2 */
+#define BLOCK_MAX_INSNS     32   /* A block also ends on a control flow instruction or on a page boundary */
+
+/* A pre-decoded basic block: */
+typedef struct iss_block {
+	uint64_t   ppc;   /* Tag: Physical address of the first instruction */
+	uint8_t    count; /* Number of instructions */
+	uint8_t    valid; /* 0: EMPTY / INVALIDATED 1: VALID */
+	uint32_t   execs; /* How many times the block ran on the interpreter (it's translated into host code once it gets hot) */
+	void     * jit;   /* Translated host code (0 if the block is not translated) */
+	iss_insn_t insns[BLOCK_MAX_INSNS];
+} iss_block_t;
+
+void          block_cache_init(void);
+iss_block_t * block_cache_lookup(uint64_t ppc);
+void          block_cache_flush(void);
+void          block_cache_invalidate(uint64_t code_page);
+void          block_cache_drop_jit(void);
+void          block_cache_print_stats(void);
+
+#endif /* SRC_ISS_BLOCK_CACHE_H_ */
@@ -0,0 +1,281 @@
+/*
+ * fanout.c
+ *
+ *  Created on: 15/01/2017
+ *      Author: Miguel
+ */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* For WIFEXITED and WEXITSTATUS */
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+#include "fanout.h"
+#include "../vmachine/bus.h"
+#include "../vmachine/defines.h"
+#include "../vmachine/io_controller.h"
+#include "../vmachine/loader.h"
+#include "../vmachine/memstore.h"
+
+#if IS_WINDOWS
+
+int fanout_run(fisc_cpu_t * c, const fanout_child_t * children, int count, int jobs, uint64_t max_instructions) {
+	printf("\n> ERROR: The fan-out needs fork(), which this host does not have\n");
+	return 1;
+}
+
+#else
+
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define FANOUT_IRQ_DEVICE 0 /* The timer (see the device table of io_controller.c) */
+
+/* Result of a child, as read back by the parent: */
+typedef struct {
+	fisc_cpu_t cpu;
+	uint64_t   executed;
+	uint32_t   page_count;
+	uint64_t * addresses; /* Ascending */
+	uint8_t  * pages;     /* page_count * MEMSTORE_PAGE_SIZE bytes */
+	char       ok;
+} fanout_result_t;
+
+static pid_t fanout_pid; /* The parent's */
+
+static void result_path(char * path, size_t size, int index) {
+	snprintf(path, size, FANOUT_RESULT_FILE, (long)fanout_pid, index);
+}
+
+static uint32_t page_len(uint64_t address) {
+	return memory_depth - address < MEMSTORE_PAGE_SIZE ? memory_depth - address : MEMSTORE_PAGE_SIZE;
+}
+
+/*********************************/
+/* Child side:                   */
+/*********************************/
+static char write_result(fisc_cpu_t * c, uint64_t executed, int index) {
+	char path[64];
+	result_path(path, sizeof(path), index);
+	FILE * fptr = fopen(path, "wb");
+	if(!fptr)
+		return 0;
+
+	uint32_t cpu_size = sizeof(fisc_cpu_t);
+	uint32_t page_count = 0;
+	uint64_t end = ((memory_depth - 1) >> MEMSTORE_PAGE_SHIFT) + 1;
+	for(uint64_t page = bitmap_next(&dirty_pages, 0, end); page < end; page = bitmap_next(&dirty_pages, page + 1, end))
+		page_count++;
+
+	fwrite(FANOUT_MAGIC, 1, 8, fptr);
+	fwrite(&cpu_size,    sizeof(cpu_size),   1, fptr);
+	fwrite(c,            cpu_size,           1, fptr);
+	fwrite(&executed,    sizeof(executed),   1, fptr);
+	fwrite(&page_count,  sizeof(page_count), 1, fptr);
+	for(uint64_t page = bitmap_next(&dirty_pages, 0, end); page < end; page = bitmap_next(&dirty_pages, page + 1, end)) {
+		uint64_t address = page << MEMSTORE_PAGE_SHIFT;
+		fwrite(&address, sizeof(address), 1, fptr);
+		fwrite(memstore_ptr(address, page_len(address), 0), 1, page_len(address), fptr);
+	}
+	return fclose(fptr) == 0;
+}
+
+static int child_main(fisc_cpu_t * c, const fanout_child_t * child, int index, uint64_t max_instructions) {
+	uint64_t executed = 0;
+
+	if(!bus_track_dirty(1))
+		return 1;
+	if(child->images && !load_memory(child->images))
+		return 1;
+
+	if(child->irq_at && (!max_instructions || child->irq_at < max_instructions)) {
+		executed = iss_run(c, child->irq_at);
+		if(!c->halted)
+			io_irq(FANOUT_IRQ_DEVICE, INT_IRQ);
+	}
+	if(!c->halted && (!max_instructions || executed < max_instructions))
+		executed += iss_run(c, max_instructions ? max_instructions - executed : 0);
+
+	iss_flags_sync(c);
+	return write_result(c, executed, index) ? 0 : 1;
+}
+
+/*********************************/
+/* Parent side:                  */
+/*********************************/
+static char read_result(fanout_result_t * r, int index) {
+	char path[64];
+	char magic[8];
+	uint32_t cpu_size;
+
+	memset(r, 0, sizeof(fanout_result_t));
+	result_path(path, sizeof(path), index);
+	FILE * fptr = fopen(path, "rb");
+	if(!fptr)
+		return 0;
+
+	if(fread(magic, 1, 8, fptr) != 8 || memcmp(magic, FANOUT_MAGIC, 8)
+		|| fread(&cpu_size, sizeof(cpu_size), 1, fptr) != 1 || cpu_size != sizeof(fisc_cpu_t)
+		|| fread(&r->cpu, cpu_size, 1, fptr) != 1
+		|| fread(&r->executed, sizeof(r->executed), 1, fptr) != 1
+		|| fread(&r->page_count, sizeof(r->page_count), 1, fptr) != 1)
+	{
+		fclose(fptr);
+		return 0;
+	}
+
+	r->addresses = malloc(r->page_count * sizeof(uint64_t) + 1);
+	r->pages     = malloc((size_t)r->page_count * MEMSTORE_PAGE_SIZE + 1);
+	r->ok        = r->addresses && r->pages;
+	for(uint32_t i = 0; r->ok && i < r->page_count; i++)
+		if(fread(&r->addresses[i], sizeof(uint64_t), 1, fptr) != 1 || r->addresses[i] >= memory_depth
+			|| fread(r->pages + (size_t)i * MEMSTORE_PAGE_SIZE, 1, page_len(r->addresses[i]), fptr) != page_len(r->addresses[i]))
+			r->ok = 0;
+	fclose(fptr);
+
+	if(!r->ok) {
+		free(r->addresses);
+		free(r->pages);
+		r->addresses = 0;
+		r->pages     = 0;
+	}
+	return r->ok;
+}
+
+/* The results are only read once, so they don't pile up in bin/ under every parent's pid */
+static void remove_results(int count) {
+	char path[64];
+	for(int i = 0; i < count; i++) {
+		result_path(path, sizeof(path), i);
+		unlink(path);
+	}
+}
+
+/* Contents of a page as a child left it: either it dirtied the page, or it is still the booted page */
+static const uint8_t * result_page(const fanout_result_t * r, uint32_t i, uint64_t address) {
+	if(i < r->page_count && r->addresses[i] == address)
+		return r->pages + (size_t)i * MEMSTORE_PAGE_SIZE;
+	return memstore_ptr(address, page_len(address), 0);
+}
+
+/* Compares a child against the reference child. Only the pages which either of them dirtied can differ */
+static void diff_result(const fanout_result_t * ref, const fanout_result_t * r) {
+	uint32_t reg_diffs = 0, page_diffs = 0;
+
+	printf("  registers:");
+	for(int reg = 0; reg < ISS_REGISTER_COUNT; reg++) {
+		if(ref->cpu.x[reg] == r->cpu.x[reg])
+			continue;
+		if(reg_diffs++ < FANOUT_MAX_LISTED)
+			printf(" X%d", reg);
+	}
+	if(ref->cpu.pc != r->cpu.pc && reg_diffs++ < FANOUT_MAX_LISTED)
+		printf(" PC");
+	if(ref->cpu.cpsr != r->cpu.cpsr && reg_diffs++ < FANOUT_MAX_LISTED)
+		printf(" CPSR");
+	printf(reg_diffs ? (reg_diffs > FANOUT_MAX_LISTED ? " ... (%u)\n" : " (%u)\n") : " same\n", reg_diffs);
+
+	printf("  pages:");
+	uint32_t i = 0, j = 0;
+	while(i < ref->page_count || j < r->page_count) {
+		uint64_t a = i < ref->page_count ? ref->addresses[i] : UINT64_MAX;
+		uint64_t b = j < r->page_count   ? r->addresses[j]   : UINT64_MAX;
+		uint64_t address = a < b ? a : b;
+		if(memcmp(result_page(ref, i, address), result_page(r, j, address), page_len(address)) && page_diffs++ < FANOUT_MAX_LISTED)
+			printf(" 0x%" PRIx64, address);
+		if(a == address) i++;
+		if(b == address) j++;
+	}
+	printf(page_diffs ? (page_diffs > FANOUT_MAX_LISTED ? " ... (%u)\n" : " (%u)\n") : " same\n", page_diffs);
+}
+
+int fanout_run(fisc_cpu_t * c, const fanout_child_t * children, int count, int jobs, uint64_t max_instructions) {
+	static pid_t pids[FANOUT_MAX_CHILDREN];
+	static char  child_failed[FANOUT_MAX_CHILDREN]; /* Its result file is not to be read */
+	int next = 0, running = 0, failed = 0;
+
+	if(count > FANOUT_MAX_CHILDREN)
+		count = FANOUT_MAX_CHILDREN;
+	if(jobs <= 0)
+		jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if(jobs <= 0)
+		jobs = 1;
+
+	fanout_pid = getpid();
+	printf("> Fan-out: %d children, %d at a time, from instruction %" PRIu64 "\n", count, jobs, c->instret);
+
+	while(next < count || running) {
+		if(next < count && running < jobs) {
+			/* A result file left over by an earlier run must not pass for this child's: */
+			char path[64];
+			result_path(path, sizeof(path), next);
+			unlink(path);
+			child_failed[next] = 0;
+
+			fflush(stdout); /* Or the children would print the parent's buffered output again */
+			pid_t pid = fork();
+			if(pid == 0)
+				_exit(child_main(c, &children[next], next, max_instructions));
+			if(pid < 0) {
+				printf("\n> ERROR: Could not fork the child %d\n", next);
+				child_failed[next] = 1;
+				failed++;
+			} else {
+				running++;
+			}
+			pids[next++] = pid;
+			continue;
+		}
+
+		int status;
+		pid_t pid = wait(&status);
+		if(pid < 0)
+			break;
+		running--;
+		if(!WIFEXITED(status) || WEXITSTATUS(status)) {
+			for(int i = 0; i < next; i++) {
+				if(pids[i] == pid) {
+					printf("\n> ERROR: The child %d failed\n", i);
+					child_failed[i] = 1;
+				}
+			}
+			failed++;
+		}
+	}
+
+	/* Gather the results and diff them against the first child's: */
+	fanout_result_t ref, r;
+	if(child_failed[0] || !read_result(&ref, 0)) {
+		printf("\n> ERROR: Could not read the result of the child 0\n");
+		remove_results(count);
+		return 1;
+	}
+	for(int i = 0; i < count; i++) {
+		if(i && child_failed[i])
+			continue; /* Already reported */
+		if(i && !read_result(&r, i)) {
+			printf("\n> ERROR: Could not read the result of the child %d\n", i);
+			failed++;
+			continue;
+		}
+		const fanout_result_t * res = i ? &r : &ref;
+		printf("> Fan-out child %d (%s", i, children[i].images ? children[i].images : "no images");
+		if(children[i].irq_at)
+			printf(", IRQ at %" PRIu64, children[i].irq_at);
+		printf("): %s after %" PRIu64 " instructions, %u dirty pages%s\n", res->cpu.halted ? "Halted" : "Stopped",
+			res->executed, res->page_count, i ? "" : " (reference)");
+		if(i) {
+			diff_result(&ref, &r);
+			free(r.addresses);
+			free(r.pages);
+		}
+	}
+	free(ref.addresses);
+	free(ref.pages);
+	remove_results(count);
+	return failed != 0;
+}
+
+#endif
@@ -0,0 +1,33 @@
+/*
+ * fanout.h
+ *
+ *  Created on: 15/01/2017
+ *      Author: Miguel
+ */
+
+#ifndef SRC_ISS_FANOUT_H_
+#define SRC_ISS_FANOUT_H_
+
+#include <stdint.h>
+#include "iss.h"
+
+/* Regression fan-out: a simulator which has already booted forks one child per test. The children share the Main Memory
+ * (and everything else) copy on write with the parent, so neither the boot nor the memory is paid for more than once.
+ * Each child loads its own images on top of the booted memory (a test vector), optionally raises an interrupt after
+ * some number of instructions, runs, and writes its result: the registers plus the pages it dirtied.
+ * The parent then diffs every child against the first one, only looking at the pages which either of them dirtied.
+ * Only available on POSIX hosts (it needs fork) */
+
+#define FANOUT_MAX_CHILDREN 256
+#define FANOUT_MAGIC        "FISCDLT1"
+#define FANOUT_RESULT_FILE  "bin/fanout_%ld_%d.delta" /* Where each child writes its result (by the parent's pid, so runs can overlap) */
+#define FANOUT_MAX_LISTED   8                         /* Differences listed per child */
+
+typedef struct {
+	const char * images; /* Loaded on top of the booted memory (a list for load_memory), or 0 */
+	uint64_t     irq_at; /* Raise a timer interrupt after this many instructions (0: never) */
+} fanout_child_t;
+
+int fanout_run(fisc_cpu_t * c, const fanout_child_t * children, int count, int jobs, uint64_t max_instructions);
+
+#endif /* SRC_ISS_FANOUT_H_ */
@@ -0,0 +1,609 @@
+/*
+ * iss.c
+ *
+ *  Created on: 02/01/2017
+ *      Author: Miguel
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+#include "iss.h"
+#include "block_cache.h"
+#include "jit.h"
+#include "../vmachine/bus.h"
+#include "../vmachine/defines.h"
+#include "../vmachine/io_controller.h"
+#include "../vmachine/irq_queue.h"
+#include "../vmachine/mmu.h"
+#include "../vmachine/scheduler.h"
+
+#define SEXT(val, bits) ((int64_t)((uint64_t)(val) << (64 - (bits))) >> (64 - (bits)))
+
+/* ALU functions (see rtl/alu.vhd): */
+enum ALU_FUNC {
+	ALU_AND, ALU_ORR, ALU_EOR, ALU_ADD, ALU_SUB, ALU_NEG, ALU_NOT,
+	ALU_SMUL, ALU_UMUL, ALU_SDIV, ALU_UDIV, ALU_PASSB, ALU_LSL, ALU_LSR
+};
+
+fisc_cpu_t cpu;
+
+char iss_use_block_cache = 1; /* 0: Fetch and decode every instruction (plain interpreter) */
+
+/* Loads and stores go through these. The lockstep checker (cosim.c) replaces them so that the reference model never touches the memory or the devices */
+uint64_t (*iss_load)(uint64_t phys_addr, uint8_t access_width) = bus_read;
+char     (*iss_store)(uint64_t phys_addr, uint64_t data, uint8_t access_width) = bus_write;
+
+void iss_reset(fisc_cpu_t * c) {
+	memset(c, 0, sizeof(fisc_cpu_t));
+	c->cpsr     = CPSR_RESET_VALUE;
+	c->old_mode = MODE_KERNEL;
+	c->load_rd  = -1;
+	for(int i = 0; i < 8; i++)
+		c->spsr[i] = MODE_KERNEL;
+	mmu_set_enabled(0);
+	mmu_set_pdp(0);
+	block_cache_init();
+}
+
+/*********************************/
+/* Register and ALU emulation:   */
+/*********************************/
+static inline uint64_t reg_rd(fisc_cpu_t * c, uint8_t reg) {
+	return reg == ISS_REGISTER_COUNT-1 ? 0 : c->x[reg]; /* XZR always reads as zero */
+}
+
+static inline void reg_wr(fisc_cpu_t * c, uint8_t reg, uint64_t data) {
+	if(reg != ISS_REGISTER_COUNT-1)
+		c->x[reg] = data;
+}
+
+/* Upper 64 bits of the unsigned 128 bit product a*b */
+static uint64_t umulh(uint64_t a, uint64_t b) {
+	uint64_t a_lo = (uint32_t)a, a_hi = a >> 32;
+	uint64_t b_lo = (uint32_t)b, b_hi = b >> 32;
+	uint64_t lo_lo = a_lo * b_lo;
+	uint64_t hi_lo = a_hi * b_lo;
+	uint64_t lo_hi = a_lo * b_hi;
+	uint64_t cross = (lo_lo >> 32) + (uint32_t)hi_lo + lo_hi;
+	return a_hi * b_hi + (hi_lo >> 32) + (cross >> 32);
+}
+
+/* The RTL's ALU sign extends both operands into 65 bits, saturates the result whenever bit 64 differs from bit 63
+ * and derives the flags from the unsaturated result. Here the 65 bit values are kept as 'lo' (bits 63..0) and 'hi' (bit 64) */
+static uint64_t alu(fisc_cpu_t * c, enum ALU_FUNC func, uint64_t a, uint64_t b, char set_flags) {
+	uint64_t lo = 0;
+	uint8_t  hi = 0;
+	uint8_t  ha = a >> 63;
+	uint8_t  hb = b >> 63;
+
+	switch(func) {
+		case ALU_AND: lo = a & b; hi = ha & hb; break;
+		case ALU_ORR: lo = a | b; hi = ha | hb; break;
+		case ALU_EOR: lo = a ^ b; hi = ha ^ hb; break;
+		case ALU_ADD:
+			lo = a + b;
+			hi = (ha + hb + (lo < a)) & 1;
+			break;
+		case ALU_SUB: {
+			uint64_t t = a + ~b;
+			lo = t + 1;
+			hi = (ha + !hb + ((t < a) | (lo == 0))) & 1;
+			break;
+		}
+		case ALU_NEG:
+			lo = ~b + 1;
+			hi = (!hb + (lo == 0)) & 1;
+			break;
+		case ALU_NOT:   lo = ~b; hi = !hb; break;
+		case ALU_PASSB: lo = b;  hi = hb;  break;
+		case ALU_SMUL:
+			lo = a * b;
+			hi = (umulh(a, b) - (ha ? b : 0) - (hb ? a : 0)) & 1;
+			break;
+		case ALU_UMUL:
+			lo = a * b;
+			hi = (umulh(a, b) + (ha & b) + (hb & a)) & 1;
+			break;
+		case ALU_SDIV: {
+			int64_t divisor = (int64_t)b > 0 ? (int64_t)b : 1; /* The RTL divides by 1 when the divisor is not positive */
+			lo = (uint64_t)((int64_t)a / divisor);
+			hi = lo >> 63;
+			break;
+		}
+		case ALU_UDIV: {
+			uint64_t divisor = (int64_t)b > 0 ? b : 1;
+			if(!ha) {
+				lo = a / divisor;
+			} else {
+				/* The dividend is 2^64 + a: */
+				uint64_t q1 = UINT64_MAX / divisor, r1 = UINT64_MAX % divisor;
+				uint64_t q2 = a / divisor,          r2 = a % divisor;
+				uint64_t q  = q1 + q2;
+				hi = q < q1;
+				lo = q + (r1 + 1 + r2 >= divisor);
+				hi = (hi + (lo < q)) & 1;
+			}
+			break;
+		}
+		case ALU_LSL:
+			if(hb || b > 64) break;
+			if(b == 0)       { lo = a; hi = ha; }
+			else if(b == 64) { lo = 0; hi = a & 1; }
+			else             { lo = a << b; hi = (a >> (64 - b)) & 1; }
+			break;
+		case ALU_LSR:
+			if(hb || b > 64) break;
+			if(b == 0)       { lo = a; hi = ha; }
+			else if(b == 64) { lo = ha; }
+			else             { lo = (a >> b) | ((uint64_t)ha << (64 - b)); }
+			break;
+	}
+
+	if(set_flags) {
+		c->flags_lazy = 0;
+		c->cpsr &= ~(CPSR_N | CPSR_Z | CPSR_V | CPSR_C);
+		if(lo >> 63) c->cpsr |= CPSR_N;
+		if(!lo)      c->cpsr |= CPSR_Z;
+		if(hi)       c->cpsr |= CPSR_C; /* The RTL never raises the overflow flag */
+	}
+
+	if(hi != (lo >> 63))
+		return hi ? 0x8000000000000000 : 0x7FFFFFFFFFFFFFFF;
+	return lo;
+}
+
+static char branch_cond(fisc_cpu_t * c, uint8_t cond) {
+	iss_flags_sync(c);
+	char n = (c->cpsr & CPSR_N) != 0;
+	char z = (c->cpsr & CPSR_Z) != 0;
+	char v = (c->cpsr & CPSR_V) != 0;
+	char cr = (c->cpsr & CPSR_C) != 0;
+	switch(cond) {
+		case 0:  return z;                 /* EQ */
+		case 1:  return !z;                /* NE */
+		case 2:  return n != v;            /* LT */
+		case 3:  return !(!z && n == v);   /* LE */
+		case 4:  return !z && n == v;      /* GT */
+		case 5:  return n == v;            /* GE */
+		case 6:  return !cr;               /* LO */
+		case 7:  return !(!z && cr);       /* LS */
+		case 8:  return !z && cr;          /* HI */
+		case 9:  return cr;                /* HS */
+		case 10: return n;                 /* MI */
+		case 11: return !n;                /* PL */
+		case 12: return v;                 /* VS */
+		case 13: return !v;                /* VC */
+		default: return 0;
+	}
+}
+
+/*********************************/
+/* Status register emulation:    */
+/*********************************/
+static uint16_t cpsr_field_rd(uint16_t reg, uint8_t field) {
+	switch(field) {
+		case 0:  return reg;
+		case 1:  return (reg >> 7) & 0xF;
+		case 2:  return (reg >> 10) & 1;
+		case 3:  return (reg >> 9) & 1;
+		case 4:  return (reg >> 8) & 1;
+		case 5:  return (reg >> 7) & 1;
+		case 6:  return (reg >> 6) & 1;
+		case 7:  return (reg >> 5) & 1;
+		case 8:  return (reg >> 3) & 3;
+		case 9:  return (reg >> 4) & 1; /* The RTL returns IEN1 for both fields 9 and 10 */
+		case 10: return (reg >> 4) & 1;
+		case 11: return reg & CPSR_MODE;
+		default: return 0;
+	}
+}
+
+static uint16_t cpsr_field_wr(uint16_t reg, uint8_t field, uint64_t data) {
+	static const struct { uint8_t lsb, width; } fields[] = {
+		{0, 11}, {7, 4}, {10, 1}, {9, 1}, {8, 1}, {7, 1}, {6, 1}, {5, 1}, {3, 2}, {3, 1}, {4, 1}, {0, 3}
+	};
+	if(field >= sizeof(fields) / sizeof(fields[0])) return reg; /* The RTL ignores writes into the fields past 11 */
+	uint16_t mask = ((1 << fields[field].width) - 1) << fields[field].lsb;
+	return (reg & ~mask) | (((uint16_t)data << fields[field].lsb) & mask);
+}
+
+/* Enters an interrupt / exception handler */
+void iss_interrupt(fisc_cpu_t * c, uint8_t id, enum INTERRUPT_TYPE type) {
+	iss_flags_sync(c);
+	uint8_t mode = c->cpsr & CPSR_MODE;
+
+	/* Save context: */
+	c->spsr[mode] = c->cpsr;
+	c->cpsr &= ~(type == INT_ERR ? CPSR_IEN0 : CPSR_IEN1);
+	c->old_mode = mode;
+	c->elr = c->pc;
+
+	/* Change mode and jump into the vector: */
+	c->cpsr = (c->cpsr & ~CPSR_MODE) | (type == INT_ERR ? MODE_EXCEPTION : type == INT_IRQ ? MODE_IRQ : MODE_SIRQ);
+	c->int_id = id;
+	if(type == INT_ERR)
+		c->esr = id;
+	c->pc = (type == INT_ERR ? c->evp : c->ivp) + id * 4;
+	c->cycles += 3; /* The CPU spends a cycle on each of the states savectx, changemode and jmpint / jmpex */
+}
+
+/* Leaves an interrupt / exception handler (RETI) */
+static void iss_interrupt_return(fisc_cpu_t * c) {
+	iss_flags_sync(c);
+	uint16_t cpsr = c->cpsr;
+
+	c->spsr[cpsr & CPSR_MODE] = cpsr;
+	c->cpsr = c->spsr[c->old_mode];
+	if(!(cpsr & CPSR_IEN0))
+		c->cpsr |= CPSR_IEN0;
+	else if(!(cpsr & CPSR_IEN1))
+		c->cpsr |= CPSR_IEN1;
+	c->old_mode = cpsr & CPSR_MODE;
+	c->pc = c->elr;
+
+	mmu_set_enabled((c->cpsr & CPSR_PG) != 0);
+	io_ack_dispatch(c->int_id);
+	c->irq_pending = irq_any_pending(); /* The requests which waited for the handler to return */
+}
+
+/*********************************/
+/* Instruction decoding:         */
+/*********************************/
+char iss_decode(uint32_t instruction, iss_insn_t * insn) {
+	insn->op    = OP_UNDEF;
+	insn->rd    = instruction & 0x1F;
+	insn->rn    = (instruction >> 5) & 0x1F;
+	insn->rm    = (instruction >> 16) & 0x1F;
+	insn->width = (instruction >> 10) & 0x3;
+	insn->imm   = 0;
+	insn->off   = 0;
+
+	/* Decode with the same priority as the microcode unit: 11 bit opcodes first, then 10, 8 and 6 bit opcodes */
+	uint32_t opcode = instruction >> 21;
+
+	switch(opcode) {
+		case ISS_HALT_OPCODE: insn->op = OP_HALT; return 1;
+		case 0x458: insn->op = OP_ADD;   return 1;
+		case 0x558: insn->op = OP_ADDS;  return 1;
+		case 0x658: insn->op = OP_SUB;   return 1;
+		case 0x758: insn->op = OP_SUBS;  return 1;
+		case 0x4D8: insn->op = OP_MUL;   return 1;
+		case 0x4DA: insn->op = OP_SMULH; return 1;
+		case 0x4DE: insn->op = OP_UMULH; return 1;
+		case 0x4D6: insn->op = OP_SDIV;  return 1;
+		case 0x4D7: insn->op = OP_UDIV;  return 1;
+		case 0x450: insn->op = OP_AND;   return 1;
+		case 0x750: insn->op = OP_ANDS;  return 1;
+		case 0x550: insn->op = OP_ORR;   return 1;
+		case 0x650: insn->op = OP_EOR;   return 1;
+		case 0x69B: insn->op = OP_LSL; insn->imm = (instruction >> 10) & 0x3F; return 1;
+		case 0x69A: insn->op = OP_LSR; insn->imm = (instruction >> 10) & 0x3F; return 1;
+		case 0x6B0: insn->op = OP_BR;    return 1;
+		case 0x768: insn->op = OP_NEG;   return 1;
+		case 0x769: insn->op = OP_NOT;   return 1;
+		case 0x614: insn->op = OP_MSR;   return 1;
+		case 0x5F4: insn->op = OP_MRS;   return 1;
+		case 0x5D4: insn->op = OP_LIVP;  return 1;
+		case 0x5B4: insn->op = OP_SIVP;  return 1;
+		case 0x594: insn->op = OP_LEVP;  return 1;
+		case 0x574: insn->op = OP_SEVP;  return 1;
+		case 0x554: insn->op = OP_SESR;  return 1;
+		case 0x544: insn->op = OP_LDPC;  return 1;
+		case 0x4F4: insn->op = OP_LPDP;  return 1;
+		case 0x4D4: insn->op = OP_SPDP;  return 1;
+		case 0x4B4: insn->op = OP_LPFLA; return 1;
+		/* Loads and stores (the access width is encoded on bits 11..10): */
+		case 0x7C2: /* LDR   */
+		case 0x1C2: /* LDRB  */
+		case 0x3C2: /* LDRH  */
+		case 0x5C4: /* LDRSW */
+		case 0x642: /* LDXR  */
+			insn->op = OP_LDR; insn->imm = (instruction >> 12) & 0x1FF; return 1;
+		case 0x7C0: /* STR  */
+		case 0x1C0: /* STRB */
+		case 0x3C0: /* STRH */
+		case 0x5C0: /* STRW */
+		case 0x640: /* STXR */
+			insn->op = OP_STR; insn->imm = (instruction >> 12) & 0x1FF; return 1;
+		case 0x7D2: /* LDRR   */
+		case 0x1D2: /* LDRBR  */
+		case 0x3D2: /* LDRHR  */
+		case 0x4C4: /* LDRSWR */
+		case 0x652: /* LDXRR  */
+			insn->op = OP_LDRR; insn->imm = (instruction >> 12) & 0x1FF; return 1;
+		case 0x7D0: /* STRR  */
+		case 0x1D0: /* STRBR */
+		case 0x3D0: /* STRHR */
+		case 0x5D0: /* STRWR */
+		case 0x5D1: /* STXRR */
+			insn->op = OP_STRR; insn->imm = (instruction >> 12) & 0x1FF; return 1;
+	}
+
+	/* MOVK and MOVZ (the quadrant is encoded on bits 22..21): */
+	if((opcode >> 2) == 0x1E5 || (opcode >> 2) == 0x1A5) {
+		insn->op    = (opcode >> 2) == 0x1E5 ? OP_MOVK : OP_MOVZ;
+		insn->width = opcode & 0x3;
+		insn->imm   = (instruction >> 5) & 0xFFFF;
+		return 1;
+	}
+
+	insn->imm = (instruction >> 10) & 0xFFF;
+	switch(opcode >> 1) {
+		case 0x244: insn->op = OP_ADDI;  return 1;
+		case 0x2C4: insn->op = OP_ADDIS; return 1;
+		case 0x344: insn->op = OP_SUBI;  return 1;
+		case 0x3C4: insn->op = OP_SUBIS; return 1;
+		case 0x248: insn->op = OP_ANDI;  return 1;
+		case 0x3C8: insn->op = OP_ANDIS; return 1;
+		case 0x2C8: insn->op = OP_ORRI;  return 1;
+		case 0x348: insn->op = OP_EORI;  return 1;
+		case 0x1C4: insn->op = OP_NEGI;  return 1;
+		case 0x144: insn->op = OP_NOTI;  return 1;
+	}
+	insn->imm = 0;
+
+	insn->off = SEXT((instruction >> 5) & 0x7FFFF, 19) * 4;
+	switch(opcode >> 3) {
+		case 0x54: insn->op = OP_BCOND; return 1;
+		case 0xB5: insn->op = OP_CBNZ;  return 1;
+		case 0xB4: insn->op = OP_CBZ;   return 1;
+	}
+
+	insn->off = SEXT(instruction & 0x3FFFFFF, 26) * 4;
+	switch(opcode >> 5) {
+		case 0x05: insn->op = OP_B;    return 1;
+		case 0x25: insn->op = OP_BL;   return 1;
+		case 0x28: insn->op = OP_RETI; return 1;
+		case 0x29: insn->op = OP_SINT; insn->imm = instruction & 0xFF; return 1;
+	}
+	insn->off = 0;
+
+	return 0; /* The microcode runs the NULL instruction for unknown opcodes */
+}
+
+/*********************************/
+/* Instruction execution:        */
+/*********************************/
+static uint64_t iss_data_address(fisc_cpu_t * c, const iss_insn_t * insn, char pc_relative) {
+	uint8_t  ae = (c->cpsr & CPSR_AE) != 0;
+	uint64_t vaddress = reg_rd(c, insn->rn) + insn->imm;
+	if(pc_relative)
+		vaddress += ae ? c->pc / 4 : c->pc;
+	return address_translate(address_align(vaddress & ISS_ADDRESS_MASK, insn->width, ae));
+}
+
+char iss_execute(fisc_cpu_t * c, const iss_insn_t * insn) {
+	uint64_t next_pc = c->pc + 4;
+
+	/* Approximate the pipeline's load-use stall: */
+	if(c->load_rd >= 0 && (insn->rn == c->load_rd || insn->rm == c->load_rd))
+		c->cycles++;
+	c->load_rd = -1;
+	c->cycles++;
+
+	switch(insn->op) {
+		case OP_ADD:   reg_wr(c, insn->rd, alu(c, ALU_ADD, reg_rd(c, insn->rn), reg_rd(c, insn->rm), 0)); break;
+		case OP_ADDS:  reg_wr(c, insn->rd, alu(c, ALU_ADD, reg_rd(c, insn->rn), reg_rd(c, insn->rm), 1)); break;
+		case OP_ADDI:  reg_wr(c, insn->rd, alu(c, ALU_ADD, reg_rd(c, insn->rn), insn->imm, 0)); break;
+		case OP_ADDIS: reg_wr(c, insn->rd, alu(c, ALU_ADD, reg_rd(c, insn->rn), insn->imm, 1)); break;
+		case OP_SUB:   reg_wr(c, insn->rd, alu(c, ALU_SUB, reg_rd(c, insn->rn), reg_rd(c, insn->rm), 0)); break;
+		case OP_SUBS:  reg_wr(c, insn->rd, alu(c, ALU_SUB, reg_rd(c, insn->rn), reg_rd(c, insn->rm), 1)); break;
+		case OP_SUBI:  reg_wr(c, insn->rd, alu(c, ALU_SUB, reg_rd(c, insn->rn), insn->imm, 0)); break;
+		case OP_SUBIS: reg_wr(c, insn->rd, alu(c, ALU_SUB, reg_rd(c, insn->rn), insn->imm, 1)); break;
+		case OP_MUL:
+		case OP_SMULH: /* SMULH and UMULH are unimplemented on the RTL (they return the lower half of the product) */
+			reg_wr(c, insn->rd, alu(c, ALU_SMUL, reg_rd(c, insn->rn), reg_rd(c, insn->rm), 0)); break;
+		case OP_UMULH: reg_wr(c, insn->rd, alu(c, ALU_UMUL, reg_rd(c, insn->rn), reg_rd(c, insn->rm), 0)); break;
+		case OP_SDIV:  reg_wr(c, insn->rd, alu(c, ALU_SDIV, reg_rd(c, insn->rn), reg_rd(c, insn->rm), 0)); break;
+		case OP_UDIV:  reg_wr(c, insn->rd, alu(c, ALU_UDIV, reg_rd(c, insn->rn), reg_rd(c, insn->rm), 0)); break;
+		case OP_AND:   reg_wr(c, insn->rd, alu(c, ALU_AND, reg_rd(c, insn->rn), reg_rd(c, insn->rm), 0)); break;
+		case OP_ANDS:  reg_wr(c, insn->rd, alu(c, ALU_AND, reg_rd(c, insn->rn), reg_rd(c, insn->rm), 1)); break;
+		case OP_ANDI:  reg_wr(c, insn->rd, alu(c, ALU_AND, reg_rd(c, insn->rn), insn->imm, 0)); break;
+		case OP_ANDIS: reg_wr(c, insn->rd, alu(c, ALU_AND, reg_rd(c, insn->rn), insn->imm, 1)); break;
+		case OP_ORR:   reg_wr(c, insn->rd, alu(c, ALU_ORR, reg_rd(c, insn->rn), reg_rd(c, insn->rm), 0)); break;
+		case OP_ORRI:  reg_wr(c, insn->rd, alu(c, ALU_ORR, reg_rd(c, insn->rn), insn->imm, 0)); break;
+		case OP_EOR:   reg_wr(c, insn->rd, alu(c, ALU_EOR, reg_rd(c, insn->rn), reg_rd(c, insn->rm), 0)); break;
+		case OP_EORI:  reg_wr(c, insn->rd, alu(c, ALU_EOR, reg_rd(c, insn->rn), insn->imm, 0)); break;
+		case OP_LSL:   reg_wr(c, insn->rd, alu(c, ALU_LSL, reg_rd(c, insn->rn), insn->imm, 0)); break;
+		case OP_LSR:   reg_wr(c, insn->rd, alu(c, ALU_LSR, reg_rd(c, insn->rn), insn->imm, 0)); break;
+		/* NEG and NOT read their operand from Rd (reg2loc): */
+		case OP_NEG:   reg_wr(c, insn->rd, alu(c, ALU_NEG, 0, reg_rd(c, insn->rd), 0)); break;
+		case OP_NOT:   reg_wr(c, insn->rd, alu(c, ALU_NOT, 0, reg_rd(c, insn->rd), 0)); break;
+		case OP_NEGI:  reg_wr(c, insn->rd, alu(c, ALU_NEG, 0, insn->imm, 0)); break;
+		case OP_NOTI:  reg_wr(c, insn->rd, alu(c, ALU_NOT, 0, insn->imm, 0)); break;
+		case OP_MOVK: {
+			uint8_t shift = insn->width * 16;
+			reg_wr(c, insn->rd, (reg_rd(c, insn->rd) & ~(0xFFFFULL << shift)) | (insn->imm << shift));
+			break;
+		}
+		case OP_MOVZ: reg_wr(c, insn->rd, insn->imm << (insn->width * 16)); break;
+
+		/* Branches: */
+		case OP_B:
+			if(!insn->off && !(c->cpsr & CPSR_IEN1)) {
+				c->halted = 1; /* HALT: nothing can break out of this loop */
+				break;
+			}
+			next_pc = c->pc + insn->off;
+			c->cycles++;
+			break;
+		case OP_BL:
+			reg_wr(c, 30, (c->pc >> 2) + 1);
+			next_pc = c->pc + insn->off;
+			c->cycles++;
+			break;
+		case OP_BR:
+			next_pc = reg_rd(c, insn->rd) << 2;
+			c->cycles++;
+			break;
+		case OP_BCOND:
+			if(branch_cond(c, insn->rd)) { next_pc = c->pc + insn->off; c->cycles++; }
+			break;
+		case OP_CBZ:
+			if(!reg_rd(c, insn->rd)) { next_pc = c->pc + insn->off; c->cycles++; }
+			break;
+		case OP_CBNZ:
+			if(reg_rd(c, insn->rd))  { next_pc = c->pc + insn->off; c->cycles++; }
+			break;
+
+		/* Loads and stores: */
+		case OP_LDR:
+		case OP_LDRR:
+			reg_wr(c, insn->rd, iss_load(iss_data_address(c, insn, insn->op == OP_LDRR), insn->width));
+			c->load_rd = insn->rd;
+			c->cycles++;
+			break;
+		case OP_STR:
+		case OP_STRR:
+			iss_store(iss_data_address(c, insn, insn->op == OP_STRR), reg_rd(c, insn->rd), insn->width);
+			c->cycles++;
+			break;
+
+		/* Status and special registers: */
+		case OP_MSR: {
+			iss_flags_sync(c);
+			uint16_t * reg = (insn->rd & 0x10) ? &c->spsr[c->cpsr & CPSR_MODE] : &c->cpsr;
+			*reg = cpsr_field_wr(*reg, insn->rd & 0xF, reg_rd(c, insn->rn));
+			mmu_set_enabled((c->cpsr & CPSR_PG) != 0);
+			c->irq_pending = irq_any_pending(); /* Interrupts may have just been enabled */
+			break;
+		}
+		case OP_MRS: {
+			iss_flags_sync(c);
+			uint16_t reg = (insn->rn & 0x10) ? c->spsr[c->cpsr & CPSR_MODE] : c->cpsr;
+			reg_wr(c, insn->rd, cpsr_field_rd(reg, insn->rn & 0xF));
+			break;
+		}
+		case OP_LIVP:  c->ivp = reg_rd(c, insn->rd); break;
+		case OP_SIVP:  reg_wr(c, insn->rd, c->ivp);  break;
+		case OP_LEVP:  c->evp = reg_rd(c, insn->rd); break;
+		case OP_SEVP:  reg_wr(c, insn->rd, c->evp);  break;
+		case OP_SESR:  reg_wr(c, insn->rd, c->esr);  break;
+		case OP_LDPC:  reg_wr(c, 30, c->pc + 4);     break;
+		case OP_LPDP:
+			c->pdp = reg_rd(c, insn->rd);
+			mmu_set_pdp(c->pdp);
+			break;
+		case OP_SPDP:  reg_wr(c, insn->rd, c->pdp);  break;
+		case OP_LPFLA: reg_wr(c, 30, c->pfla);       break;
+
+		/* Interrupts: */
+		case OP_RETI:
+			c->instret++;
+			iss_interrupt_return(c);
+			return 1;
+		case OP_SINT:
+			c->instret++;
+			c->pc = next_pc;
+			iss_interrupt(c, insn->imm, INT_SIRQ);
+			return 1;
+
+		case OP_HALT:
+			c->halted = 1;
+			break;
+		case OP_UNDEF:
+		default:
+			break; /* The RTL runs undefined instructions as a NOP */
+	}
+
+	if(c->halted)
+		return 0;
+
+	c->pc = next_pc;
+	c->instret++;
+	return 1;
+}
+
+/* Takes the most urgent interrupt request which the CPU has enabled. The others stay queued until the CPU returns from the
+ * handler or changes the CPSR (which look at the queue again), or until the next request */
+static inline void iss_service_irq(fisc_cpu_t * c) {
+	if(c->irq_pending) {
+		uint8_t devid;
+		enum INTERRUPT_TYPE type;
+		uint8_t types = ((c->cpsr & CPSR_IEN0) ? IRQ_TYPE_BIT(INT_ERR) : 0)
+		              | ((c->cpsr & CPSR_IEN1) ? IRQ_TYPE_BIT(INT_IRQ) | IRQ_TYPE_BIT(INT_SIRQ) : 0);
+		c->irq_pending = 0;
+		if(irq_pop(types, &devid, &type))
+			iss_interrupt(c, devid, type);
+	}
+}
+
+char iss_step(fisc_cpu_t * c) {
+	iss_insn_t insn;
+
+	if(c->halted) return 0;
+	iss_service_irq(c);
+
+	/* Fetch, decode and execute: */
+	uint32_t instruction = (uint32_t)bus_read(address_translate(c->pc & ISS_ADDRESS_MASK), SZ_32);
+	iss_decode(instruction, &insn);
+	return iss_execute(c, &insn);
+}
+
+/* An instruction takes at most this many cycles: an SINT after a load into one of its operands takes one for the load-use
+ * stall, one to execute and three to enter the handler (a taken branch, a load or a store take one less) */
+#define ISS_MAX_CPI 5
+
+/* Runs a whole basic block out of the Block Cache, stopping early once the next event is due (see iss_run).
+ * Returns the number of retired instructions */
+static uint64_t iss_run_block(fisc_cpu_t * c, uint64_t budget) {
+	uint64_t start = c->instret;
+
+	iss_service_irq(c);
+
+	iss_block_t * blk = block_cache_lookup(address_translate(c->pc & ISS_ADDRESS_MASK));
+	if(!blk) {
+		iss_step(c); /* Code which runs from the IO space is never cached */
+		return c->instret - start;
+	}
+
+	/* Hot blocks run as host code. They can't look at the scheduler, so they only get as many instructions as surely fit
+	 * before the next event: */
+	uint64_t jit_budget = sched_until_next(c->cycles) / ISS_MAX_CPI;
+	if(jit_budget > budget)
+		jit_budget = budget;
+	if(iss_use_jit && blk->count <= jit_budget && (blk->jit || (++blk->execs >= JIT_HOT_THRESHOLD && jit_translate(blk)))) {
+		jit_run(c, blk, jit_budget);
+		return c->instret - start;
+	}
+
+	for(int i = 0; i < blk->count && c->instret - start < budget && c->cycles < sched_next; i++) {
+		const iss_insn_t * insn = &blk->insns[i];
+		if(!iss_execute(c, insn))
+			break;
+		/* A store may have overwritten the rest of this block: */
+		if((insn->op == OP_STR || insn->op == OP_STRR) && !blk->valid)
+			break;
+	}
+	return c->instret - start;
+}
+
+/* The devices' events run on the cycle counter (see scheduler.h). The interpreter stops a block on the instruction which
+ * reaches the next event, and the JIT runs no more instructions than fit before it at ISS_MAX_CPI, so an event fires
+ * at most one instruction late */
+uint64_t iss_run(fisc_cpu_t * c, uint64_t max_instructions) {
+	uint64_t start = c->instret;
+	if(!iss_use_block_cache) {
+		while(!max_instructions || c->instret - start < max_instructions) {
+			sched_run(c->cycles);
+			if(!iss_step(c))
+				break;
+		}
+	} else {
+		while(!c->halted && (!max_instructions || c->instret - start < max_instructions)) {
+			sched_run(c->cycles);
+			iss_run_block(c, max_instructions ? max_instructions - (c->instret - start) : UINT64_MAX);
+		}
+	}
+	return c->instret - start;
+}
+
+void iss_dump_registers(fisc_cpu_t * c) {
+	iss_flags_sync(c);
+	printf("\n> Registers:\n");
+	for(int i = 0; i < ISS_REGISTER_COUNT; i++)
+		printf("X%-2d: 0x%016" PRIx64 "%s", i, reg_rd(c, i), (i % 4 == 3) ? "\n" : "  ");
+	printf("PC : 0x%016" PRIx64 "  CPSR: 0x%03x  ELR: 0x%016" PRIx64 "  PDP: 0x%016" PRIx64 "\n", c->pc, c->cpsr, c->elr, c->pdp);
+	printf("IVP: 0x%016" PRIx64 "  EVP : 0x%016" PRIx64 "  ESR: 0x%02x\n", c->ivp, c->evp, c->esr);
+}
@@ -0,0 +1,123 @@
+/*
+ * iss.h
+ *
+ *  Created on: 02/01/2017
+ *      Author: Miguel
+ */
+
+#ifndef SRC_ISS_ISS_H_
+#define SRC_ISS_ISS_H_
+
+#include <stdint.h>
+#include "../vmachine/io_controller.h"
+
+#define ISS_REGISTER_COUNT   32         /* FISC_REGISTER_COUNT */
+#define ISS_HALT_INSTRUCTION 0x14000000 /* The assembler emits HALT as 'B 0' (a branch into itself) */
+#define ISS_HALT_OPCODE      0x7FF      /* The microcode stops on this (11 bit) opcode */
+#define ISS_ADDRESS_MASK     0x7FFFFF   /* The Memory entity's address ports are 23 bits wide */
+
+/* CPSR layout (see rtl/cpsr.vhd): */
+#define CPSR_N    (1<<10)
+#define CPSR_Z    (1<<9)
+#define CPSR_V    (1<<8)
+#define CPSR_C    (1<<7)
+#define CPSR_AE   (1<<6) /* Alignment enable */
+#define CPSR_PG   (1<<5) /* Paging enable */
+#define CPSR_IEN1 (1<<4) /* IRQ enable */
+#define CPSR_IEN0 (1<<3) /* Exception enable */
+#define CPSR_MODE (0x7)
+
+enum CPU_MODE {
+	MODE_USER      = 1,
+	MODE_KERNEL    = 2,
+	MODE_IRQ       = 3,
+	MODE_SIRQ      = 4,
+	MODE_EXCEPTION = 7
+};
+
+#define CPSR_RESET_VALUE (CPSR_IEN0 | MODE_KERNEL)
+
+/* Internal (pre-decoded) operations. The decoder maps every ISA opcode into one of these: */
+enum ISS_OP {
+	OP_UNDEF,
+	/* Arithmetic and logic: */
+	OP_ADD, OP_ADDS, OP_ADDI, OP_ADDIS, OP_SUB, OP_SUBS, OP_SUBI, OP_SUBIS,
+	OP_MUL, OP_SMULH, OP_UMULH, OP_SDIV, OP_UDIV,
+	OP_AND, OP_ANDS, OP_ANDI, OP_ANDIS, OP_ORR, OP_ORRI, OP_EOR, OP_EORI,
+	OP_LSL, OP_LSR, OP_NEG, OP_NOT, OP_NEGI, OP_NOTI, OP_MOVK, OP_MOVZ,
+	/* Branches: */
+	OP_B, OP_BL, OP_BR, OP_BCOND, OP_CBZ, OP_CBNZ,
+	/* Loads and stores (the PC relative versions have the 'R' suffix): */
+	OP_LDR, OP_LDRR, OP_STR, OP_STRR,
+	/* Status and special registers: */
+	OP_MSR, OP_MRS, OP_LIVP, OP_SIVP, OP_LEVP, OP_SEVP, OP_SESR, OP_LDPC, OP_LPDP, OP_SPDP, OP_LPFLA,
+	/* Interrupts: */
+	OP_RETI, OP_SINT,
+	OP_HALT
+};
+
+/* A decoded instruction: */
+typedef struct iss_insn {
+	uint8_t  op;    /* enum ISS_OP */
+	uint8_t  rd;    /* Bits 4..0 (Rd / Rt / condition / CPSR field) */
+	uint8_t  rn;    /* Bits 9..5 */
+	uint8_t  rm;    /* Bits 20..16 */
+	uint8_t  width; /* enum DATATYPE (D format) or MOV quadrant (IW format) */
+	uint64_t imm;   /* Zero extended immediate (ALU immediate, shamt, DT address, MOV immediate or interrupt ID) */
+	int64_t  off;   /* Sign extended branch offset (in bytes) */
+} iss_insn_t;
+
+/* The architectural state of the CPU: */
+typedef struct fisc_cpu {
+	uint64_t x[ISS_REGISTER_COUNT];
+	uint64_t pc;
+	uint16_t cpsr;
+	uint16_t spsr[8];
+	uint8_t  old_mode;
+	uint64_t elr;
+	uint64_t ivp;
+	uint64_t evp;
+	uint64_t pdp;
+	uint64_t pfla;
+	uint8_t  esr;
+
+	/* Lazily evaluated flags. The JIT only records the unsaturated result of ADDS, SUBS and ANDS
+	 * and the flags are folded into the CPSR (iss_flags_sync) whenever something reads them: */
+	char     flags_lazy;
+	uint64_t flags_result; /* Bits 63..0 of the result */
+	uint8_t  flags_carry;  /* Bit 64 of the result */
+
+	char     halted;
+	uint64_t instret; /* Retired instructions */
+	uint64_t cycles;  /* Approximated cycle count */
+	int8_t   load_rd; /* Destination of the previous load (used to approximate load-use stalls) */
+
+	/* Set when there may be interrupt requests to look at in the IRQ queue (see irq_queue.h): */
+	volatile char    irq_pending;
+	uint8_t          int_id; /* ID of the interrupt being serviced */
+} fisc_cpu_t;
+
+extern fisc_cpu_t cpu;
+
+static inline void iss_flags_sync(fisc_cpu_t * c) {
+	if(!c->flags_lazy) return;
+	c->cpsr &= ~(CPSR_N | CPSR_Z | CPSR_V | CPSR_C);
+	if(c->flags_result >> 63) c->cpsr |= CPSR_N;
+	if(!c->flags_result)      c->cpsr |= CPSR_Z;
+	if(c->flags_carry)        c->cpsr |= CPSR_C;
+	c->flags_lazy = 0;
+}
+
+extern char iss_use_block_cache;
+extern uint64_t (*iss_load)(uint64_t phys_addr, uint8_t access_width);
+extern char     (*iss_store)(uint64_t phys_addr, uint64_t data, uint8_t access_width);
+
+void     iss_reset(fisc_cpu_t * c);
+char     iss_decode(uint32_t instruction, iss_insn_t * insn);
+char     iss_execute(fisc_cpu_t * c, const iss_insn_t * insn);
+char     iss_step(fisc_cpu_t * c);
+uint64_t iss_run(fisc_cpu_t * c, uint64_t max_instructions);
+void     iss_interrupt(fisc_cpu_t * c, uint8_t id, enum INTERRUPT_TYPE type);
+void     iss_dump_registers(fisc_cpu_t * c);
+
+#endif /* SRC_ISS_ISS_H_ */
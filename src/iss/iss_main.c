@@ -0,0 +1,185 @@
+/*
+ * iss_main.c
+ *
+ *  Created on: 02/01/2017
+ *      Author: Miguel
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+#include "iss.h"
+#include "block_cache.h"
+#include "fanout.h"
+#include "jit.h"
+#include "../vmachine/address_space.h"
+#include "../vmachine/bus.h"
+#include "../vmachine/defines.h"
+#include "../vmachine/io_controller.h"
+#include "../vmachine/irq_queue.h"
+#include "../vmachine/loader.h"
+#include "../vmachine/mmu.h"
+#include "../vmachine/snapshot.h"
+
+/* The devices raise their interrupts through this function (from any thread). On the RTL simulation it is provided by io_controller_rtl.c */
+char io_irq(uint8_t devid, enum INTERRUPT_TYPE type) {
+#if ENABLE_INTERRUPT_NOTICES == 1
+	printf("\n**** NOTICE: INTERRUPT (%s, devid: %d) ****\n", (type == INT_ERR) ? "EXC" : "IRQ", devid);
+	fflush(stdout);
+#endif
+
+	if(!irq_post(devid, type))
+		return 0;
+	cpu.irq_pending = 1;
+	return 1;
+}
+
+static void usage(const char * prog) {
+	printf("Usage: %s [-n max_instructions] [-i] [-r] [-s] [-J] [-R snapshot] [-S snapshot] [-H] [-F ppm]\n"
+		"       [-b boot_instructions] [-V images]... [-T irq_at] [-j jobs] [image]\n", prog);
+	printf("  -n  Stop after executing this many instructions (default: run until HALT)\n");
+	printf("  -i  Do not start the IO devices (no SDL window and no timer interrupts)\n");
+	printf("  -r  Dump the registers after the program stops\n");
+	printf("  -s  Fetch and decode every instruction (disables the Block Cache and the JIT)\n");
+	printf("  -J  Run every block on the interpreter (disables the JIT)\n");
+	printf("  -R  Resume from this snapshot instead of loading the image\n");
+	printf("  -S  Save a snapshot after the program stops\n");
+	printf("  -H  Headless VGA: keep the framebuffer in memory only (also %s=1, see vga.h for the frame dumps)\n", VGA_ENV_HEADLESS);
+	printf("  -F  Dump the VGA framebuffer into this PPM after the program stops\n");
+	printf("  -b  Fan-out: boot for this many instructions before forking the children (default: 0)\n");
+	printf("  -V  Fan-out: add a child which loads these images on top of the booted memory ('-' for none)\n");
+	printf("  -T  Fan-out: the last added child raises a timer interrupt after this many instructions\n");
+	printf("  -j  Fan-out: children running at a time (default: one per processor)\n");
+	printf("  image is a comma separated list of 'path[@address]' (raw binary, Intel HEX, ELF or ASCII bits)\n");
+	printf("  and defaults to '%s'. ELF images set the initial PC to their entry point\n", BOOTLOADER_FILE);
+}
+
+int main(int argc, char * argv[]) {
+	uint64_t max_instructions = 0;
+	char use_devices = 1;
+	char dump_regs = 0;
+	const char * image = BOOTLOADER_FILE;
+	const char * restore_path = 0;
+	const char * save_path = 0;
+	const char * frame_path = 0;
+	char headless = 0;
+	static fanout_child_t children[FANOUT_MAX_CHILDREN];
+	int child_count = 0;
+	int jobs = 0;
+	uint64_t boot_instructions = 0;
+
+	for(int i = 1; i < argc; i++) {
+		if(!strcmp(argv[i], "-n") && i + 1 < argc) {
+			max_instructions = strtoull(argv[++i], 0, 0);
+		} else if(!strcmp(argv[i], "-i")) {
+			use_devices = 0;
+		} else if(!strcmp(argv[i], "-r")) {
+			dump_regs = 1;
+		} else if(!strcmp(argv[i], "-s")) {
+			iss_use_block_cache = 0;
+			iss_use_jit = 0;
+		} else if(!strcmp(argv[i], "-J")) {
+			iss_use_jit = 0;
+		} else if(!strcmp(argv[i], "-R") && i + 1 < argc) {
+			restore_path = argv[++i];
+		} else if(!strcmp(argv[i], "-S") && i + 1 < argc) {
+			save_path = argv[++i];
+		} else if(!strcmp(argv[i], "-H")) {
+			headless = 1;
+		} else if(!strcmp(argv[i], "-F") && i + 1 < argc) {
+			frame_path = argv[++i];
+		} else if(!strcmp(argv[i], "-b") && i + 1 < argc) {
+			boot_instructions = strtoull(argv[++i], 0, 0);
+		} else if(!strcmp(argv[i], "-V") && i + 1 < argc && child_count < FANOUT_MAX_CHILDREN) {
+			i++;
+			children[child_count].images = strcmp(argv[i], "-") ? argv[i] : 0;
+			children[child_count++].irq_at = 0;
+		} else if(!strcmp(argv[i], "-T") && i + 1 < argc && child_count) {
+			children[child_count - 1].irq_at = strtoull(argv[++i], 0, 0);
+		} else if(!strcmp(argv[i], "-j") && i + 1 < argc) {
+			jobs = atoi(argv[++i]);
+		} else if(argv[i][0] == '-') {
+			usage(argv[0]);
+			return 1;
+		} else {
+			image = argv[i];
+		}
+	}
+
+	if(!bus_init(MEMORY_DEPTH) || (!restore_path && !load_memory(image)))
+		return 1;
+
+	/* The devices run on threads, which do not survive a fork: */
+	if(child_count)
+		use_devices = 0;
+
+	vga_configure();
+	if(headless)
+		vga_headless = 1;
+
+	if(use_devices) {
+		if(SDL_Init(vga_headless ? SDL_INIT_TIMER : SDL_INIT_EVERYTHING) != 0) {
+			printf("\n> ERROR: Could not initialize SDL. (%s)\n", SDL_GetError());
+			use_devices = 0;
+		} else {
+			io_controller_init();
+		}
+	}
+
+	iss_reset(&cpu);
+	if(restore_path) {
+		if(!snapshot_restore(restore_path))
+			return 1;
+		image = restore_path;
+	} else if(loader_has_entry) {
+		cpu.pc = loader_entry;
+	}
+
+	if(child_count) {
+		if(boot_instructions)
+			iss_run(&cpu, boot_instructions);
+		int ret = fanout_run(&cpu, children, child_count, jobs, max_instructions);
+		jit_deinit();
+		fflush(stdout);
+		return ret;
+	}
+
+	printf("> Running '%s' ...\n", image);
+	fflush(stdout);
+
+	uint64_t start = SDL_GetPerformanceCounter();
+	uint64_t executed = iss_run(&cpu, max_instructions);
+	double seconds = (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+
+	printf("\n> ISS: %s after %" PRIu64 " instructions (%" PRIu64 " cycles, CPI %.2f) in %.3f s (%.2f MIPS)",
+		cpu.halted ? "Halted" : "Stopped", executed, cpu.cycles,
+		executed ? (double)cpu.cycles / executed : 0.0, seconds,
+		seconds > 0 ? executed / seconds / 1e6 : 0.0);
+	mmu_print_stats();
+	irq_print_stats();
+	if(iss_use_block_cache)
+		block_cache_print_stats();
+	if(iss_use_jit)
+		jit_print_stats();
+	printf("\n");
+
+	if(dump_regs)
+		iss_dump_registers(&cpu);
+
+	if(save_path)
+		snapshot_save(save_path);
+
+	if(frame_path && use_devices)
+		vga_dump(frame_path);
+
+	jit_deinit();
+
+	if(use_devices) {
+		cpu.halted = 1;
+		io_controller_deinit();
+		SDL_Quit();
+	}
+	fflush(stdout);
+	return 0;
+}
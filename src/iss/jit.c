@@ -0,0 +1,444 @@
+/*
+ * jit.c
+ *
+ *  Created on: 07/01/2017
+ *      Author: Miguel
+ */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* For MAP_ANONYMOUS */
+#endif
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <inttypes.h>
+#include "jit.h"
+
+char iss_use_jit = JIT_SUPPORTED;
+
+#if JIT_SUPPORTED == 1
+
+#include <sys/mman.h>
+
+/* Every block is translated into a function 'void block(fisc_cpu_t * c, uint64_t budget)'. RBX holds the pointer to
+ * the CPU's state (the FISC registers live in c->x), R12 holds the instruction budget and RAX, RCX and RDX are scratch.
+ * The simple ALU instructions (ADD, SUB, AND, ORR, EOR, their immediate and flag setting versions, MOVZ and MOVK)
+ * and the PC relative branches are emitted as host instructions. A block which branches back to its own start loops
+ * inside the host code while the budget lasts and no interrupt is pending.
+ * Everything else (memory accesses, BL/BR, status registers...) calls into iss_execute, so the memory, MMU and
+ * IO controller modules (and the MMIO dispatch) remain the only device model */
+
+uint8_t * jit_buffer = 0;
+uint32_t  jit_used   = 0;
+
+/* JIT statistics: */
+uint64_t jit_blocks   = 0;
+uint64_t jit_runs     = 0;
+uint64_t jit_recycles = 0;
+
+/* Translation context: */
+typedef struct {
+	uint8_t * code;
+	uint32_t  len;
+	uint32_t  cap;
+	uint32_t  exit_fixups[BLOCK_MAX_INSNS * 2 + 4];
+	uint8_t   fixup_count;
+	uint32_t  pending_pc;      /* Bytes the PC must still advance */
+	uint32_t  pending_instret; /* Instructions which retired since the counters were last updated */
+	uint32_t  pending_cycles;
+} jit_ctx_t;
+
+#define OFF_X(reg)  (uint32_t)(offsetof(fisc_cpu_t, x) + (reg) * 8)
+#define OFF(field)  (uint32_t)offsetof(fisc_cpu_t, field)
+
+static void emit8(jit_ctx_t * j, uint8_t b) {
+	if(j->len < j->cap)
+		j->code[j->len] = b;
+	j->len++;
+}
+
+static void emit32(jit_ctx_t * j, uint32_t v) {
+	for(int i = 0; i < 4; i++) emit8(j, (v >> (i * 8)) & 0xFF);
+}
+
+static void emit64(jit_ctx_t * j, uint64_t v) {
+	for(int i = 0; i < 8; i++) emit8(j, (v >> (i * 8)) & 0xFF);
+}
+
+static void emit_bytes(jit_ctx_t * j, const char * bytes, int len) {
+	for(int i = 0; i < len; i++) emit8(j, (uint8_t)bytes[i]);
+}
+
+/* RAX = X[reg] */
+static void emit_load_rax(jit_ctx_t * j, uint8_t reg) {
+	if(reg == ISS_REGISTER_COUNT-1) { emit_bytes(j, "\x31\xC0", 2); return; } /* xor eax, eax */
+	emit_bytes(j, "\x48\x8B\x83", 3); emit32(j, OFF_X(reg));                   /* mov rax, [rbx+x] */
+}
+
+/* RCX = X[reg] */
+static void emit_load_rcx(jit_ctx_t * j, uint8_t reg) {
+	if(reg == ISS_REGISTER_COUNT-1) { emit_bytes(j, "\x31\xC9", 2); return; } /* xor ecx, ecx */
+	emit_bytes(j, "\x48\x8B\x8B", 3); emit32(j, OFF_X(reg));                   /* mov rcx, [rbx+x] */
+}
+
+/* RCX = imm */
+static void emit_imm_rcx(jit_ctx_t * j, uint64_t imm) {
+	if(imm <= 0xFFFFFFFF) { emit8(j, 0xB9); emit32(j, (uint32_t)imm); return; } /* mov ecx, imm32 */
+	emit_bytes(j, "\x48\xB9", 2); emit64(j, imm);                                /* mov rcx, imm64 */
+}
+
+/* X[reg] = RAX */
+static void emit_store_rax(jit_ctx_t * j, uint8_t reg) {
+	if(reg == ISS_REGISTER_COUNT-1) return;
+	emit_bytes(j, "\x48\x89\x83", 3); emit32(j, OFF_X(reg)); /* mov [rbx+x], rax */
+}
+
+/* qword [rbx+field] += imm */
+static void emit_add_field(jit_ctx_t * j, uint32_t field_off, uint32_t imm) {
+	if(!imm) return;
+	emit_bytes(j, "\x48\x81\x83", 3); emit32(j, field_off); emit32(j, imm);
+}
+
+/* Brings c->pc, c->instret and c->cycles up to date */
+static void emit_sync_counters(jit_ctx_t * j) {
+	emit_add_field(j, OFF(pc),      j->pending_pc);
+	emit_add_field(j, OFF(instret), j->pending_instret);
+	emit_add_field(j, OFF(cycles),  j->pending_cycles);
+	j->pending_pc = j->pending_instret = j->pending_cycles = 0;
+}
+
+/* j<cc> <exit> (patched once the epilogue is emitted) */
+static void emit_jcc_exit(jit_ctx_t * j, uint8_t cc) {
+	emit8(j, 0x0F); emit8(j, cc);
+	j->exit_fixups[j->fixup_count++] = j->len;
+	emit32(j, 0);
+}
+
+#define JCC_B  0x82
+#define JCC_E  0x84
+#define JCC_NE 0x85
+#define JCC_S  0x88
+#define JCC_NS 0x89
+#define JCC_LE 0x8E
+#define JCC_G  0x8F
+
+/* j<cc> rel32 to a label which is patched later on. Returns the position of the displacement */
+static uint32_t emit_jcc_fwd(jit_ctx_t * j, uint8_t cc) {
+	emit8(j, 0x0F); emit8(j, cc);
+	uint32_t pos = j->len;
+	emit32(j, 0);
+	return pos;
+}
+
+static void patch_rel32(jit_ctx_t * j, uint32_t pos, uint32_t label) {
+	int32_t rel = (int32_t)(label - (pos + 4));
+	if(pos + 4 <= j->cap)
+		memcpy(&j->code[pos], &rel, 4);
+}
+
+/* jmp <exit> */
+static void emit_jmp_exit(jit_ctx_t * j) {
+	emit8(j, 0xE9);
+	j->exit_fixups[j->fixup_count++] = j->len;
+	emit32(j, 0);
+}
+
+/* Emits X[rd] = X[rn] <op> operand B, with the RTL's saturation and (lazy) flags */
+static void emit_alu(jit_ctx_t * j, const iss_insn_t * insn, uint8_t x86_op, char use_imm, char set_flags) {
+	emit_load_rax(j, insn->rn);
+	if(use_imm) emit_imm_rcx(j, insn->imm);
+	else        emit_load_rcx(j, insn->rm);
+
+	emit_bytes(j, "\x48", 1); emit8(j, x86_op); emit8(j, 0xC8); /* <op> rax, rcx */
+
+	/* Bit 64 of the ALU's 65 bit result is SF ^ OF, and it differs from bit 63 exactly when OF is set.
+	 * None of the instructions below change the host's flags: */
+	if(set_flags) {
+		emit_bytes(j, "\x0F\x9C\xC2", 3);                                      /* setl dl */
+		emit_bytes(j, "\x48\x89\x83", 3); emit32(j, OFF(flags_result));         /* mov [rbx+flags_result], rax */
+		emit_bytes(j, "\x88\x93", 2);     emit32(j, OFF(flags_carry));          /* mov [rbx+flags_carry], dl */
+		emit_bytes(j, "\xC6\x83", 2);     emit32(j, OFF(flags_lazy)); emit8(j, 1); /* mov byte [rbx+flags_lazy], 1 */
+	}
+
+	/* Saturate on overflow: */
+	emit_bytes(j, "\x71\x09", 2);             /* jno +9 */
+	emit_bytes(j, "\x48\xC1\xF8\x3F", 4);     /* sar rax, 63 */
+	emit_bytes(j, "\x48\x0F\xBA\xF8\x3F", 5); /* btc rax, 63 */
+
+	emit_store_rax(j, insn->rd);
+}
+
+/* Can this instruction be translated into host code? (otherwise it runs on the interpreter) */
+static char is_native(uint8_t op) {
+	switch(op) {
+		case OP_ADD: case OP_ADDS: case OP_ADDI: case OP_ADDIS:
+		case OP_SUB: case OP_SUBS: case OP_SUBI: case OP_SUBIS:
+		case OP_AND: case OP_ANDS: case OP_ANDI: case OP_ANDIS:
+		case OP_ORR: case OP_ORRI: case OP_EOR:  case OP_EORI:
+		case OP_MOVZ: case OP_MOVK:
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+/* Translates a single instruction into host code */
+static void emit_native(jit_ctx_t * j, const iss_insn_t * insn) {
+	switch(insn->op) {
+		case OP_ADD:   emit_alu(j, insn, 0x01, 0, 0); break;
+		case OP_ADDS:  emit_alu(j, insn, 0x01, 0, 1); break;
+		case OP_ADDI:  emit_alu(j, insn, 0x01, 1, 0); break;
+		case OP_ADDIS: emit_alu(j, insn, 0x01, 1, 1); break;
+		case OP_SUB:   emit_alu(j, insn, 0x29, 0, 0); break;
+		case OP_SUBS:  emit_alu(j, insn, 0x29, 0, 1); break;
+		case OP_SUBI:  emit_alu(j, insn, 0x29, 1, 0); break;
+		case OP_SUBIS: emit_alu(j, insn, 0x29, 1, 1); break;
+		case OP_AND:   emit_alu(j, insn, 0x21, 0, 0); break;
+		case OP_ANDS:  emit_alu(j, insn, 0x21, 0, 1); break;
+		case OP_ANDI:  emit_alu(j, insn, 0x21, 1, 0); break;
+		case OP_ANDIS: emit_alu(j, insn, 0x21, 1, 1); break;
+		case OP_ORR:   emit_alu(j, insn, 0x09, 0, 0); break;
+		case OP_ORRI:  emit_alu(j, insn, 0x09, 1, 0); break;
+		case OP_EOR:   emit_alu(j, insn, 0x31, 0, 0); break;
+		case OP_EORI:  emit_alu(j, insn, 0x31, 1, 0); break;
+		case OP_MOVZ:
+			emit_bytes(j, "\x48\xB8", 2); emit64(j, insn->imm << (insn->width * 16)); /* mov rax, imm64 */
+			emit_store_rax(j, insn->rd);
+			break;
+		case OP_MOVK:
+			emit_load_rax(j, insn->rd);
+			emit_imm_rcx(j, ~(0xFFFFULL << (insn->width * 16)));
+			emit_bytes(j, "\x48\x21\xC8", 3); /* and rax, rcx */
+			emit_imm_rcx(j, insn->imm << (insn->width * 16));
+			emit_bytes(j, "\x48\x09\xC8", 3); /* or rax, rcx */
+			emit_store_rax(j, insn->rd);
+			break;
+	}
+}
+
+/* Emits a call to iss_execute(c, insn), which leaves the block if it returns 0 (the CPU halted) */
+static void emit_call_interpreter(jit_ctx_t * j, const iss_insn_t * insn) {
+	emit_sync_counters(j);
+	emit_bytes(j, "\x48\x89\xDF", 3);                          /* mov rdi, rbx */
+	emit_bytes(j, "\x48\xBE", 2); emit64(j, (uint64_t)insn);    /* mov rsi, insn */
+	emit_bytes(j, "\x48\xB8", 2); emit64(j, (uint64_t)iss_execute); /* mov rax, iss_execute */
+	emit_bytes(j, "\xFF\xD0", 2);                              /* call rax */
+	emit_bytes(j, "\x84\xC0", 2);                              /* test al, al */
+	emit_jcc_exit(j, JCC_E);
+}
+
+/* A store may have overwritten the rest of this block. Leave if it got invalidated */
+static void emit_check_valid(jit_ctx_t * j, iss_block_t * blk) {
+	emit_bytes(j, "\x48\xB8", 2); emit64(j, (uint64_t)&blk->valid); /* mov rax, &blk->valid */
+	emit_bytes(j, "\x80\x38\x00", 3);                               /* cmp byte [rax], 0 */
+	emit_jcc_exit(j, JCC_E);
+}
+
+/* Can this branch be translated into host code? The conditions are only evaluated natively while the flags are known
+ * to be held lazily (a native flag setting instruction ran earlier on the same block) */
+static char is_native_branch(const iss_insn_t * insn, char flags_lazy) {
+	switch(insn->op) {
+		case OP_B:     return insn->off != 0; /* 'B 0' might be a HALT */
+		case OP_CBZ:
+		case OP_CBNZ:  return 1;
+		case OP_BCOND: return flags_lazy && insn->rd != 7 && insn->rd != 8; /* LS and HI need two tests */
+		default:       return 0;
+	}
+}
+
+/* Emits the test for a conditional branch and returns the position of its (taken) jump, or:
+ * -1 if the branch is never taken and -2 if it is always taken */
+static int64_t emit_branch_test(jit_ctx_t * j, const iss_insn_t * insn) {
+	switch(insn->op) {
+		case OP_B:
+			return -2;
+		case OP_CBZ:
+		case OP_CBNZ:
+			emit_load_rax(j, insn->rd);
+			emit_bytes(j, "\x48\x85\xC0", 3); /* test rax, rax */
+			return emit_jcc_fwd(j, insn->op == OP_CBZ ? JCC_E : JCC_NE);
+	}
+
+	/* B.cond with lazy flags. V is always clear, so every signed condition is a test on the result's sign: */
+	uint8_t cc;
+	switch(insn->rd) {
+		case 0:  cc = JCC_E;  break; /* EQ */
+		case 1:  cc = JCC_NE; break; /* NE */
+		case 2:                      /* LT */
+		case 10: cc = JCC_S;  break; /* MI */
+		case 3:  cc = JCC_LE; break; /* LE */
+		case 4:  cc = JCC_G;  break; /* GT */
+		case 5:                      /* GE */
+		case 11: cc = JCC_NS; break; /* PL */
+		case 6:                      /* LO */
+		case 9:                      /* HS */
+			emit_bytes(j, "\x80\xBB", 2); emit32(j, OFF(flags_carry)); emit8(j, 0); /* cmp byte [rbx+flags_carry], 0 */
+			return emit_jcc_fwd(j, insn->rd == 6 ? JCC_E : JCC_NE);
+		case 13: return -2;          /* VC */
+		default: return -1;          /* VS */
+	}
+	emit_bytes(j, "\x48\x8B\x83", 3); emit32(j, OFF(flags_result)); /* mov rax, [rbx+flags_result] */
+	emit_bytes(j, "\x48\x85\xC0", 3);                               /* test rax, rax */
+	return emit_jcc_fwd(j, cc);
+}
+
+/* Emits the block's last instruction, a native branch. 'cycles' includes the load-use stall */
+static void emit_branch(jit_ctx_t * j, iss_block_t * blk, const iss_insn_t * insn, uint32_t cycles, uint32_t loop_label) {
+	emit_sync_counters(j);
+
+	int64_t taken = emit_branch_test(j, insn);
+	if(taken != -2) {
+		/* Not taken: */
+		emit_add_field(j, OFF(pc),      4);
+		emit_add_field(j, OFF(instret), 1);
+		emit_add_field(j, OFF(cycles),  cycles);
+		if(taken == -1) return;
+		emit_jmp_exit(j);
+		patch_rel32(j, (uint32_t)taken, j->len);
+	}
+
+	/* Taken: */
+	int32_t off = (int32_t)insn->off;
+	emit_add_field(j, OFF(pc),      (uint32_t)off);
+	emit_add_field(j, OFF(instret), 1);
+	emit_add_field(j, OFF(cycles),  cycles + 1);
+
+	if(off == -(int32_t)(blk->count - 1) * 4) {
+		/* The block loops onto itself. Go around again if there's budget for a whole pass and no interrupt: */
+		emit_bytes(j, "\x49\x81\xEC", 3); emit32(j, blk->count); /* sub r12, count */
+		emit_bytes(j, "\x49\x81\xFC", 3); emit32(j, blk->count); /* cmp r12, count */
+		emit_jcc_exit(j, JCC_B);
+		emit_bytes(j, "\x80\xBB", 2); emit32(j, OFF(irq_pending)); emit8(j, 0); /* cmp byte [rbx+irq_pending], 0 */
+		emit_jcc_exit(j, JCC_NE);
+		emit8(j, 0xE9); emit32(j, (uint32_t)(loop_label - (j->len + 4))); /* jmp <loop> */
+	}
+}
+
+static void jit_translate_block(jit_ctx_t * j, iss_block_t * blk) {
+	int8_t load_rd = -1;     /* Destination of the previous instruction, if it was a load */
+	char   load_rd_live = 1; /* Might c->load_rd hold a stale value? (it's only maintained by the interpreter) */
+	char   flags_lazy = 0;   /* Did a native instruction leave the flags in c->flags_result / c->flags_carry? */
+
+	emit_bytes(j, "\x53", 1);             /* push rbx */
+	emit_bytes(j, "\x41\x54", 2);         /* push r12 */
+	emit_bytes(j, "\x48\x83\xEC\x08", 4); /* sub rsp, 8 (keeps the stack aligned for the calls into the interpreter) */
+	emit_bytes(j, "\x48\x89\xFB", 3);     /* mov rbx, rdi */
+	emit_bytes(j, "\x49\x89\xF4", 3);     /* mov r12, rsi */
+	uint32_t loop_label = j->len;
+
+	for(int i = 0; i < blk->count; i++) {
+		const iss_insn_t * insn = &blk->insns[i];
+		char native = is_native(insn->op);
+		char branch = !native && is_native_branch(insn, flags_lazy);
+
+		if(native || branch) {
+			if(load_rd_live) {
+				emit_bytes(j, "\xC6\x83", 2); emit32(j, OFF(load_rd)); emit8(j, 0xFF); /* mov byte [rbx+load_rd], -1 */
+				load_rd_live = 0;
+			}
+			/* Approximate the load-use stall the same way as the interpreter does: */
+			uint32_t cycles = 1;
+			if(load_rd >= 0 && (insn->rn == load_rd || insn->rm == load_rd))
+				cycles++;
+			load_rd = -1;
+
+			if(branch) {
+				emit_branch(j, blk, insn, cycles, loop_label);
+				break; /* Branches always end the block */
+			}
+
+			emit_native(j, insn);
+			if(insn->op == OP_ADDS || insn->op == OP_ADDIS || insn->op == OP_SUBS ||
+			   insn->op == OP_SUBIS || insn->op == OP_ANDS || insn->op == OP_ANDIS)
+				flags_lazy = 1;
+			j->pending_pc      += 4;
+			j->pending_instret += 1;
+			j->pending_cycles  += cycles;
+		} else {
+			emit_call_interpreter(j, insn);
+			if(insn->op == OP_STR || insn->op == OP_STRR)
+				emit_check_valid(j, blk);
+			if(insn->op == OP_MRS)
+				flags_lazy = 0; /* Reading the CPSR folds the flags back into it */
+			load_rd      = (insn->op == OP_LDR || insn->op == OP_LDRR) ? insn->rd : -1;
+			load_rd_live = 1;
+		}
+	}
+
+	emit_sync_counters(j);
+
+	/* Exit: */
+	uint32_t exit_label = j->len;
+	emit_bytes(j, "\x48\x83\xC4\x08", 4); /* add rsp, 8 */
+	emit_bytes(j, "\x41\x5C", 2);         /* pop r12 */
+	emit_bytes(j, "\x5B", 1);             /* pop rbx */
+	emit_bytes(j, "\xC3", 1);             /* ret */
+
+	for(int i = 0; i < j->fixup_count; i++)
+		patch_rel32(j, j->exit_fixups[i], exit_label);
+}
+
+char jit_init(void) {
+	if(jit_buffer) return 1;
+	jit_buffer = mmap(0, JIT_BUFFER_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(jit_buffer == MAP_FAILED) {
+		printf("\n> ERROR: Could not allocate the JIT's code buffer. Running on the interpreter only\n");
+		jit_buffer  = 0;
+		iss_use_jit = 0;
+		return 0;
+	}
+	jit_used = 0;
+	return 1;
+}
+
+void jit_deinit(void) {
+	if(!jit_buffer) return;
+	munmap(jit_buffer, JIT_BUFFER_SIZE);
+	jit_buffer = 0;
+	block_cache_drop_jit();
+}
+
+char jit_translate(iss_block_t * blk) {
+	if(!jit_buffer && !jit_init()) return 0;
+
+	for(int attempt = 0; attempt < 2; attempt++) {
+		jit_ctx_t j;
+		memset(&j, 0, sizeof(j));
+		j.code = jit_buffer + jit_used;
+		j.cap  = JIT_BUFFER_SIZE - jit_used;
+
+		jit_translate_block(&j, blk);
+
+		if(j.len <= j.cap) {
+			blk->jit  = j.code;
+			jit_used += (j.len + 15) & ~15;
+			jit_blocks++;
+			return 1;
+		}
+
+		/* The buffer is full. Recycle it and try again: */
+		block_cache_drop_jit();
+		jit_used = 0;
+		jit_recycles++;
+	}
+	return 0;
+}
+
+void jit_run(fisc_cpu_t * c, iss_block_t * blk, uint64_t budget) {
+	jit_runs++;
+	((void (*)(fisc_cpu_t *, uint64_t))blk->jit)(c, budget);
+}
+
+void jit_print_stats(void) {
+	printf("\n> JIT: %" PRIu64 " blocks translated, %" PRIu64 " runs, %" PRIu64 " buffer recycles", jit_blocks, jit_runs, jit_recycles);
+}
+
+#else
+
+char jit_init(void)                        { iss_use_jit = 0; return 0; }
+void jit_deinit(void)                      { }
+char jit_translate(iss_block_t * blk)      { return 0; }
+void jit_run(fisc_cpu_t * c, iss_block_t * blk, uint64_t budget) { }
+void jit_print_stats(void)                 { }
+
+#endif
@@ -0,0 +1,32 @@
+/*
+ * jit.h
+ *
+ *  Created on: 07/01/2017
+ *      Author: Miguel
+ */
+
+#ifndef SRC_ISS_JIT_H_
+#define SRC_ISS_JIT_H_
+
+#include <stdint.h>
+#include "iss.h"
+#include "block_cache.h"
+
+#if defined(__x86_64__) && !defined(_WIN32)
+#define JIT_SUPPORTED (1) /* The translator emits x86-64 code for the System V calling convention */
+#else
+#define JIT_SUPPORTED (0) /* Every block runs on the interpreter */
+#endif
+
+#define JIT_HOT_THRESHOLD 16              /* A block is translated after running this many times on the interpreter */
+#define JIT_BUFFER_SIZE   (4*1024*1024)  /* Size of the host code buffer. It is recycled as a whole once it fills up */
+
+extern char iss_use_jit;
+
+char jit_init(void);
+void jit_deinit(void);
+char jit_translate(iss_block_t * blk);
+void jit_run(fisc_cpu_t * c, iss_block_t * blk, uint64_t budget);
+void jit_print_stats(void);
+
+#endif /* SRC_ISS_JIT_H_ */
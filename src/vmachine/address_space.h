@@ -12,12 +12,18 @@
 #include "iodevices/vga.h"
 
 #define BOOTLOADER_FILE "bin/bootloader.bin"
-#define MEMORY_DEPTH 50000000 /* Size of memory in bytes */
+#define MEMORY_DEPTH 50000000 /* Default size of memory in bytes (see memstore.h) */
 #define MEMORY_LOADLOC 0      /* Where to load the bootloader on startup */
 
-#define IODEVICE_COUNT (sizeof(devices) / sizeof(devices[0]))
-#define IOSPACE        0x1000 /* The IO space starts at this address */
-#define IOSPACE_LEN    LINEAR_FRAMEBUFFER_SIZE+TIMER_IOSPACE /* And is this long in bytes */
+#define IODEVICE_MAX    16       /* Built-in plus registered devices (see io_register_device) */
+#define IOSPACE         0x1000   /* The IO space starts at this address */
+#define IOSPACE_LEN     (TIMER_IOADDR + TIMER_IOSPACE) /* And the built-in devices take this many bytes of it */
+
+/* Where the built-in devices sit, relative to IOSPACE. The framebuffer stays where it was when the timer took a single byte
+ * in front of it, and the timer's registers follow the framebuffer */
+#define VGA_IOADDR   1
+#define TIMER_IOADDR ((VGA_IOADDR + LINEAR_FRAMEBUFFER_SIZE + 7) & ~7)
+#define IOSPACE_MAX_LEN 0x400000 /* Devices can be registered up to this many bytes into the IO space */
 
 enum ADDR_SPACE_T {
 	SPACE_MMEM, /* Main Memory (Read and Write) Address Space */
@@ -0,0 +1,264 @@
+/*
+ * bus.c
+ *
+ *  Created on: 14/12/2016
+ *      Author: Miguel
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "bus.h"
+#include "defines.h"
+#include "io_controller.h"
+#include "mmu.h"
+
+bus_bitmap_t code_pages  = { 0, 0, CODE_PAGE_SHIFT };
+void (*code_write_hook)(uint64_t code_page) = 0;
+
+bus_bitmap_t table_pages = { 0, 0, TABLE_PAGE_SHIFT };
+void (*table_write_hook)(uint64_t table_page) = 0;
+
+bus_bitmap_t dirty_pages = { 0, 0, MEMSTORE_PAGE_SHIFT };
+
+/*********************************/
+/* Bitmaps:                      */
+/*********************************/
+static char bitmap_open(bus_bitmap_t * bitmap) {
+	bitmap->region_count = (memory_depth >> BITMAP_REGION_SHIFT) + 1;
+	bitmap->regions      = calloc(bitmap->region_count, sizeof(uint8_t *));
+	return bitmap->regions != 0;
+}
+
+static void bitmap_close(bus_bitmap_t * bitmap) {
+	for(uint64_t i = 0; bitmap->regions && i < bitmap->region_count; i++)
+		free(bitmap->regions[i]);
+	free(bitmap->regions);
+	bitmap->regions = 0;
+}
+
+char bitmap_set(bus_bitmap_t * bitmap, uint64_t page) {
+	uint32_t shift = BITMAP_REGION_SHIFT - bitmap->page_shift;
+	uint8_t ** region = &bitmap->regions[page >> shift];
+	if(!*region && !(*region = calloc(((1u << shift) + 7) / 8, 1)))
+		return 0;
+	uint32_t bit = page & ((1u << shift) - 1);
+	(*region)[bit >> 3] |= 1 << (bit & 7);
+	return 1;
+}
+
+void bitmap_clear(bus_bitmap_t * bitmap, uint64_t page) {
+	uint32_t shift = BITMAP_REGION_SHIFT - bitmap->page_shift;
+	uint8_t * region = bitmap->regions[page >> shift];
+	uint32_t bit = page & ((1u << shift) - 1);
+	if(region)
+		region[bit >> 3] &= ~(1 << (bit & 7));
+}
+
+/* Returns the first page in [page, end) whose bit is set, or 'end' if there's none. Unallocated regions are skipped whole */
+uint64_t bitmap_next(const bus_bitmap_t * bitmap, uint64_t page, uint64_t end) {
+	uint32_t shift = BITMAP_REGION_SHIFT - bitmap->page_shift;
+	for(; page < end; page++) {
+		if(!bitmap->regions[page >> shift])
+			page |= (1u << shift) - 1;
+		else if(bitmap_test(bitmap, page))
+			return page;
+	}
+	return end;
+}
+
+/*********************************/
+/* Code and dirty pages:         */
+/*********************************/
+
+/* Marks the pages in [phys_addr, phys_addr+len) as holding translated code */
+void bus_mark_code(uint64_t phys_addr, uint32_t len) {
+	for(uint64_t page = phys_addr >> CODE_PAGE_SHIFT; page <= (phys_addr + len - 1) >> CODE_PAGE_SHIFT; page++)
+		bitmap_set(&code_pages, page);
+}
+
+/* Forgets every page of translated code */
+void bus_clear_code(void) {
+	if(code_pages.regions) {
+		bitmap_close(&code_pages);
+		bitmap_open(&code_pages);
+	}
+}
+
+/* Marks the pages in [phys_addr, phys_addr+len) as holding paging structures. Addresses outside the Main Memory read as 0, so they are not tracked */
+void bus_mark_table(uint64_t phys_addr, uint32_t len) {
+	if(phys_addr >= memory_depth || memory_depth - phys_addr < len || (!table_pages.regions && !bitmap_open(&table_pages)))
+		return;
+	for(uint64_t page = phys_addr >> TABLE_PAGE_SHIFT; page <= (phys_addr + len - 1) >> TABLE_PAGE_SHIFT; page++)
+		bitmap_set(&table_pages, page);
+}
+
+/* Forgets every page of paging structures, until the next walk */
+void bus_clear_tables(void) {
+	bitmap_close(&table_pages);
+}
+
+/* Starts (or stops) tracking which pages of the Main Memory get written. Starting it forgets the pages written so far */
+char bus_track_dirty(char enable) {
+	bitmap_close(&dirty_pages);
+	return !enable || bitmap_open(&dirty_pages);
+}
+
+/* Notifies the owner of the translated code whenever a write lands on one of its pages */
+static inline void code_write_check(uint64_t address, uint8_t access_width) {
+	uint64_t first = address >> CODE_PAGE_SHIFT;
+	uint64_t last  = (address + (1 << access_width) - 1) >> CODE_PAGE_SHIFT;
+	if(!code_write_hook)
+		return;
+	if(bitmap_test(&code_pages, first))
+		code_write_hook(first);
+	if(last != first && bitmap_test(&code_pages, last))
+		code_write_hook(last);
+}
+
+/* Notifies the MMU whenever a write lands on the paging structures which back its TLB */
+static inline void table_write_check(uint64_t address, uint8_t access_width) {
+	uint64_t first = address >> TABLE_PAGE_SHIFT;
+	uint64_t last  = (address + (1 << access_width) - 1) >> TABLE_PAGE_SHIFT;
+	if(bitmap_test(&table_pages, first))
+		table_write_hook(first);
+	if(last != first && bitmap_test(&table_pages, last))
+		table_write_hook(last);
+}
+
+static inline void mark_dirty(uint64_t address, uint64_t len) {
+	for(uint64_t page = address >> MEMSTORE_PAGE_SHIFT; page <= (address + len - 1) >> MEMSTORE_PAGE_SHIFT; page++)
+		bitmap_set(&dirty_pages, page);
+}
+
+/*********************************/
+/* Main Memory:                  */
+/*********************************/
+
+/* Opens the Main Memory's backing store (see memstore.h) and the code bitmap which covers it */
+char bus_init(uint64_t default_depth) {
+	if(!memstore_configure(default_depth) || !io_dispatch_init())
+		return 0;
+	bitmap_close(&table_pages);
+	bitmap_close(&code_pages);
+	table_write_hook = mmu_table_write;
+	return bitmap_open(&code_pages);
+}
+
+char write_memory(uint64_t address, uint64_t data, uint8_t access_width) {
+	if(access_width > SZ_64 || address >= memory_depth || memory_depth - address < (1u << access_width)) return 0;
+	code_write_check(address, access_width);
+	if(table_pages.regions)
+		table_write_check(address, access_width);
+	if(dirty_pages.regions)
+		mark_dirty(address, 1 << access_width);
+
+	uint8_t * mem = memstore_ptr(address, 1 << access_width, 1);
+	if(!mem) {
+		/* The access is split across two pages of the sparse backing store */
+		if(access_width == SZ_8) return 0;
+		for(int i = 0; i < (1 << access_width); i++)
+			if(!write_memory(address + i, data >> (((1 << access_width) - 1 - i) * 8), SZ_8))
+				return 0;
+		return 1;
+	}
+	mem_store(mem, data, access_width);
+	return 1;
+}
+
+/* Slow path of read_memory: the access is split across two pages of the sparse backing store */
+uint64_t read_memory_split(uint64_t address, uint8_t access_width) {
+	uint64_t ret = 0;
+	for(int i = 0; i < (1 << access_width); i++)
+		ret = (ret << 8) | read_memory(address + i, SZ_8);
+	return ret;
+}
+
+/* Copies a block out of the Main Memory with one memcpy per contiguous piece of the backing store (for DMA-like devices) */
+char bus_read_block(uint64_t address, uint8_t * dst, uint64_t len) {
+	if(address > memory_depth || memory_depth - address < len) return 0;
+
+	while(len) {
+		uint64_t chunk = memory_contents ? len : MEMSTORE_PAGE_SIZE - (address & (MEMSTORE_PAGE_SIZE - 1));
+		if(chunk > len)
+			chunk = len;
+		memcpy(dst, memstore_ptr(address, (uint32_t)chunk, 0), (size_t)chunk);
+		dst     += chunk;
+		address += chunk;
+		len     -= chunk;
+	}
+	return 1;
+}
+
+/* Copies a block into the Main Memory with one memcpy per contiguous piece of the backing store.
+ * A null 'src' clears the block instead (untouched sparse pages are already zero, so they're left alone) */
+char bus_write_block(uint64_t address, const uint8_t * src, uint64_t len) {
+	if(address > memory_depth || memory_depth - address < len) return 0;
+
+	if(code_write_hook && len) {
+		uint64_t last = (address + len - 1) >> CODE_PAGE_SHIFT;
+		for(uint64_t page = bitmap_next(&code_pages, address >> CODE_PAGE_SHIFT, last + 1); page <= last; page = bitmap_next(&code_pages, page + 1, last + 1))
+			code_write_hook(page);
+	}
+	if(table_pages.regions && len) {
+		uint64_t last = (address + len - 1) >> TABLE_PAGE_SHIFT;
+		for(uint64_t page = bitmap_next(&table_pages, address >> TABLE_PAGE_SHIFT, last + 1); page <= last; page = bitmap_next(&table_pages, page + 1, last + 1))
+			table_write_hook(page);
+	}
+	if(dirty_pages.regions && len)
+		mark_dirty(address, len);
+
+	while(len) {
+		if(!src && !memory_contents) {
+			/* Clearing a sparse block: skip straight to the next page which was touched */
+			uint64_t next = memstore_next_page(address);
+			if(next > address) {
+				if(next - address >= len)
+					break;
+				len    -= next - address;
+				address = next;
+			}
+		}
+		uint64_t chunk = memory_contents ? len : MEMSTORE_PAGE_SIZE - (address & (MEMSTORE_PAGE_SIZE - 1));
+		if(chunk > len)
+			chunk = len;
+		if(src || memory_contents || memstore_page(address >> MEMSTORE_PAGE_SHIFT)) {
+			uint8_t * mem = memstore_ptr(address, (uint32_t)chunk, 1);
+			if(!mem) return 0;
+			if(src)
+				memcpy(mem, src, (size_t)chunk);
+			else
+				memset(mem, 0, (size_t)chunk);
+		}
+		if(src)
+			src += chunk;
+		address += chunk;
+		len     -= chunk;
+	}
+	return 1;
+}
+
+uint64_t address_align(uint64_t address, uint8_t access_width, uint8_t alignment_enabled) {
+	if(!alignment_enabled) return address;
+	switch(access_width) {
+		case SZ_8:  return address;
+		case SZ_16: return ALIGN16(address);
+		case SZ_32: return ALIGN32(address);
+		case SZ_64: return ALIGN64(address);
+		default:    return address;
+	}
+}
+
+/* Reads from the physical address space, routing the access to either the Main Memory or an IO device */
+uint64_t bus_read(uint64_t phys_addr, uint8_t access_width) {
+	if(address_decode(phys_addr) == SPACE_IO)
+		return io_rd_dispatch((uint32_t)phys_addr, access_width);
+	return read_memory(phys_addr, access_width);
+}
+
+/* Writes into the physical address space, routing the access to either the Main Memory or an IO device */
+char bus_write(uint64_t phys_addr, uint64_t data, uint8_t access_width) {
+	if(address_decode(phys_addr) == SPACE_IO)
+		return io_wr_dispatch((uint32_t)phys_addr, data, access_width);
+	return write_memory(phys_addr, data, access_width);
+}
@@ -0,0 +1,118 @@
+/*
+ * bus.h
+ *
+ *  Created on: 14/12/2016
+ *      Author: Miguel
+ */
+
+#ifndef SRC_VMACHINE_BUS_H_
+#define SRC_VMACHINE_BUS_H_
+
+#include <stdint.h>
+#include <string.h>
+#include "address_space.h"
+#include "defines.h"
+#include "io_controller.h"
+#include "memstore.h"
+
+/* The host side of the system bus. It holds the Main Memory and routes accesses into the IO devices.
+ * It does not depend on the simulator, so both the FLI memory model and the Instruction Set Simulator are built on top of it */
+
+#define CODE_PAGE_SHIFT 6 /* Pages of the code bitmap are 64 bytes long, so that data stored right next to the code does not keep invalidating it */
+#define TABLE_PAGE_SHIFT 6 /* Same for the bitmap of the paging structures */
+
+/* The Main Memory may be far larger than what is touched of it (see memstore.h), so the bitmaps of the bus are split into
+ * regions of 16 MB of Main Memory. A region is only allocated once one of its bits gets set */
+#define BITMAP_REGION_SHIFT 24
+
+typedef struct {
+	uint8_t ** regions;      /* 0 while the bitmap is not in use */
+	uint64_t   region_count;
+	uint8_t    page_shift;   /* One bit per page of (1 << page_shift) bytes */
+} bus_bitmap_t;
+
+/* Bitmap of the pages which hold translated (cached) code. A write into one of these pages calls code_write_hook */
+extern bus_bitmap_t code_pages;
+extern void (*code_write_hook)(uint64_t code_page);
+
+/* Bitmap of the pages which hold paging structures that the MMU walked into its TLB. A write into one of these pages calls
+ * table_write_hook (bus_init installs mmu_table_write). Not in use (so writes skip the check) until the first walk after
+ * bus_clear_tables */
+extern bus_bitmap_t table_pages;
+extern void (*table_write_hook)(uint64_t table_page);
+
+/* Bitmap of the Main Memory's pages (MEMSTORE_PAGE_SIZE) which were written since bus_track_dirty. Not in use while not tracking */
+extern bus_bitmap_t dirty_pages;
+
+char     bus_init(uint64_t default_depth);
+char     write_memory(uint64_t address, uint64_t data, uint8_t access_width);
+uint64_t read_memory_split(uint64_t address, uint8_t access_width);
+char     bus_read_block(uint64_t address, uint8_t * dst, uint64_t len);
+char     bus_write_block(uint64_t address, const uint8_t * src, uint64_t len);
+
+uint64_t address_align(uint64_t address, uint8_t access_width, uint8_t alignment_enabled);
+
+uint64_t bus_read(uint64_t phys_addr, uint8_t access_width);
+char     bus_write(uint64_t phys_addr, uint64_t data, uint8_t access_width);
+void     bus_mark_code(uint64_t phys_addr, uint32_t len);
+void     bus_clear_code(void);
+void     bus_mark_table(uint64_t phys_addr, uint32_t len);
+void     bus_clear_tables(void);
+char     bus_track_dirty(char enable);
+
+char     bitmap_set(bus_bitmap_t * bitmap, uint64_t page);
+void     bitmap_clear(bus_bitmap_t * bitmap, uint64_t page);
+uint64_t bitmap_next(const bus_bitmap_t * bitmap, uint64_t page, uint64_t end);
+
+static inline char bitmap_test(const bus_bitmap_t * bitmap, uint64_t page) {
+	uint32_t shift = BITMAP_REGION_SHIFT - bitmap->page_shift;
+	const uint8_t * region = bitmap->regions[page >> shift];
+	uint32_t bit = page & ((1u << shift) - 1);
+	return region && ((region[bit >> 3] >> (bit & 7)) & 1);
+}
+
+/* The Main Memory stores its words big endian. These move one word through memcpy, which is safe on unaligned addresses
+ * and compiles into a single load or store (plus a byte swap on little endian hosts). A constant width folds the switch away */
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define MEM_BE16(x) __builtin_bswap16(x)
+#define MEM_BE32(x) __builtin_bswap32(x)
+#define MEM_BE64(x) __builtin_bswap64(x)
+#else
+#define MEM_BE16(x) (x)
+#define MEM_BE32(x) (x)
+#define MEM_BE64(x) (x)
+#endif
+
+static inline uint64_t mem_load(const uint8_t * mem, uint8_t access_width) {
+	uint16_t w16; uint32_t w32; uint64_t w64;
+	switch(access_width) {
+		case SZ_8:  return mem[0];
+		case SZ_16: memcpy(&w16, mem, sizeof(w16)); return MEM_BE16(w16);
+		case SZ_32: memcpy(&w32, mem, sizeof(w32)); return MEM_BE32(w32);
+		default:    memcpy(&w64, mem, sizeof(w64)); return MEM_BE64(w64);
+	}
+}
+
+static inline void mem_store(uint8_t * mem, uint64_t data, uint8_t access_width) {
+	uint16_t w16; uint32_t w32; uint64_t w64;
+	switch(access_width) {
+		case SZ_8:  mem[0] = (uint8_t)data; break;
+		case SZ_16: w16 = MEM_BE16((uint16_t)data); memcpy(mem, &w16, sizeof(w16)); break;
+		case SZ_32: w32 = MEM_BE32((uint32_t)data); memcpy(mem, &w32, sizeof(w32)); break;
+		default:    w64 = MEM_BE64(data);           memcpy(mem, &w64, sizeof(w64)); break;
+	}
+}
+
+/* Inlined, so that the fetches and the loads of a constant width are only a bounds check and a load */
+static inline uint64_t read_memory(uint64_t address, uint8_t access_width) {
+	if(access_width > SZ_64 || address >= memory_depth || memory_depth - address < (1u << access_width)) return 0;
+	const uint8_t * mem = memstore_ptr(address, 1 << access_width, 0);
+	return mem ? mem_load(mem, access_width) : read_memory_split(address, access_width);
+}
+
+/* The IO space is [IOSPACE, IOSPACE + io_space_end). The subtraction wraps the addresses below it, so one compare does */
+static inline enum ADDR_SPACE_T address_decode(uint64_t address) {
+	return address - IOSPACE < io_space_end ? SPACE_IO : SPACE_MMEM;
+}
+
+#endif /* SRC_VMACHINE_BUS_H_ */
@@ -0,0 +1,283 @@
+/*
+ * cosim.c
+ *
+ *  Created on: 09/01/2017
+ *      Author: Miguel
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+#include "cosim.h"
+#include "address_space.h"
+#include "bus.h"
+#include "defines.h"
+#include "mmu.h"
+#include "../iss/iss.h"
+
+char cosim_active = 0;
+
+/* Cycle counter of the RTL (master clock). Maintained by cosim_fli.c */
+uint64_t cosim_rtl_cycle = 0;
+
+/* Events of the reference model which the RTL has not matched yet (in program order): */
+cosim_event_t cosim_queue[COSIM_QUEUE_SZ];
+uint32_t      cosim_queue_len = 0;
+
+/* Loads which the RTL performed before the reference model got to them. Their data is handed over to the reference model: */
+cosim_event_t cosim_rtl_loads[COSIM_QUEUE_SZ];
+uint32_t      cosim_rtl_loads_len = 0;
+
+/* The reference model's MMU state. While the reference model isn't running, the MMU module follows the RTL: */
+uint8_t  cosim_mmu_enabled = 0;
+uint64_t cosim_mmu_pdp     = 0;
+
+/* Last instructions of the reference model (for the mismatch report): */
+uint64_t cosim_trace_pc[COSIM_TRACE_SZ];
+uint32_t cosim_trace_insn[COSIM_TRACE_SZ];
+
+/* The RTL's last memory transaction. It's repeated on every clock until the memory is ready, while the master clock is frozen: */
+cosim_event_t cosim_last_rtl_mem;
+uint64_t      cosim_last_rtl_mem_cycle = UINT64_MAX;
+
+/* Cosim statistics: */
+uint64_t cosim_checked = 0;
+
+/* Instruction of the reference model which is currently running: */
+static uint64_t cur_pc;
+static uint32_t cur_instruction;
+
+static uint64_t width_mask(uint8_t access_width) {
+	return access_width >= SZ_64 ? UINT64_MAX : (1ULL << (8 << access_width)) - 1;
+}
+
+static void print_event(const char * who, const cosim_event_t * ev, char has_pc) {
+	printf(">   %s: ", who);
+	if(!ev) {
+		printf("(nothing)\n");
+		return;
+	}
+	switch(ev->type) {
+		case EV_REG:   printf("X%-2d = 0x%016" PRIx64, ev->reg, ev->value); break;
+		case EV_LOAD:  printf("LD p@0x%" PRIx64 " <%d>", ev->address, ev->access_width); break;
+		case EV_STORE: printf("ST p@0x%" PRIx64 " <%d> = 0x%" PRIx64, ev->address, ev->access_width, ev->value & width_mask(ev->access_width)); break;
+	}
+	if(has_pc)
+		printf(" (pc 0x%" PRIx64 ": 0x%08x)", ev->pc, ev->instruction);
+	printf("\n");
+}
+
+/* Prints the report and stops checking. Always returns 0 */
+static char cosim_mismatch(const char * what, const cosim_event_t * rtl, char rtl_has_pc, const cosim_event_t * ref) {
+	printf("\n> COSIM: MISMATCH (%s) at RTL cycle %" PRIu64 ", after %" PRIu64 " reference instructions\n", what, cosim_rtl_cycle, cpu.instret);
+	print_event("RTL", rtl, rtl_has_pc);
+	print_event("ISS", ref, 1);
+	printf("> COSIM: Last instructions of the reference model:\n");
+	for(uint64_t i = cpu.instret > COSIM_TRACE_SZ ? cpu.instret - COSIM_TRACE_SZ : 0; i < cpu.instret; i++)
+		printf(">   0x%08" PRIx64 ": 0x%08x\n", cosim_trace_pc[i % COSIM_TRACE_SZ], cosim_trace_insn[i % COSIM_TRACE_SZ]);
+	fflush(stdout);
+	cosim_active = 0;
+	return 0;
+}
+
+static void queue_remove(cosim_event_t * queue, uint32_t * len, uint32_t idx) {
+	memmove(&queue[idx], &queue[idx + 1], (*len - idx - 1) * sizeof(cosim_event_t));
+	(*len)--;
+}
+
+static char queue_push(const cosim_event_t * ev) {
+	if(cosim_queue_len == COSIM_QUEUE_SZ)
+		return cosim_mismatch("the RTL is too far behind", 0, 0, &cosim_queue[0]);
+	cosim_queue[cosim_queue_len++] = *ev;
+	return 1;
+}
+
+/* Finds the reference model's oldest pending event which matches the RTL's event */
+static int32_t queue_find(uint8_t type, uint8_t reg) {
+	for(uint32_t i = 0; i < cosim_queue_len; i++)
+		if(cosim_queue[i].type == type && (type != EV_REG || cosim_queue[i].reg == reg))
+			return i;
+	return -1;
+}
+
+/**************************************/
+/* Memory interface of the reference: */
+/**************************************/
+static uint64_t cosim_iss_load(uint64_t address, uint8_t access_width) {
+	cosim_event_t ev = { EV_LOAD, 0, access_width, address, 0, cur_pc, cur_instruction, cpu.instret };
+
+	if(cosim_rtl_loads_len) {
+		/* The RTL already did this load. Use its data, so that the reads from the devices match too: */
+		cosim_event_t rtl = cosim_rtl_loads[0];
+		queue_remove(cosim_rtl_loads, &cosim_rtl_loads_len, 0);
+		cosim_checked++;
+		if(rtl.address != address || rtl.access_width != access_width)
+			cosim_mismatch("load address", &rtl, 0, &ev);
+		return rtl.value;
+	}
+
+	/* The reference model is ahead. The Main Memory can be read, but the devices can't be read twice: */
+	if(address_decode(address) == SPACE_MMEM)
+		ev.value = read_memory(address, access_width);
+	queue_push(&ev);
+	return ev.value;
+}
+
+static char cosim_iss_store(uint64_t address, uint64_t data, uint8_t access_width) {
+	cosim_event_t ev = { EV_STORE, 0, access_width, address, data, cur_pc, cur_instruction, cpu.instret };
+	queue_push(&ev);
+	return 1; /* The RTL does the actual write */
+}
+
+/* Runs one instruction of the reference model and records what it did. Returns 0 if the reference can't go on */
+static char cosim_step(void) {
+	uint64_t regs[ISS_REGISTER_COUNT];
+
+	if(cpu.halted)
+		return 0;
+
+	/* Swap in the reference model's MMU state: */
+	uint8_t  rtl_mmu_enabled = mmu_enabled;
+	uint64_t rtl_mmu_pdp     = mmu_pdp;
+	mmu_set_enabled(cosim_mmu_enabled);
+	mmu_set_pdp(cosim_mmu_pdp);
+
+	uint64_t address = address_translate(cpu.pc & ISS_ADDRESS_MASK);
+	cur_pc          = cpu.pc;
+	cur_instruction = address_decode(address) == SPACE_MMEM ? (uint32_t)read_memory(address, SZ_32) : 0;
+	cosim_trace_pc[cpu.instret % COSIM_TRACE_SZ]   = cur_pc;
+	cosim_trace_insn[cpu.instret % COSIM_TRACE_SZ] = cur_instruction;
+
+	memcpy(regs, cpu.x, sizeof(regs));
+	char ret = iss_step(&cpu);
+
+	cosim_mmu_enabled = mmu_enabled;
+	cosim_mmu_pdp     = mmu_pdp;
+	mmu_set_enabled(rtl_mmu_enabled);
+	mmu_set_pdp(rtl_mmu_pdp);
+
+	/* The RTL can only be seen writing registers whose value changes, so the same goes for the reference: */
+	for(int i = 0; i < ISS_REGISTER_COUNT - 1 && cosim_active; i++) {
+		if(cpu.x[i] != regs[i]) {
+			cosim_event_t ev = { EV_REG, i, 0, 0, cpu.x[i], cur_pc, cur_instruction, cpu.instret };
+			queue_push(&ev);
+		}
+	}
+
+	/* Events which the RTL should have matched by now: */
+	if(cosim_active && cosim_queue_len && cosim_queue[0].instret + COSIM_MAX_LAG < cpu.instret)
+		return cosim_mismatch("the RTL never did this", 0, 0, &cosim_queue[0]);
+
+	return ret && cosim_active;
+}
+
+/* Runs the reference model until it produces an event like the RTL's. Returns its index on the queue or -1 */
+static int32_t cosim_catch_up(const cosim_event_t * rtl, char rtl_has_pc) {
+	int32_t idx;
+	for(int steps = 0; (idx = queue_find(rtl->type, rtl->reg)) < 0; steps++) {
+		if(steps == COSIM_MAX_LAG || !cosim_step()) {
+			if(cosim_active)
+				cosim_mismatch(cpu.halted ? "the reference model halted" : "the reference model never did this", rtl, rtl_has_pc, 0);
+			return -1;
+		}
+	}
+	return idx;
+}
+
+/* Is this the same memory transaction as the last one? (the master clock didn't move) */
+static char cosim_rtl_mem_repeated(const cosim_event_t * ev) {
+	if(cosim_last_rtl_mem_cycle == cosim_rtl_cycle && cosim_last_rtl_mem.type == ev->type && cosim_last_rtl_mem.address == ev->address &&
+	   cosim_last_rtl_mem.access_width == ev->access_width && cosim_last_rtl_mem.value == ev->value)
+		return 1;
+	cosim_last_rtl_mem       = *ev;
+	cosim_last_rtl_mem_cycle = cosim_rtl_cycle;
+	return 0;
+}
+
+/**********************************/
+/* Events coming from the RTL:    */
+/**********************************/
+char cosim_rtl_reg_write(uint8_t reg, uint64_t value, uint64_t pc, uint32_t instruction) {
+	if(!cosim_active) return 1;
+
+	cosim_event_t rtl = { EV_REG, reg, 0, 0, value, pc, instruction, 0 };
+	int32_t idx = cosim_catch_up(&rtl, 1);
+	if(idx < 0)
+		return 0;
+
+	cosim_event_t ref = cosim_queue[idx];
+	queue_remove(cosim_queue, &cosim_queue_len, idx);
+	cosim_checked++;
+	if(ref.value != value)
+		return cosim_mismatch("register writeback", &rtl, 1, &ref);
+	return 1;
+}
+
+char cosim_rtl_load(uint64_t address, uint64_t data, uint8_t access_width) {
+	if(!cosim_active) return 1;
+
+	cosim_event_t rtl = { EV_LOAD, 0, access_width, address, data, 0, 0, 0 };
+	if(cosim_rtl_mem_repeated(&rtl))
+		return 1;
+
+	int32_t idx = queue_find(EV_LOAD, 0);
+	if(idx < 0) {
+		/* The reference model will pick it up once it gets there: */
+		if(cosim_rtl_loads_len == COSIM_QUEUE_SZ)
+			return cosim_mismatch("the reference model is too far behind", &rtl, 0, 0);
+		cosim_rtl_loads[cosim_rtl_loads_len++] = rtl;
+		return 1;
+	}
+
+	cosim_event_t ref = cosim_queue[idx];
+	queue_remove(cosim_queue, &cosim_queue_len, idx);
+	cosim_checked++;
+	if(ref.address != address || ref.access_width != access_width)
+		return cosim_mismatch("load address", &rtl, 0, &ref);
+	return 1;
+}
+
+char cosim_rtl_store(uint64_t address, uint64_t data, uint8_t access_width) {
+	if(!cosim_active) return 1;
+
+	cosim_event_t rtl = { EV_STORE, 0, access_width, address, data, 0, 0, 0 };
+	if(cosim_rtl_mem_repeated(&rtl))
+		return 1;
+
+	int32_t idx = cosim_catch_up(&rtl, 0);
+	if(idx < 0)
+		return 0;
+
+	cosim_event_t ref = cosim_queue[idx];
+	queue_remove(cosim_queue, &cosim_queue_len, idx);
+	cosim_checked++;
+	if(ref.address != address || ref.access_width != access_width)
+		return cosim_mismatch("store address", &rtl, 0, &ref);
+	if((ref.value ^ data) & width_mask(access_width))
+		return cosim_mismatch("store data", &rtl, 0, &ref);
+	return 1;
+}
+
+void cosim_rtl_interrupt(uint64_t cycle) {
+	if(!cosim_active) return;
+	printf("\n> COSIM: The RTL entered an interrupt / exception at cycle %" PRIu64 ". These aren't modelled in lockstep, so the checking stops here\n", cycle);
+	cosim_active = 0;
+}
+
+void cosim_init(void) {
+	iss_reset(&cpu);
+	iss_use_block_cache = 0;
+	iss_load  = cosim_iss_load;
+	iss_store = cosim_iss_store;
+
+	cosim_queue_len     = 0;
+	cosim_rtl_loads_len = 0;
+	cosim_mmu_enabled   = 0;
+	cosim_mmu_pdp       = 0;
+	cosim_active        = 1;
+}
+
+void cosim_print_stats(void) {
+	printf("\n> COSIM: %" PRIu64 " RTL events checked against %" PRIu64 " reference instructions (%s)",
+		cosim_checked, cpu.instret, cosim_active ? "no mismatches" : "stopped");
+}
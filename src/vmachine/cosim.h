@@ -0,0 +1,50 @@
+/*
+ * cosim.h
+ *
+ *  Created on: 09/01/2017
+ *      Author: Miguel
+ */
+
+#ifndef SRC_VMACHINE_COSIM_H_
+#define SRC_VMACHINE_COSIM_H_
+
+#include <stdint.h>
+
+/* Lockstep co-simulation: the RTL's register writebacks and memory transactions are checked against the
+ * Instruction Set Simulator (src/iss), which runs in the same process as the reference model.
+ * The reference model is only stepped when the RTL retires something, and it never touches the memory or the
+ * devices (the RTL remains the only one which does). Enable it with ENABLE_COSIM (defines.h) */
+
+#define COSIM_MAX_LAG    64  /* Instructions the reference model may run ahead of the RTL before an event counts as missing */
+#define COSIM_QUEUE_SZ   128 /* Events of the reference model which are waiting for the RTL */
+#define COSIM_TRACE_SZ   8   /* Instructions of the reference model listed on a mismatch report */
+
+enum COSIM_EVENT_TYPE {
+	EV_REG,   /* Register writeback */
+	EV_LOAD,  /* Memory read from the memory access stage */
+	EV_STORE  /* Memory write */
+};
+
+typedef struct {
+	uint8_t  type;
+	uint8_t  reg;          /* EV_REG */
+	uint8_t  access_width; /* EV_LOAD / EV_STORE */
+	uint64_t address;      /* Physical address (EV_LOAD / EV_STORE) */
+	uint64_t value;
+	uint64_t pc;
+	uint32_t instruction;
+	uint64_t instret;      /* Reference model's instruction count when the event happened */
+} cosim_event_t;
+
+extern char     cosim_active;
+extern uint64_t cosim_rtl_cycle;
+
+void cosim_init(void);
+char cosim_rtl_reg_write(uint8_t reg, uint64_t value, uint64_t pc, uint32_t instruction);
+char cosim_rtl_load(uint64_t address, uint64_t data, uint8_t access_width);
+char cosim_rtl_store(uint64_t address, uint64_t data, uint8_t access_width);
+void cosim_rtl_interrupt(uint64_t cycle);
+void cosim_print_stats(void);
+void cosim_fli_init(void); /* Provided by cosim_fli.c */
+
+#endif /* SRC_VMACHINE_COSIM_H_ */
@@ -0,0 +1,95 @@
+/*
+ * cosim_fli.c
+ *
+ *  Created on: 09/01/2017
+ *      Author: Miguel
+ */
+#include <mti.h>
+#include <stdio.h>
+#include <stdint.h>
+#include "cosim.h"
+#include "sim.h"
+#include "../iss/iss.h"
+
+/* Where the checker finds the FISC core's internal signals (see rtl/top.vhd and rtl/fisc.vhd): */
+#define COSIM_RTL_PATH     "/top/FISC_CORE"
+#define COSIM_REGFILE_PATH COSIM_RTL_PATH "/Stage2_Decode1/RegFile1/regfile"
+
+#define COSIM_STATE_FETCHING 0 /* s_fetching (rtl/defines.vhd) */
+
+typedef struct {
+	mtiSignalIdT   master_clk;
+	mtiSignalIdT   cpu_state;
+	mtiSignalIdT   wb_pc;          /* PC of the instruction on the MEM/WB pipeline register */
+	mtiSignalIdT   wb_instruction;
+	mtiSignalIdT * regs;           /* One signal per register of the register file */
+} cosim_fli_t;
+
+cosim_fli_t * cosim_ip;
+mtiProcessIdT cosim_process;
+
+/* The RTL's register file as of the last master clock: */
+uint64_t cosim_rtl_regs[ISS_REGISTER_COUNT];
+
+/* Runs on every edge of the master clock. A register written on one edge is only seen on the next one,
+ * together with the instruction which was on the writeback stage back then */
+void cosim_on_clk(void * param) {
+	static uint64_t wb_pc = 0;
+	static uint32_t wb_instruction = 0;
+	cosim_fli_t * cosim_ip = (cosim_fli_t *) param;
+
+	if(!sim_bit(cosim_ip->master_clk))
+		return;
+	cosim_rtl_cycle++;
+	if(!cosim_active)
+		return;
+
+	if(sim_vec(cosim_ip->cpu_state) != COSIM_STATE_FETCHING) {
+		cosim_rtl_interrupt(cosim_rtl_cycle);
+		return;
+	}
+
+	for(int i = 0; i < ISS_REGISTER_COUNT - 1; i++) {
+		uint64_t value = sim_vec(cosim_ip->regs[i]);
+		if(value == cosim_rtl_regs[i])
+			continue;
+		cosim_rtl_regs[i] = value;
+		if(!cosim_rtl_reg_write(i, value, wb_pc, wb_instruction)) {
+			mti_Break();
+			return;
+		}
+	}
+
+	wb_pc          = sim_vec(cosim_ip->wb_pc);
+	wb_instruction = (uint32_t)sim_vec(cosim_ip->wb_instruction);
+}
+
+/* The core's internal signals can only be found once the whole design has been elaborated */
+void cosim_on_load_done(void * param) {
+	cosim_fli_t * cosim_ip = (cosim_fli_t *) param;
+	mtiSignalIdT  regfile  = mti_FindSignal(COSIM_REGFILE_PATH);
+
+	cosim_ip->master_clk     = mti_FindSignal(COSIM_RTL_PATH "/master_clk");
+	cosim_ip->cpu_state      = mti_FindSignal(COSIM_RTL_PATH "/cpu_state");
+	cosim_ip->wb_pc          = mti_FindSignal(COSIM_RTL_PATH "/ifidexmem_pc_out");
+	cosim_ip->wb_instruction = mti_FindSignal(COSIM_RTL_PATH "/ifidexmem_instruction");
+
+	if(!regfile || !cosim_ip->master_clk || !cosim_ip->cpu_state || !cosim_ip->wb_pc || !cosim_ip->wb_instruction) {
+		printf("\n> ERROR: Co-simulation could not find the signals of '%s'. The checker is disabled\n", COSIM_RTL_PATH);
+		cosim_active = 0;
+		return;
+	}
+
+	cosim_ip->regs = mti_GetSignalSubelements(regfile, 0);
+	mti_Sensitize(cosim_process, cosim_ip->master_clk, MTI_EVENT);
+}
+
+void cosim_fli_init(void) {
+	cosim_init();
+
+	cosim_ip      = (cosim_fli_t *)mti_Malloc(sizeof(cosim_fli_t));
+	cosim_process = mti_CreateProcess("cosim_p", cosim_on_clk, cosim_ip);
+	mti_AddLoadDoneCB(cosim_on_load_done, cosim_ip);
+
+	printf("\n> Co-simulation enabled: the RTL is checked against the Instruction Set Simulator\n");
+}
@@ -8,10 +8,12 @@
 #ifndef SRC_VMACHINE_DEFINES_H_
 #define SRC_VMACHINE_DEFINES_H_
 
-#define MODELSIM_EXECUTION_TIME 50 /* How long will the Simulator run (in nanoseconds scale) */
-
 #define ENABLE_INTERRUPT_NOTICES (0)
 
+#define ENABLE_TRACE (1) /* Build the trace points in (they still need to be enabled at runtime, see trace.h) */
+
+#define ENABLE_COSIM (0) /* Check the RTL in lockstep against the Instruction Set Simulator (see cosim.h) */
+
 #define MAX_INTEGER_SIZE 64
 
 enum DATATYPE {
@@ -22,16 +24,17 @@ enum DATATYPE {
 #define ALIGN32(addr) ((addr)*4)
 #define ALIGN64(addr) ((addr)*8)
 
-#define IS_WINDOWS defined(_WIN32) || defined(_WIN64)
-
+#if defined(_WIN32) || defined(_WIN64)
+#define IS_WINDOWS (1)
+#else
+#define IS_WINDOWS (0)
+#endif
 
 #if IS_WINDOWS
 #define _TTHREAD_WIN32_
 #include <i686-w64-mingw32/include/SDL2/SDL.h>
-#include <windows.h>
-#include <winbase.h>
 #else
-#include <SDL.h>
+#include <SDL.h> /* From sdl2-config --cflags */
 #endif
 
 #include "../vmachine/tinycthread/tinycthread.h"
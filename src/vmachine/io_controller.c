@@ -4,168 +4,164 @@
  *  Created on: 19/12/2016
  *      Author: Miguel
  */
-#include <mti.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include "io_controller.h"
 #include "address_space.h"
 #include "defines.h"
-#include "signal_conv.h"
+#include "irq_queue.h"
 #include "tinycthread/tinycthread.h"
 #include "utils.h"
 
-typedef struct {
-	mtiSignalIdT clk;
-	mtiDriverIdT int_en;
-	mtiDriverIdT int_id;
-	mtiDriverIdT int_type;
-	mtiSignalIdT int_ack;
-	mtiSignalIdT int_ack_id;
-	mtiSignalIdT ex_enabled;
-	mtiSignalIdT int_enabled;
-} ioctrl_t;
-
-ioctrl_t * ioctrl_ip;
-
-uint8_t int_en_holdtime = 0;
-
 #define ALIGN_IOADDR(phys_addr) (phys_addr - IOSPACE)
 
-char io_rd_dispatch_ret[MAX_INTEGER_SIZE+1];
-
 volatile char io_controller_closing = 0;
-volatile char is_ack = 0;
-
-typedef struct iodev {
-	int (*init)(void*);
-	void (*deinit)(void);
-	char (*write)(uint32_t local_ioaddr, uint64_t data, uint8_t access_width);
-	uint64_t (*read)(uint32_t local_ioaddr, uint8_t access_width);
-	void (*int_ack)(void);
-	const int space_addr;
-	const int space_len;
-} iodev_t;
-
-iodev_t devices[] = {
-	{timer_init, timer_deinit, timer_write, timer_read, 0, 0, TIMER_IOSPACE}, /* Create Timer Device */
-	{vga_init, vga_deinit, vga_write, vga_read, 0, TIMER_IOSPACE, LINEAR_FRAMEBUFFER_SIZE}, /* Create VGA Device */
+
+/* The built-in devices, registered by io_dispatch_init in this order (their device ids) */
+static const iodev_t builtin_devices[] = {
+	{0, timer_start, timer_deinit, timer_write, timer_read, 0, TIMER_IOADDR, TIMER_IOSPACE, timer_save, timer_restore}, /* Create Timer Device */
+	{vga_init, vga_start, vga_deinit, vga_write, vga_read, 0, VGA_IOADDR, LINEAR_FRAMEBUFFER_SIZE, vga_save, vga_restore}, /* Create VGA Device */
 };
 
-thrd_t io_threads[IODEVICE_COUNT];
+static iodev_t  devices[IODEVICE_MAX];
+static uint32_t device_count = 0;
+static uint8_t  io_slots[IO_SLOT_COUNT];
+static char     io_dispatch_ready = 0;
+static char     io_running = 0;
+uint32_t io_space_end = 0;
 
-char io_controller_init(void) {
-	for(int i = 0; i < IODEVICE_COUNT; i++)
-		if(thrd_create(&io_threads[i], devices[i].init, (void*)i) != thrd_success)
-			return 0;
-	return 1;
+thrd_t io_threads[IODEVICE_MAX];
+
+static char io_start_device(uint32_t id) {
+	if(devices[id].start)
+		devices[id].start(id);
+	return !devices[id].init || thrd_create(&io_threads[id], devices[id].init, (void*)(uintptr_t)id) == thrd_success;
 }
 
-void io_controller_on_clk(void * param) {
-	_Bool clk = sig_to_int(ioctrl_ip->clk);
-	if(clk) {
-		if(!int_en_holdtime)
-			mti_ScheduleDriver(ioctrl_ip->int_en, 2, 1, MTI_INERTIAL);
-		else
-			int_en_holdtime--;
-		is_ack = sig_to_int(ioctrl_ip->int_ack);
-		if(is_ack) {
-			uint32_t int_ack_id = sigv_to_int(ioctrl_ip->int_ack_id);
-			if(int_ack_id < IODEVICE_COUNT && devices[int_ack_id].int_ack)
-				devices[int_ack_id].int_ack();
+/* Adds a device into the IO space. Returns its device id, or -1 if there is no room or it overlaps another device */
+int io_register_device(const iodev_t * dev) {
+	if(!io_dispatch_init())
+		return -1;
+	if(device_count == IODEVICE_MAX || !dev->space_len || dev->space_addr > IOSPACE_MAX_LEN - dev->space_len) {
+		printf("\n> ERROR: Could not register the IO device at 0x%x (%u bytes)\n", IOSPACE + dev->space_addr, dev->space_len);
+		return -1;
+	}
+	for(uint32_t i = 0; i < device_count; i++) {
+		if(dev->space_addr < devices[i].space_addr + devices[i].space_len && devices[i].space_addr < dev->space_addr + dev->space_len) {
+			printf("\n> ERROR: The IO device at 0x%x overlaps the device %u at 0x%x\n", IOSPACE + dev->space_addr, i, IOSPACE + devices[i].space_addr);
+			return -1;
 		}
 	}
+
+	uint32_t id = device_count;
+	devices[id] = *dev;
+	irq_set_priority(id, dev->irq_priority);
+
+	uint32_t end = dev->space_addr + dev->space_len;
+	for(uint32_t slot = dev->space_addr >> IO_SLOT_SHIFT; slot <= (end - 1) >> IO_SLOT_SHIFT; slot++) {
+		char whole = slot << IO_SLOT_SHIFT >= dev->space_addr && (slot + 1) << IO_SLOT_SHIFT <= end;
+		io_slots[slot] = (io_slots[slot] == IO_SLOT_NONE && whole) ? id : IO_SLOT_SHARED;
+	}
+	if(end > io_space_end)
+		io_space_end = end;
+	device_count++;
+
+	/* The controller is already up, so the device starts right away: */
+	if(io_running && !io_start_device(id))
+		return -1;
+	return id;
 }
 
-void io_controller_init_vhd(
-	mtiRegionIdT region,
-	char * param,
-	mtiInterfaceListT * generics,
-	mtiInterfaceListT * ports
-) {
-	ioctrl_ip              = (ioctrl_t *)mti_Malloc(sizeof(ioctrl_t));
-	ioctrl_ip->clk         = mti_FindPort(ports, "clk");
-	ioctrl_ip->int_en      = mti_CreateDriver(mti_FindPort(ports, "int_en"));
-	ioctrl_ip->int_id      = mti_CreateDriver(mti_FindPort(ports, "int_id"));
-	ioctrl_ip->int_type    = mti_CreateDriver(mti_FindPort(ports, "int_type"));
-	ioctrl_ip->int_ack     = mti_FindPort(ports, "int_ack");
-	ioctrl_ip->int_ack_id  = mti_FindPort(ports, "int_ack_id");
-	ioctrl_ip->ex_enabled  = mti_FindPort(ports, "ex_enabled");
-	ioctrl_ip->int_enabled = mti_FindPort(ports, "int_enabled");
-
-	mtiProcessIdT io_proc_onclk = mti_CreateProcess("ioctrl_p_onclk", io_controller_on_clk, ioctrl_ip);
-	mti_Sensitize(io_proc_onclk, ioctrl_ip->clk, MTI_EVENT);
+/* Builds the dispatch table with the built-in devices. The bus does this, since it dispatches even without the devices' threads */
+char io_dispatch_init(void) {
+	if(io_dispatch_ready)
+		return 1;
+	memset(io_slots, IO_SLOT_NONE, sizeof(io_slots));
+	io_dispatch_ready = 1;
+
+	/* The devices whose requests are dropped can be picked from the environment: */
+	const char * env = getenv(IRQ_ENV_MASK);
+	uint32_t masked = env ? strtoul(env, 0, 0) : 0;
+	for(uint32_t i = 0; i < IRQ_MAX_SOURCES; i++)
+		irq_set_masked(i, (masked >> i) & 1);
+	for(uint32_t i = 0; i < sizeof(builtin_devices) / sizeof(builtin_devices[0]); i++)
+		if(io_register_device(&builtin_devices[i]) < 0)
+			return 0;
+	return 1;
+}
+
+char io_controller_init(void) {
+	if(!io_dispatch_init())
+		return 0;
+	for(uint32_t i = 0; i < device_count; i++)
+		if(!io_start_device(i))
+			return 0;
+	io_running = 1;
+	return 1;
 }
 
 char io_controller_deinit(void) {
-	for(int i = 0; i < IODEVICE_COUNT; i++)
-		devices[i].deinit();
+	for(uint32_t i = 0; i < device_count; i++)
+		if(devices[i].deinit)
+			devices[i].deinit();
 	io_controller_closing = 1;
-	for(int i = 0; i < IODEVICE_COUNT; i++)
-		thrd_join(&io_threads[i], 0);
+	for(uint32_t i = 0; i < device_count; i++)
+		if(devices[i].init)
+			thrd_join(io_threads[i], 0);
+	io_running = 0;
 	return 1;
 }
 
+/* Returns the device which holds the IO address, or 0 */
+static inline iodev_t * io_lookup(uint32_t ioaddr) {
+	if(ioaddr >= io_space_end)
+		return 0;
+	uint8_t slot = io_slots[ioaddr >> IO_SLOT_SHIFT];
+	if(slot < IO_SLOT_SHARED)
+		return &devices[slot];
+	if(slot == IO_SLOT_SHARED)
+		for(uint32_t i = 0; i < device_count; i++)
+			if(ioaddr - devices[i].space_addr < devices[i].space_len)
+				return &devices[i];
+	return 0;
+}
+
 char io_wr_dispatch(uint32_t phys_addr, uint64_t data, uint8_t access_width) {
 	uint32_t ioaddr = ALIGN_IOADDR(phys_addr);
-	for(int i = 0; i < IODEVICE_COUNT; i++)
-		if(ioaddr >= devices[i].space_addr && ioaddr < devices[i].space_addr + devices[i].space_len)
-			return devices[i].write(ioaddr - devices[i].space_addr, data, access_width);
-	return 1;
+	iodev_t * dev = io_lookup(ioaddr);
+	return dev ? dev->write(ioaddr - dev->space_addr, data, access_width) : 1;
 }
 
-char * io_rd_dispatch(uint32_t phys_addr, uint8_t access_width) {
+uint64_t io_rd_dispatch(uint32_t phys_addr, uint8_t access_width) {
 	uint32_t ioaddr = ALIGN_IOADDR(phys_addr);
-	uint64_t ret = (uint64_t)-1;
-	for(int i = 0; i < IODEVICE_COUNT; i++)
-		if(ioaddr >= devices[i].space_addr && ioaddr < devices[i].space_addr + devices[i].space_len) {
-			ret = devices[i].read(ioaddr - devices[i].space_addr, access_width);
-			break;
-		}
-
-	int2bin64(ret, io_rd_dispatch_ret, 64);
-
-	for(int i = 0; i < MAX_INTEGER_SIZE; i++)
-		io_rd_dispatch_ret[i] = (io_rd_dispatch_ret[i]-'0') + 2;
-	io_rd_dispatch_ret[MAX_INTEGER_SIZE] = 0;
-	return io_rd_dispatch_ret;
+	iodev_t * dev = io_lookup(ioaddr);
+	return dev ? dev->read(ioaddr - dev->space_addr, access_width) : (uint64_t)-1;
 }
 
-char io_irq(uint8_t devid, enum INTERRUPT_TYPE type) {
-	/* TODO: Since this function can be called from multioctrl_iple threads, we must implement queueing for IRQ servicing */
-	/* Do not trigger an interrupt while the CPU is on IRQ mode, therefore, we must wait for a CPU ack */
-
-#if ENABLE_INTERRUPT_NOTICES == 1
-	printf("\n**** NOTICE: INTERRUPT (%s, devid: %d) ****\n", (type == INT_ERR) ? "EXC" : "IRQ", devid);
-	fflush(stdout);
-#endif
-
-	_Bool int_enabled = sig_to_int(ioctrl_ip->int_enabled);
-	_Bool ex_enabled  = sig_to_int(ioctrl_ip->ex_enabled);
-
-	if(type == INT_ERR && !ex_enabled) {
-#if ENABLE_INTERRUPT_NOTICES == 1
-		printf("**** ERROR: Exceptions are disabled! Dropping the EX request... ****\n");
-		fflush(stdout);
-#endif
-		return 0;
-	}
-
-	if(type == INT_IRQ && !int_enabled) {
-#if ENABLE_INTERRUPT_NOTICES == 1
-		printf("**** ERROR: Interrupts are disabled! Dropping the IRQ request... ****\n");
-		fflush(stdout);
-#endif
-		return 0;
-	}
-
-	int_en_holdtime = 1; /* The IRQ enable wire will be held high for this many clock cycles */
+/* Saves the state of every device which has any, in the order of the device table */
+char io_snapshot_save(snapshot_stream_t * s) {
+	for(uint32_t i = 0; i < device_count; i++)
+		if(devices[i].save && !devices[i].save(s))
+			return 0;
+	return 1;
+}
 
-	mti_ScheduleDriver(ioctrl_ip->int_en,   3, 1, MTI_INERTIAL);
-	mti_ScheduleDriver(ioctrl_ip->int_id,   (long)int_to_sigv(devid, 8), 1, MTI_INERTIAL);
-	mti_ScheduleDriver(ioctrl_ip->int_type, (long)int_to_sigv(type,  2), 1, MTI_INERTIAL);
+char io_snapshot_restore(snapshot_stream_t * s) {
+	for(uint32_t i = 0; i < device_count; i++)
+		if(devices[i].restore && !devices[i].restore(s))
+			return 0;
+	return 1;
+}
 
-	if(devices[devid].int_ack)
-		while(!is_ack)
-			SDL_Delay(10);
+/* Returns 1 if the device blocks on io_irq until the CPU acknowledges its interrupt */
+char io_dev_wants_ack(uint8_t devid) {
+	return devid < device_count && devices[devid].int_ack;
+}
 
-	return 1;
+/* Forwards the CPU's interrupt acknowledge into the device that raised it */
+void io_ack_dispatch(uint32_t devid) {
+	if(devid < device_count && devices[devid].int_ack)
+		devices[devid].int_ack();
 }
@@ -9,6 +9,8 @@
 #define SRC_VMACHINE_IO_CONTROLLER_H_
 
 #include <stdint.h>
+#include "address_space.h"
+#include "snapshot.h"
 
 enum INTERRUPT_TYPE {
 	INT_ERR, /* For exceptions (Errors) */
@@ -16,10 +18,42 @@ enum INTERRUPT_TYPE {
 	INT_SIRQ /* For software interrupt requests */
 };
 
+/* An IO device. Its accesses are routed into it with the address relative to the start of its space */
+typedef struct iodev {
+	int (*init)(void*);    /* Optional: runs on the device's own thread, with its device id as the argument */
+	void (*start)(uint32_t devid); /* Optional: runs on the simulator's thread, before the device's thread is created */
+	void (*deinit)(void);  /* Optional: runs on the simulator's thread when the devices stop */
+	char (*write)(uint32_t local_ioaddr, uint64_t data, uint8_t access_width);
+	uint64_t (*read)(uint32_t local_ioaddr, uint8_t access_width);
+	void (*int_ack)(void);
+	uint32_t space_addr;   /* Relative to IOSPACE */
+	uint32_t space_len;
+	char (*save)(snapshot_stream_t * s);    /* Optional: saves the device's state into a snapshot */
+	char (*restore)(snapshot_stream_t * s);
+	uint8_t irq_priority;  /* Its requests go before those of the devices with a lower priority (see irq_queue.h) */
+} iodev_t;
+
+/* The accesses are dispatched through a table with an entry per slot of IO_SLOT_SIZE bytes of the IO space. A slot which
+ * lies entirely inside a device holds that device's id, so the device is found with a single lookup. Only the slots
+ * shared by several devices (or only partly covered by one) fall back to comparing the ranges of the devices */
+#define IO_SLOT_SHIFT  8
+#define IO_SLOT_SIZE   (1 << IO_SLOT_SHIFT)
+#define IO_SLOT_COUNT  ((IOSPACE_MAX_LEN + IO_SLOT_SIZE - 1) >> IO_SLOT_SHIFT)
+#define IO_SLOT_NONE   0xFF /* No device */
+#define IO_SLOT_SHARED 0xFE /* Compare the ranges of the devices */
+
+extern uint32_t io_space_end; /* End of the highest device, relative to IOSPACE */
+
+char io_dispatch_init(void);
+int  io_register_device(const iodev_t * dev);
 char io_controller_init(void);
 char io_controller_deinit(void);
 char io_wr_dispatch(uint32_t phys_addr, uint64_t data, uint8_t access_width);
-char * io_rd_dispatch(uint32_t phys_addr, uint8_t access_width);
-char io_irq(uint8_t devid, enum INTERRUPT_TYPE type);
+uint64_t io_rd_dispatch(uint32_t phys_addr, uint8_t access_width);
+char io_dev_wants_ack(uint8_t devid);
+void io_ack_dispatch(uint32_t devid);
+char io_snapshot_save(snapshot_stream_t * s);
+char io_snapshot_restore(snapshot_stream_t * s);
+char io_irq(uint8_t devid, enum INTERRUPT_TYPE type); /* Provided by the simulator front-end (FLI or ISS) */
 
 #endif /* SRC_VMACHINE_IO_CONTROLLER_H_ */
@@ -0,0 +1,110 @@
+/*
+ * io_controller_rtl.c
+ *
+ *  Created on: 19/12/2016
+ *      Author: Miguel
+ */
+#include <stdio.h>
+#include "io_controller.h"
+#include "io_controller_rtl.h"
+#include "irq_queue.h"
+#include "defines.h"
+#include "trace.h"
+
+/* The CPU takes an interrupt on a falling edge of the clock, and only while it is fetching. So a request is offered on the
+ * interrupt wires until the CPU accepts it, which it signals by dropping int_ack. It raises int_ack again once the ISR
+ * returns, and the next request is offered after that. The request stays pending while it is offered, so that the offer
+ * can be replaced by a more urgent one, or withdrawn if the CPU disables its type */
+enum IOC_STATE {
+	IOC_IDLE,    /* Nothing is offered */
+	IOC_OFFERED, /* int_en is high with the request in offered_id / offered_type */
+	IOC_IN_ISR   /* The CPU took the offered request. int_id stays put, since the CPU acknowledges with it */
+};
+
+static uint8_t ioc_state    = IOC_IDLE;
+static uint8_t ack_old      = 1; /* int_ack on the last rising edge. The CPU holds it high while it waits for interrupts */
+static uint8_t offered_id   = 0;
+static uint8_t offered_type = 0;
+
+/* Buffers which hold the encoded std_logic data that is driven into the interrupt wires */
+static char int_id_sigv[8];
+static char int_type_sigv[2];
+
+/* Snapshot section of the interrupt being offered and of the pending requests (see snapshot.h) */
+static char io_controller_save(snapshot_stream_t * s) {
+	return snapshot_write(s, &ioc_state, sizeof(ioc_state)) && snapshot_write(s, &ack_old, sizeof(ack_old))
+		&& snapshot_write(s, &offered_id, sizeof(offered_id)) && snapshot_write(s, &offered_type, sizeof(offered_type))
+		&& snapshot_write(s, irq_pending, sizeof(irq_pending));
+}
+
+static char io_controller_restore(snapshot_stream_t * s) {
+	return snapshot_read(s, &ioc_state, sizeof(ioc_state)) && snapshot_read(s, &ack_old, sizeof(ack_old))
+		&& snapshot_read(s, &offered_id, sizeof(offered_id)) && snapshot_read(s, &offered_type, sizeof(offered_type))
+		&& snapshot_read(s, irq_pending, sizeof(irq_pending));
+}
+
+/* Offers the most urgent request which the CPU has enabled on the interrupt wires, or withdraws the offer if there is none */
+static void io_controller_offer(ioctrl_t * ioctrl_ip) {
+	uint8_t types = (sim_bit(ioctrl_ip->ex_enabled)  ? IRQ_TYPE_BIT(INT_ERR) : 0)
+	              | (sim_bit(ioctrl_ip->int_enabled) ? IRQ_TYPE_BIT(INT_IRQ) | IRQ_TYPE_BIT(INT_SIRQ) : 0);
+	uint8_t devid;
+	enum INTERRUPT_TYPE type;
+
+	if(!irq_peek(types, &devid, &type)) {
+		if(ioc_state == IOC_OFFERED)
+			sim_drive_bit(ioctrl_ip->int_en, 0, 1);
+		ioc_state = IOC_IDLE;
+		return;
+	}
+	if(ioc_state == IOC_OFFERED && devid == offered_id && type == offered_type)
+		return; /* Still on the wires */
+
+	ioc_state    = IOC_OFFERED;
+	offered_id   = devid;
+	offered_type = type;
+	sim_drive_bit(ioctrl_ip->int_en,   1, 1);
+	sim_drive_vec(ioctrl_ip->int_id,   devid, 8, int_id_sigv,   1);
+	sim_drive_vec(ioctrl_ip->int_type, type,  2, int_type_sigv, 1);
+}
+
+/* Runs on every edge of the clock */
+void io_controller_on_clk(ioctrl_t * ioctrl_ip) {
+	if(!sim_bit(ioctrl_ip->clk))
+		return;
+
+	uint8_t ack = sim_bit(ioctrl_ip->int_ack);
+	if(ack_old && !ack && ioc_state == IOC_OFFERED) {
+		/* Falling edge: the CPU took the offered request */
+		irq_take(offered_id, offered_type);
+		trace(TRACE_IRQ, TR_IRQ, 0, 0, 0, offered_type, offered_id);
+		sim_drive_bit(ioctrl_ip->int_en, 0, 1);
+		ioc_state = IOC_IN_ISR;
+	} else if(!ack_old && ack) {
+		/* Rising edge: the ISR returned */
+		io_ack_dispatch(sim_vec(ioctrl_ip->int_ack_id));
+		if(ioc_state == IOC_IN_ISR)
+			ioc_state = IOC_IDLE;
+	}
+	ack_old = ack;
+
+	if(ioc_state != IOC_IN_ISR && (ioc_state == IOC_OFFERED || irq_any_pending()))
+		io_controller_offer(ioctrl_ip);
+}
+
+void io_controller_setup(void) {
+	snapshot_add_section(SNAPSHOT_TAG('I', 'O', 'C', ' '), io_controller_save, io_controller_restore);
+}
+
+/* Called by the devices (from any thread). The request is queued, and io_controller_on_clk drives it into the CPU */
+char io_irq(uint8_t devid, enum INTERRUPT_TYPE type) {
+#if ENABLE_INTERRUPT_NOTICES == 1
+	printf("\n**** NOTICE: INTERRUPT (%s, devid: %d) ****\n", (type == INT_ERR) ? "EXC" : "IRQ", devid);
+	fflush(stdout);
+#endif
+
+	if(!irq_post(devid, type)) {
+		trace(TRACE_IRQ, TR_IRQ_DROP, 0, 0, 0, type, devid);
+		return 0;
+	}
+	return 1;
+}
@@ -0,0 +1,28 @@
+/*
+ * io_controller_rtl.h
+ *
+ *  Created on: 20/01/2017
+ *      Author: Miguel
+ */
+
+#ifndef SRC_VMACHINE_IO_CONTROLLER_RTL_H_
+#define SRC_VMACHINE_IO_CONTROLLER_RTL_H_
+
+#include "sim.h"
+
+/* Ports of the IO_Controller entity (rtl/io_controller.vhd), as the simulator backend sees them: */
+typedef struct {
+	sim_signal_t clk;
+	sim_driver_t int_en;
+	sim_driver_t int_id;
+	sim_driver_t int_type;
+	sim_signal_t int_ack;
+	sim_signal_t int_ack_id;
+	sim_signal_t ex_enabled;
+	sim_signal_t int_enabled;
+} ioctrl_t;
+
+void io_controller_setup(void);
+void io_controller_on_clk(ioctrl_t * ioctrl_ip);
+
+#endif /* SRC_VMACHINE_IO_CONTROLLER_RTL_H_ */
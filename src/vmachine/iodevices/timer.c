@@ -7,44 +7,114 @@
 #include "timer.h"
 #include "../defines.h"
 #include "../io_controller.h"
+#include "../scheduler.h"
 
-mtx_t mutex;
-
-char timer_device_running = 1;
 uint32_t timer_device_id = (uint32_t)-1;
 
-void timer_poll(void) {
-	SDL_Delay(100); /* Wait a little bit to allow the CPU to start executing */
-	timer_device_running = 1;
-	while(timer_device_running) {
-		io_irq(timer_device_id, INT_IRQ);
-		SDL_Delay(1);
+static char     timer_started = 0;
+static uint64_t timer_ctrl    = 0;
+static uint64_t timer_period  = 0;
+static uint64_t timer_status  = 0;
+static uint64_t timer_deadline;   /* Cycle of the next expiration, while timer_event is scheduled */
+static int      timer_event = -1;
+
+static void timer_expire(void * arg, uint64_t now);
+
+/* (Re)starts the count, which expires after 'cycles' cycles. A disabled timer (or a zero count) stays stopped */
+static void timer_arm(uint64_t now, uint64_t cycles) {
+	sched_cancel(timer_event);
+	timer_event = -1;
+	if((timer_ctrl & TIMER_CTRL_ENABLE) && cycles) {
+		timer_deadline = now + cycles;
+		timer_event = sched_add(timer_deadline, timer_expire, 0);
 	}
 }
 
-int timer_init(void * arg) {
-	timer_device_id = (uint32_t)arg;
-	mtx_init(&mutex, mtx_plain);
-
-	timer_poll();
+static void timer_expire(void * arg, uint64_t now) {
+	timer_event = -1;
+	timer_status |= TIMER_STATUS_EXPIRED;
+	if(timer_ctrl & TIMER_CTRL_PERIODIC)
+		timer_arm(now, timer_period); /* From the cycle it was due, so that a late dispatch does not drift */
+	else
+		timer_ctrl &= ~TIMER_CTRL_ENABLE;
+	if(timer_ctrl & TIMER_CTRL_IRQ)
+		io_irq(timer_device_id, INT_IRQ);
+}
 
-	mtx_destroy(&mutex);
-	thrd_exit(0);
-	return 1;
+void timer_start(uint32_t devid) {
+	timer_device_id = devid;
+	timer_started   = 1;
+	timer_ctrl      = TIMER_CTRL_ENABLE | TIMER_CTRL_PERIODIC | TIMER_CTRL_IRQ;
+	timer_period    = TIMER_DEFAULT_PERIOD;
+	timer_status    = 0;
+	timer_arm(sched_now, timer_period);
 }
 
 void timer_deinit(void) {
-	mtx_lock(&mutex);
-	timer_device_running = 0;
-	mtx_unlock(&mutex);
+	sched_cancel(timer_event);
+	timer_event   = -1;
+	timer_started = 0;
 }
 
-char timer_write(uint32_t local_ioaddr, uint64_t data, uint8_t access_width) {
+/* The registers are only accessed at their own offset. Narrower accesses read (or write, zero extended) their low bits */
+static uint64_t width_mask(uint8_t access_width) {
+	switch(access_width) {
+		case SZ_8:  return 0xFF;
+		case SZ_16: return 0xFFFF;
+		case SZ_32: return 0xFFFFFFFF;
+		default:    return (uint64_t)-1;
+	}
+}
 
+char timer_write(uint32_t local_ioaddr, uint64_t data, uint8_t access_width) {
+	data &= width_mask(access_width);
+	switch(local_ioaddr) {
+		case TIMER_REG_CTRL: {
+			char was_enabled = (timer_ctrl & TIMER_CTRL_ENABLE) != 0;
+			timer_ctrl = data & (TIMER_CTRL_ENABLE | TIMER_CTRL_PERIODIC | TIMER_CTRL_IRQ);
+			if(!(timer_ctrl & TIMER_CTRL_ENABLE))
+				timer_arm(sched_now, 0);
+			else if(!was_enabled)
+				timer_arm(sched_now, timer_period);
+			break;
+		}
+		case TIMER_REG_PERIOD: timer_period = data; break; /* Takes effect on the next expiration */
+		case TIMER_REG_COUNT:  timer_arm(sched_now, data); break;
+		case TIMER_REG_STATUS: timer_status &= ~data; break;
+		default: break;
+	}
 	return 1;
 }
 
 uint64_t timer_read(uint32_t local_ioaddr, uint8_t access_width) {
+	uint64_t value;
+	switch(local_ioaddr) {
+		case TIMER_REG_CTRL:   value = timer_ctrl; break;
+		case TIMER_REG_PERIOD: value = timer_period; break;
+		case TIMER_REG_COUNT:  value = timer_event >= 0 && timer_deadline > sched_now ? timer_deadline - sched_now : 0; break;
+		case TIMER_REG_STATUS: value = timer_status; break;
+		default:               value = 0; break;
+	}
+	return value & width_mask(access_width);
+}
 
-	return 0;
+/* Snapshots hold the registers and the absolute cycle of the next expiration */
+char timer_save(snapshot_stream_t * s) {
+	uint64_t deadline = timer_event >= 0 ? timer_deadline : SCHED_NEVER;
+	return snapshot_write(s, &timer_ctrl, sizeof(timer_ctrl)) && snapshot_write(s, &timer_period, sizeof(timer_period))
+		&& snapshot_write(s, &timer_status, sizeof(timer_status)) && snapshot_write(s, &deadline, sizeof(deadline));
+}
+
+char timer_restore(snapshot_stream_t * s) {
+	uint64_t deadline;
+	if(!snapshot_read(s, &timer_ctrl, sizeof(timer_ctrl)) || !snapshot_read(s, &timer_period, sizeof(timer_period))
+		|| !snapshot_read(s, &timer_status, sizeof(timer_status)) || !snapshot_read(s, &deadline, sizeof(deadline)))
+		return 0;
+	sched_cancel(timer_event);
+	timer_event = -1;
+	if(timer_started && deadline != SCHED_NEVER) {
+		timer_deadline = deadline;
+		timer_event = sched_add(timer_deadline, timer_expire, 0);
+	}
+	return 1;
 }
@@ -9,12 +9,35 @@
 #define SRC_VMACHINE_IODEVICES_TIMER_H_
 
 #include <stdint.h>
+#include "../snapshot.h"
 
-#define TIMER_IOSPACE 1
+/* Programmable timer, counting simulated clock cycles (see scheduler.h). Its registers are 64 bits wide:
+ *  TIMER_REG_CTRL:   TIMER_CTRL_* bits
+ *  TIMER_REG_PERIOD: cycles between two expirations
+ *  TIMER_REG_COUNT:  cycles left until the next expiration. Writing it restarts the count from the value written
+ *  TIMER_REG_STATUS: TIMER_STATUS_EXPIRED is set on every expiration. Writing a 1 clears it
+ * The timer comes out of reset enabled and periodic, interrupting every TIMER_DEFAULT_PERIOD cycles */
 
-int timer_init(void * arg);
+#define TIMER_IOSPACE 32 /* Bytes of registers */
+
+#define TIMER_REG_CTRL   0x00
+#define TIMER_REG_PERIOD 0x08
+#define TIMER_REG_COUNT  0x10
+#define TIMER_REG_STATUS 0x18
+
+#define TIMER_CTRL_ENABLE   (1 << 0)
+#define TIMER_CTRL_PERIODIC (1 << 1) /* Otherwise one-shot: the timer disables itself when it expires */
+#define TIMER_CTRL_IRQ      (1 << 2) /* Raise an interrupt when it expires */
+
+#define TIMER_STATUS_EXPIRED (1 << 0)
+
+#define TIMER_DEFAULT_PERIOD 50000 /* 1 ms at 50 MHz */
+
+void timer_start(uint32_t devid);
 void timer_deinit(void);
 char timer_write(uint32_t local_ioaddr, uint64_t data, uint8_t access_width);
 uint64_t timer_read(uint32_t local_ioaddr, uint8_t access_width);
+char timer_save(snapshot_stream_t * s);
+char timer_restore(snapshot_stream_t * s);
 
 #endif /* SRC_VMACHINE_IODEVICES_TIMER_H_ */
@@ -7,9 +7,12 @@
 #include "vga.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "../defines.h"
+#include "../mmio_ring.h"
+#include "../scheduler.h"
 
 SDL_Window   * window = 0;
 SDL_Renderer * renderer;
@@ -17,89 +20,72 @@ SDL_Texture  * texture;
 
 char renderbuffer[LINEAR_FRAMEBUFFER_SIZE];
 
-char vga_device_running = 1;
-char vga_device_open    = 0;
+char vga_device_running = 1; /* Cleared (atomically) to stop the VGA thread */
 uint32_t vga_device_id  = (uint32_t)-1;
 
-mtx_t mutex;
+char vga_headless = 0;
+static char     vga_verbose = 0;
+static uint32_t frame_count = 0;
+static uint64_t frame_hash  = 0;
+static int      frame_event = -1;  /* Next headless frame, on the scheduler */
+static uint64_t frame_deadline;    /* Its cycle */
 
-volatile uint32_t internal_local_ioaddr = 0;
-volatile uint64_t internal_data = 0;
-volatile uint8_t  internal_access_width = 0;
-volatile uint8_t  internal_wr = 0;
-volatile uint8_t  internal_rd = 0;
+static void vga_frame_arm(uint64_t when);
+static uint32_t dump_every  = 0; /* Dump a frame every this many frames (0: never) */
+static char     dump_file[256];
 
-volatile uint64_t external_rd = 0;
+/* The simulator's accesses to the framebuffer, executed by the VGA thread (which owns the SDL renderer). The ring is only open
+ * while that thread runs. Otherwise (headless, no devices, or SDL failed) the simulator's thread owns the framebuffer and accesses it directly */
+static mmio_ring_t vga_ring;
+
+static char vga_local_write(uint32_t local_ioaddr, uint64_t data, uint8_t access_width);
+static uint64_t vga_local_read(uint32_t local_ioaddr, uint8_t access_width);
 
 char vga_write(uint32_t local_ioaddr, uint64_t data, uint8_t access_width) {
-	static char first = 2; /* TODO: This variable temporarily fixes a threading bug */
-	internal_local_ioaddr = local_ioaddr;
-	internal_data = data;
-	internal_access_width = access_width;
-	while(internal_wr) SDL_Delay(1);
-	internal_wr = 1;
-	if(first) {
-		first--;
-		while(internal_wr) SDL_Delay(1);
-		return vga_write(local_ioaddr, data, access_width);
-	} else {
-		first = 2;
-	}
-	return 1;
+	if(!mmio_is_open(&vga_ring))
+		return vga_local_write(local_ioaddr, data, access_width);
+	return mmio_post_write(&vga_ring, local_ioaddr, data, access_width);
 }
 
-char vga_local_write(uint32_t local_ioaddr, uint64_t data, uint8_t access_width) {
-	if(local_ioaddr < LINEAR_FRAMEBUFFER_SIZE) {
-		vga_device_open = 1;
-		int pitch = WINDOW_WIDTH*4;
-
-		uint32_t format;
-		int w, h;
-		SDL_QueryTexture(texture, &format, NULL, &w, &h);
-		SDL_PixelFormat * fmt = SDL_AllocFormat(SDL_GetWindowPixelFormat(window));
-
-		SDL_LockTexture(texture, NULL, (void**)&renderbuffer[0], &pitch);
-
-		switch(access_width) {
-			case SZ_8: {
-				uint32_t * ptr = (uint32_t*)&renderbuffer[local_ioaddr];
-				*ptr = SDL_MapRGB(fmt, 0, 0, (uint8_t) data & 0xFF);
-				break;
-			}
-			case SZ_16: {
-				uint32_t * ptr = (uint32_t*)&renderbuffer[local_ioaddr];
-				*ptr = SDL_MapRGB(fmt, 0, (uint8_t)((data & 0xFF00) >> 8), (uint8_t) data & 0xFF);
-				break;
-			}
-			case SZ_32: {
-				uint32_t * ptr = (uint32_t*)&renderbuffer[local_ioaddr];
-				*ptr = SDL_MapRGB(fmt, (uint8_t)((data & 0xFF0000) >> 16), (uint8_t)((data & 0xFF00) >> 8), (uint8_t) data & 0xFF);
-				break;
-			}
-			case SZ_64: {
-				uint32_t * ptr = (uint32_t*)&renderbuffer[local_ioaddr];
-				ptr[0] = SDL_MapRGB(fmt, (uint8_t)((data & 0xFF000000000000) >> 48), (uint8_t)((data & 0xFF0000000000) >> 40), (uint8_t)((data & 0xFF00000000) >> 32));
-				ptr[1] = SDL_MapRGB(fmt, (uint8_t)((data & 0xFF0000) >> 16), (uint8_t)((data & 0xFF00) >> 8), (uint8_t) data & 0xFF);
-				break;
-			}
-			default: return 0;
-		}
+/* The framebuffer is a shadow of the texture in ARGB8888. Only the rows which were written get uploaded on the next frame */
+static uint8_t dirty_rows[WINDOW_HEIGHT];
+static uint32_t dirty_top = WINDOW_HEIGHT, dirty_bottom = 0; /* Rows [dirty_top, dirty_bottom) hold every dirty row */
 
-		SDL_FreeFormat(fmt);
-		SDL_UnlockTexture(texture);
+static void vga_mark_dirty(uint32_t first_row, uint32_t last_row) {
+	memset(&dirty_rows[first_row], 1, last_row - first_row + 1);
+	if(first_row < dirty_top)
+		dirty_top = first_row;
+	if(last_row + 1 > dirty_bottom)
+		dirty_bottom = last_row + 1;
+}
+
+static char vga_local_write(uint32_t local_ioaddr, uint64_t data, uint8_t access_width) {
+	uint32_t len = access_width == SZ_64 ? 8 : 4; /* Every access writes whole pixels */
+	if(local_ioaddr > LINEAR_FRAMEBUFFER_SIZE - len)
+		return 1;
+
+	uint32_t * ptr = (uint32_t*)&renderbuffer[local_ioaddr];
+	switch(access_width) {
+		case SZ_8:  *ptr = VGA_ARGB(0, 0, data); break;
+		case SZ_16: *ptr = VGA_ARGB(0, data >> 8, data); break;
+		case SZ_32: *ptr = VGA_ARGB(data >> 16, data >> 8, data); break;
+		case SZ_64:
+			ptr[0] = VGA_ARGB(data >> 48, data >> 40, data >> 32);
+			ptr[1] = VGA_ARGB(data >> 16, data >> 8, data);
+			break;
+		default: return 0;
 	}
+	vga_mark_dirty(local_ioaddr / VGA_PITCH, (local_ioaddr + len - 1) / VGA_PITCH);
 	return 1;
 }
 
 uint64_t vga_read(uint32_t local_ioaddr, uint8_t access_width) {
-	internal_local_ioaddr = local_ioaddr;
-	internal_access_width = access_width;
-	internal_rd = 1;
-	while(internal_rd) SDL_Delay(1);
-	return external_rd;
+	if(!mmio_is_open(&vga_ring))
+		return vga_local_read(local_ioaddr, access_width);
+	return mmio_read(&vga_ring, local_ioaddr, access_width);
 }
 
-uint64_t vga_local_read(uint32_t local_ioaddr, uint8_t access_width) {
+static uint64_t vga_local_read(uint32_t local_ioaddr, uint8_t access_width) {
 	switch(access_width) {
 		case SZ_8:  if(local_ioaddr   >= LINEAR_FRAMEBUFFER_SIZE) return (uint64_t)-1; break;
 		case SZ_16: if(local_ioaddr+1 >= LINEAR_FRAMEBUFFER_SIZE) return (uint64_t)-1; break;
@@ -132,66 +118,246 @@ uint64_t vga_local_read(uint32_t local_ioaddr, uint8_t access_width) {
 	}
 }
 
-void vga_render(void) {
-	SDL_UpdateTexture(texture, NULL, &renderbuffer[0], WINDOW_WIDTH*4);
+/* Snapshots hold the framebuffer's rows which are not all black. The read goes through the ring, so every write posted before
+ * lands first. After it the VGA thread only reads the framebuffer, until the simulator posts again */
+char vga_save(snapshot_stream_t * s) {
+	static uint32_t black[WINDOW_WIDTH];
+	uint32_t end = SNAPSHOT_END;
+	uint32_t frames = vga_headless ? frame_count : 0;
+	uint64_t deadline = frame_event >= 0 ? frame_deadline : SCHED_NEVER;
+	vga_read(0, SZ_8);
+	/* Only the headless frames follow the simulation. The window's run on the host's clock: */
+	if(!snapshot_write(s, &frames, sizeof(frames)) || !snapshot_write(s, &deadline, sizeof(deadline)))
+		return 0;
+	for(uint32_t x = 0; x < WINDOW_WIDTH; x++)
+		black[x] = VGA_ARGB(0, 0, 0);
+	for(uint32_t row = 0; row < WINDOW_HEIGHT; row++) {
+		const char * line = &renderbuffer[row * WINDOW_WIDTH * 4];
+		if(memcmp(line, black, sizeof(black)) && (!snapshot_write(s, &row, sizeof(row)) || !snapshot_write(s, line, sizeof(black))))
+			return 0;
+	}
+	return snapshot_write(s, &end, sizeof(end));
+}
+
+/* Writes a row of pixels (or a black row) the way the simulator does, two pixels per access */
+static void vga_write_row(uint32_t row, const uint32_t * pixels) {
+	for(uint32_t x = 0; x < WINDOW_WIDTH; x += 2) {
+		uint64_t data = pixels ? (uint64_t)(pixels[x] & 0xFFFFFF) << 32 | (pixels[x + 1] & 0xFFFFFF) : 0;
+		vga_write(row * VGA_PITCH + x * 4, data, SZ_64);
+	}
+}
+
+/* The rows go through the ring as well, since the VGA thread owns the framebuffer and its dirty rows */
+char vga_restore(snapshot_stream_t * s) {
+	static uint32_t line[WINDOW_WIDTH];
+	uint32_t row = 0;
+	uint32_t frames;
+	uint64_t deadline;
+	if(!snapshot_read(s, &frames, sizeof(frames)) || !snapshot_read(s, &deadline, sizeof(deadline)))
+		return 0;
+	if(vga_headless && deadline != SCHED_NEVER) {
+		frame_count = frames;
+		vga_frame_arm(deadline);
+	}
+	for(uint32_t y = 0; y < WINDOW_HEIGHT; y++)
+		vga_write_row(y, 0);
+	while(snapshot_read(s, &row, sizeof(row)) && row != SNAPSHOT_END) {
+		if(row >= WINDOW_HEIGHT || !snapshot_read(s, line, sizeof(line)))
+			return 0;
+		vga_write_row(row, line);
+	}
+	return row == SNAPSHOT_END;
+}
+
+/* FNV-1a of the framebuffer, so that tests can check what is on the screen without looking at it */
+uint64_t vga_frame_hash(void) {
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for(uint32_t i = 0; i < LINEAR_FRAMEBUFFER_SIZE; i++)
+		hash = (hash ^ (uint8_t)renderbuffer[i]) * 0x100000001b3ULL;
+	return hash;
+}
+
+/* Writes the framebuffer into a binary PPM */
+static char vga_write_ppm(const char * path) {
+	static uint8_t row[WINDOW_WIDTH * 3];
+	FILE * fptr = fopen(path, "wb");
+	if(!fptr) {
+		printf("\n> ERROR: Could not create the frame dump '%s'\n", path);
+		return 0;
+	}
+	fprintf(fptr, "P6\n%d %d\n255\n", WINDOW_WIDTH, WINDOW_HEIGHT);
+	for(uint32_t y = 0; y < WINDOW_HEIGHT; y++) {
+		const uint32_t * pixels = (const uint32_t*)&renderbuffer[y * VGA_PITCH];
+		for(uint32_t x = 0; x < WINDOW_WIDTH; x++) {
+			row[x * 3]     = pixels[x] >> 16;
+			row[x * 3 + 1] = pixels[x] >> 8;
+			row[x * 3 + 2] = pixels[x];
+		}
+		fwrite(row, 1, sizeof(row), fptr);
+	}
+	return fclose(fptr) == 0;
+}
+
+/* Dumps the framebuffer as the simulator sees it. The read goes through the ring, so every write posted before lands first */
+char vga_dump(const char * path) {
+	vga_read(0, SZ_8);
+	if(!vga_write_ppm(path))
+		return 0;
+	printf("\n> VGA: Dumped '%s' (hash %016llx)\n", path, (unsigned long long)vga_frame_hash());
+	return 1;
+}
+
+/* Uploads each run of dirty rows into the texture, and presents it. Returns 0 if nothing changed */
+char vga_render(void) {
+	if(dirty_top >= dirty_bottom)
+		return 0;
+	for(uint32_t row = dirty_top; row < dirty_bottom; row++) {
+		if(!dirty_rows[row])
+			continue;
+		uint32_t first = row;
+		while(row < dirty_bottom && dirty_rows[row])
+			dirty_rows[row++] = 0;
+		if(!vga_headless) {
+			SDL_Rect rect = { 0, (int)first, WINDOW_WIDTH, (int)(row - first) };
+			SDL_UpdateTexture(texture, &rect, &renderbuffer[first * VGA_PITCH], VGA_PITCH);
+		}
+	}
+	dirty_top    = WINDOW_HEIGHT;
+	dirty_bottom = 0;
+
+	if(vga_headless) {
+		frame_hash = vga_frame_hash();
+		if(vga_verbose)
+			printf("\n> VGA: Frame %u hash %016llx\n", frame_count, (unsigned long long)frame_hash);
+		return 1;
+	}
 	SDL_RenderClear(renderer);
 	SDL_RenderCopy(renderer, texture, NULL, NULL);
 	SDL_RenderPresent(renderer);
+	return 1;
 }
 
-void vga_poll() {
+/* Runs a frame: refreshes the screen (if there is one), and dumps every dump_every frames */
+static void vga_frame(void) {
 	SDL_Event evt;
-	vga_device_running = 1;
-	while(vga_device_running) {
-		if(internal_wr) {
-			vga_local_write(internal_local_ioaddr, internal_data, internal_access_width);
-			internal_wr = 0;
-		}
-		if(internal_rd) {
-			external_rd = vga_local_read(internal_local_ioaddr, internal_access_width);
-			internal_rd = 0;
-		}
-		vga_render();
+	vga_render();
+	if(!vga_headless)
 		while(SDL_PollEvent(&evt) != 0)
 			if(evt.type == SDL_QUIT)
-				vga_device_running = 0;
+				__atomic_store_n(&vga_device_running, 0, __ATOMIC_RELEASE);
+
+	if(dump_every && frame_count % dump_every == 0) {
+		char path[256];
+		snprintf(path, sizeof(path), dump_file, frame_count);
+		vga_write_ppm(path);
+	}
+	frame_count++;
+}
+
+/* Runs the headless frames on the simulator's thread, every VGA_FRAME_CYCLES cycles */
+static void vga_frame_expire(void * arg, uint64_t now) {
+	frame_event = -1;
+	vga_frame();
+	vga_frame_arm(now + VGA_FRAME_CYCLES); /* From the cycle it was due, so that a late dispatch does not drift */
+}
+
+static void vga_frame_arm(uint64_t when) {
+	sched_cancel(frame_event);
+	frame_deadline = when;
+	frame_event    = sched_add(when, vga_frame_expire, 0);
+}
+
+/* Executes the simulator's accesses as they come, and refreshes the screen VGA_REFRESH_RATE times per second */
+void vga_poll() {
+	uint64_t frame_ticks = SDL_GetPerformanceFrequency() / VGA_REFRESH_RATE;
+	uint64_t next_frame  = SDL_GetPerformanceCounter();
+	while(__atomic_load_n(&vga_device_running, __ATOMIC_ACQUIRE)) {
+		uint32_t executed = mmio_drain(&vga_ring, vga_local_write, vga_local_read);
+
+		uint64_t now = SDL_GetPerformanceCounter();
+		if(now >= next_frame) {
+			vga_frame();
+			next_frame += frame_ticks;
+			if(next_frame < now)
+				next_frame = now + frame_ticks; /* Fell behind, so skip the missed frames */
+		} else if(!executed) {
+			SDL_Delay(1); /* Idle until the next access or frame */
+		}
+	}
+}
+
+/* Blanks the screen. Without the VGA thread, the framebuffer still starts out like this */
+static void vga_clear(void) {
+	for(uint32_t i = 0; i < LINEAR_FRAMEBUFFER_SIZE; i += 4)
+		*(uint32_t*)&renderbuffer[i] = VGA_ARGB(0, 0, 0);
+	vga_mark_dirty(0, WINDOW_HEIGHT - 1);
+}
+
+/* Picks the backend and the frame dumps from the environment. The front-ends call this before they initialize SDL */
+void vga_configure(void) {
+	const char * env = getenv(VGA_ENV_HEADLESS);
+	if(env && *env)
+		vga_headless = atoi(env) != 0;
+	env = getenv(VGA_ENV_VERBOSE);
+	vga_verbose = env && *env && atoi(env) != 0;
+	env = getenv(VGA_ENV_DUMP_EVERY);
+	dump_every = env ? strtoul(env, 0, 0) : 0;
+	env = getenv(VGA_ENV_DUMP_FILE);
+	dump_file[0] = 0;
+	strncat(dump_file, env && *env ? env : VGA_DEFAULT_DUMP_FILE, sizeof(dump_file) - 1);
+	vga_clear();
+}
+
+/* Runs on the simulator's thread before the VGA thread is created, so that no access slips past the ring while it starts */
+void vga_start(uint32_t devid) {
+	vga_device_id = devid;
+	vga_clear();
+	__atomic_store_n(&vga_device_running, 1, __ATOMIC_RELEASE);
+	if(vga_headless) {
+		/* The ring stays closed, so the simulator's thread owns the framebuffer: */
+		frame_count = 0;
+		vga_frame_arm(sched_now + VGA_FRAME_CYCLES);
+	} else {
+		mmio_open(&vga_ring);
 	}
 }
 
 int vga_init(void * arg) {
+	if(vga_headless) {
+		thrd_exit(0); /* The frames run on the scheduler */
+		return 1;
+	}
+
 	SDL_CreateWindowAndRenderer(WINDOW_WIDTH, WINDOW_HEIGHT, SDL_WINDOW_OPENGL | SDL_WINDOW_BORDERLESS | SDL_WINDOW_RESIZABLE, &window, &renderer);
 	if(window == NULL) {
 		printf("\n> ERROR (SDL): Window could not be created! SDL Error: %s\n", SDL_GetError());
+		mmio_close(&vga_ring);
 		return 0;
 	}
 
-	vga_device_id = (uint32_t)arg;
-
-	mtx_init(&mutex, mtx_plain);
-
 	SDL_SetWindowTitle(window, WINDOW_TITLE);
 	SDL_Surface * icon = SDL_LoadBMP(WINDOW_ICON);
 	SDL_SetWindowIcon(window, icon);
 
-	memset(renderbuffer, 0, LINEAR_FRAMEBUFFER_SIZE);
-
 	SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
 	SDL_RenderClear(renderer);
 	SDL_RenderPresent(renderer);
-	texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, WINDOW_WIDTH, WINDOW_HEIGHT);
+	texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, WINDOW_WIDTH, WINDOW_HEIGHT);
 	vga_poll();
+	mmio_close(&vga_ring);
 
 	/* Clean up everything: */
 	SDL_DestroyTexture(texture);
 	SDL_DestroyRenderer(renderer);
-	mtx_destroy(&mutex);
 	thrd_exit(0);
 	return 1;
 }
 
 void vga_deinit(void) {
-	if(!vga_device_open) return;
-	mtx_lock(&mutex);
-	vga_device_running = 0;
-	mtx_unlock(&mutex);
+	__atomic_store_n(&vga_device_running, 0, __ATOMIC_RELEASE);
+	if(vga_headless) {
+		sched_cancel(frame_event);
+		frame_event = -1;
+		printf("\n> VGA: %u frames, the last one with hash %016llx\n", frame_count, (unsigned long long)frame_hash);
+	}
 }
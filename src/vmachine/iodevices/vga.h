@@ -9,17 +9,44 @@
 #define SRC_VMACHINE_IODEVICES_VGA_H_
 
 #include <stdint.h>
+#include "../snapshot.h"
 
 #define WINDOW_TITLE  "FISC VGA Screen"
 #define WINDOW_ICON   "res/fisc_logo.bmp"
 #define WINDOW_WIDTH  800
 #define WINDOW_HEIGHT 600
 
+#define VGA_REFRESH_RATE 60 /* Frames per second */
+
+/* Headless mode keeps the framebuffer in memory only (no window, and SDL's video is not even initialized). It has no thread:
+ * the simulator's thread accesses the framebuffer, and runs a frame every VGA_FRAME_CYCLES simulated cycles (see
+ * scheduler.h), so the frames are the same on every run and every host. Either mode can dump frames into binary PPMs every
+ * so many frames. Headless mode prints the hash of the last frame when it stops, and of every frame which changed if asked */
+#define VGA_ENV_HEADLESS      "FISC_VGA_HEADLESS"  /* Non zero: headless */
+#define VGA_ENV_VERBOSE       "FISC_VGA_VERBOSE"   /* Non zero: print the hash of every frame which changed (headless) */
+#define VGA_ENV_DUMP_EVERY    "FISC_VGA_DUMP"      /* Dump every this many frames (default 0: never) */
+#define VGA_ENV_DUMP_FILE     "FISC_VGA_DUMP_FILE" /* Path of the dumps, formatted with the frame number */
+
+#define VGA_FRAME_CYCLES      (50000000 / VGA_REFRESH_RATE) /* Simulated cycles per headless frame (the core runs at 50 MHz) */
+#define VGA_DEFAULT_DUMP_FILE "bin/vga_%06u.ppm"
+
 #define LINEAR_FRAMEBUFFER_SIZE WINDOW_WIDTH * WINDOW_HEIGHT * 4
+#define VGA_PITCH               (WINDOW_WIDTH * 4) /* Bytes per row of the framebuffer */
+
+/* The framebuffer holds the pixels as the texture does (ARGB8888, opaque) */
+#define VGA_ARGB(r, g, b) (0xFF000000 | ((uint32_t)((r) & 0xFF) << 16) | ((uint32_t)((g) & 0xFF) << 8) | (uint32_t)((b) & 0xFF))
+
+extern char vga_headless;
 
+void vga_configure(void);
+void vga_start(uint32_t devid);
 int vga_init(void * arg);
 void vga_deinit(void);
 char vga_write(uint32_t local_ioaddr, uint64_t data, uint8_t access_width);
 uint64_t vga_read(uint32_t local_ioaddr, uint8_t access_width);
+char vga_save(snapshot_stream_t * s);
+char vga_restore(snapshot_stream_t * s);
+char vga_dump(const char * path);
+uint64_t vga_frame_hash(void);
 
 #endif /* SRC_VMACHINE_IODEVICES_VGA_H_ */
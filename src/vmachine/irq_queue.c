@@ -0,0 +1,90 @@
+/*
+ * irq_queue.c
+ *
+ *  Created on: 18/01/2017
+ *      Author: Miguel
+ */
+#include <stdio.h>
+#include <inttypes.h>
+#include "irq_queue.h"
+
+uint32_t irq_pending[INT_SIRQ + 1];         /* Set of pending devices, per type */
+static uint32_t irq_masked = 0;             /* Devices whose requests are dropped */
+static uint8_t  irq_priority[IRQ_MAX_SOURCES]; /* Higher goes first. Ties go to the lower device id */
+
+static uint64_t irq_posted    = 0;
+static uint64_t irq_coalesced = 0;
+static uint64_t irq_dropped   = 0;
+static uint64_t irq_delivered = 0;
+
+/* Called by any thread. Returns 0 if the request was dropped */
+char irq_post(uint8_t devid, enum INTERRUPT_TYPE type) {
+	__atomic_add_fetch(&irq_posted, 1, __ATOMIC_RELAXED);
+	if(devid >= IRQ_MAX_SOURCES || type > INT_SIRQ || (__atomic_load_n(&irq_masked, __ATOMIC_RELAXED) >> devid) & 1) {
+		__atomic_add_fetch(&irq_dropped, 1, __ATOMIC_RELAXED);
+		return 0;
+	}
+	if(__atomic_fetch_or(&irq_pending[type], 1u << devid, __ATOMIC_RELEASE) & (1u << devid))
+		__atomic_add_fetch(&irq_coalesced, 1, __ATOMIC_RELAXED);
+	return 1;
+}
+
+/* Called by the simulator's thread. Finds the most urgent request among the types which the CPU has enabled, and leaves it pending */
+char irq_peek(uint8_t types, uint8_t * devid, enum INTERRUPT_TYPE * type) {
+	for(int t = INT_ERR; t <= INT_SIRQ; t++) {
+		if(!(types & IRQ_TYPE_BIT(t)))
+			continue;
+		uint32_t pending = __atomic_load_n(&irq_pending[t], __ATOMIC_ACQUIRE);
+		if(!pending)
+			continue;
+
+		int best = -1;
+		for(int dev = 0; pending; dev++, pending >>= 1)
+			if((pending & 1) && (best < 0 || irq_priority[dev] > irq_priority[best]))
+				best = dev;
+		*devid = best;
+		*type  = t;
+		return 1;
+	}
+	return 0;
+}
+
+/* Called by the simulator's thread once the CPU has taken the request. A request which is posted from now on is a new one */
+void irq_take(uint8_t devid, enum INTERRUPT_TYPE type) {
+	/* Only this thread clears bits, so the request is still there: */
+	__atomic_fetch_and(&irq_pending[type], ~(1u << devid), __ATOMIC_ACQ_REL);
+	irq_delivered++;
+}
+
+/* Takes out the most urgent request right away (for a CPU which takes it on the spot) */
+char irq_pop(uint8_t types, uint8_t * devid, enum INTERRUPT_TYPE * type) {
+	if(!irq_peek(types, devid, type))
+		return 0;
+	irq_take(*devid, *type);
+	return 1;
+}
+
+/* Forgets every pending request (they belong to the devices of another run, when restoring a snapshot) */
+void irq_clear(void) {
+	for(int t = INT_ERR; t <= INT_SIRQ; t++)
+		__atomic_store_n(&irq_pending[t], 0, __ATOMIC_RELEASE);
+}
+
+void irq_set_priority(uint8_t devid, uint8_t priority) {
+	if(devid < IRQ_MAX_SOURCES)
+		irq_priority[devid] = priority;
+}
+
+void irq_set_masked(uint8_t devid, char masked) {
+	if(devid >= IRQ_MAX_SOURCES)
+		return;
+	if(masked)
+		__atomic_fetch_or(&irq_masked, 1u << devid, __ATOMIC_RELAXED);
+	else
+		__atomic_fetch_and(&irq_masked, ~(1u << devid), __ATOMIC_RELAXED);
+}
+
+void irq_print_stats(void) {
+	printf("\n> IRQ: %" PRIu64 " posted, %" PRIu64 " delivered, %" PRIu64 " coalesced, %" PRIu64 " dropped",
+		irq_posted, irq_delivered, irq_coalesced, irq_dropped);
+}
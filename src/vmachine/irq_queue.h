@@ -0,0 +1,46 @@
+/*
+ * irq_queue.h
+ *
+ *  Created on: 18/01/2017
+ *      Author: Miguel
+ */
+
+#ifndef SRC_VMACHINE_IRQ_QUEUE_H_
+#define SRC_VMACHINE_IRQ_QUEUE_H_
+
+#include <stdint.h>
+#include "io_controller.h"
+
+/* Interrupt requests between the devices and the CPU. Any thread posts a request with irq_post and never waits: a request
+ * only sets its device's bit in the pending set of its type, so it is lock-free, and a request which is posted while the
+ * same one is still pending is coalesced into it. The simulator's thread takes the requests out with irq_pop (or irq_peek,
+ * and irq_take once the CPU has accepted it), exceptions first and then by the priority of the devices. Requests stay pending while the CPU has their type disabled, and the
+ * requests of a masked device are dropped */
+
+#define IRQ_MAX_SOURCES 32 /* Device ids which can interrupt (one bit each) */
+
+/* The priority of a device comes from its entry in the device table (iodev_t.irq_priority). The masked devices come from
+ * the environment, as a bitmask of device ids (such as 0x2 to silence the device 1) */
+#define IRQ_ENV_MASK "FISC_IRQ_MASK"
+
+#define IRQ_TYPE_BIT(type) (1 << (type))
+#define IRQ_TYPES_ALL      (IRQ_TYPE_BIT(INT_ERR) | IRQ_TYPE_BIT(INT_IRQ) | IRQ_TYPE_BIT(INT_SIRQ))
+
+extern uint32_t irq_pending[INT_SIRQ + 1];
+
+char irq_post(uint8_t devid, enum INTERRUPT_TYPE type);
+char irq_peek(uint8_t types, uint8_t * devid, enum INTERRUPT_TYPE * type);
+void irq_take(uint8_t devid, enum INTERRUPT_TYPE type);
+char irq_pop(uint8_t types, uint8_t * devid, enum INTERRUPT_TYPE * type);
+void irq_clear(void);
+void irq_set_priority(uint8_t devid, uint8_t priority);
+void irq_set_masked(uint8_t devid, char masked);
+void irq_print_stats(void);
+
+static inline char irq_any_pending(void) {
+	return (__atomic_load_n(&irq_pending[INT_ERR],  __ATOMIC_RELAXED)
+	      | __atomic_load_n(&irq_pending[INT_IRQ],  __ATOMIC_RELAXED)
+	      | __atomic_load_n(&irq_pending[INT_SIRQ], __ATOMIC_RELAXED)) != 0;
+}
+
+#endif /* SRC_VMACHINE_IRQ_QUEUE_H_ */
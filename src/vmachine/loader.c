@@ -0,0 +1,367 @@
+/*
+ * loader.c
+ *
+ *  Created on: 11/01/2017
+ *      Author: Miguel
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "loader.h"
+#include "address_space.h"
+#include "bus.h"
+#include "defines.h"
+
+#if !(IS_WINDOWS)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+uint64_t loader_entry     = 0;
+char     loader_has_entry = 0;
+
+static const char * format_names[] = { "raw", "ascii bits", "intel hex", "elf" };
+
+/*********************************/
+/* Mapping the image file:       */
+/*********************************/
+typedef struct {
+	const uint8_t * data;
+	size_t          size;
+	char            mapped; /* The data is a mapping of the file (instead of a heap copy) */
+} image_file_t;
+
+static char image_open(const char * path, image_file_t * f) {
+	memset(f, 0, sizeof(image_file_t));
+#if IS_WINDOWS
+	FILE * fptr = fopen(path, "rb");
+	if(!fptr)
+		return 0;
+	fseek(fptr, 0, SEEK_END);
+	long size = ftell(fptr);
+	fseek(fptr, 0, SEEK_SET);
+	uint8_t * data = malloc(size > 0 ? size : 1);
+	if(!data || (size > 0 && fread(data, 1, size, fptr) != (size_t)size)) {
+		free(data);
+		fclose(fptr);
+		return 0;
+	}
+	fclose(fptr);
+	f->data = data;
+	f->size = size;
+#else
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+	if(fd < 0 || fstat(fd, &st) < 0) {
+		if(fd >= 0) close(fd);
+		return 0;
+	}
+	f->size = st.st_size;
+	if(f->size) {
+		void * data = mmap(0, f->size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(data == MAP_FAILED) {
+			close(fd);
+			return 0;
+		}
+		f->data   = data;
+		f->mapped = 1;
+	}
+	close(fd);
+#endif
+	return 1;
+}
+
+static void image_close(image_file_t * f) {
+#if !(IS_WINDOWS)
+	if(f->mapped) {
+		munmap((void *)f->data, f->size);
+		return;
+	}
+#endif
+	free((void *)f->data);
+}
+
+static enum IMAGE_FORMAT image_detect(const image_file_t * f) {
+	const uint8_t * d = f->data;
+	if(f->size >= 4 && d[0] == 0x7F && d[1] == 'E' && d[2] == 'L' && d[3] == 'F')
+		return IMAGE_ELF;
+	if(f->size >= 11 && d[0] == ':')
+		return IMAGE_IHEX;
+	if(f->size >= 9) {
+		int i;
+		for(i = 0; i < 8 && (d[i] == '0' || d[i] == '1'); i++);
+		if(i == 8 && (d[8] == '\n' || d[8] == '\r'))
+			return IMAGE_ASCII_BITS;
+	}
+	return IMAGE_RAW;
+}
+
+/*********************************/
+/* Loaders of each format:       */
+/*********************************/
+/* Each loader returns how many bytes it wrote into the Main Memory, or -1 if it failed */
+static int64_t load_raw(const image_file_t * f, uint64_t load_address, uint32_t * segments) {
+	*segments = 1;
+	return bus_write_block(load_address, f->data, f->size) ? (int64_t)f->size : -1;
+}
+
+static int64_t load_ascii_bits(const image_file_t * f, uint64_t load_address, uint32_t * segments) {
+	uint8_t * bytes = malloc(f->size / 2 + 1); /* Every byte takes at least a digit and a newline */
+	if(!bytes)
+		return -1;
+
+	uint32_t count  = 0;
+	uint32_t line   = 1;
+	uint8_t  byte   = 0;
+	uint32_t digits = 0;
+	for(size_t i = 0; i <= f->size; i++) {
+		uint8_t c = i < f->size ? f->data[i] : '\n';
+		if(c == '0' || c == '1') {
+			byte = (byte << 1) | (c - '0');
+			digits++;
+		} else if(c == '\n') {
+			if(digits && digits != 8) {
+				printf("> ERROR: The line %u of the ASCII bits image has %u digits instead of 8\n", line, digits);
+				free(bytes);
+				return -1;
+			}
+			if(digits)
+				bytes[count++] = byte;
+			byte   = 0;
+			digits = 0;
+			line++;
+		}
+	}
+
+	*segments = 1;
+	int64_t ret = bus_write_block(load_address, bytes, count) ? count : -1;
+	free(bytes);
+	return ret;
+}
+
+static int hex_nibble(uint8_t c) {
+	if(c >= '0' && c <= '9') return c - '0';
+	if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+	if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+	return -1;
+}
+
+static int hex_byte(const uint8_t * p) {
+	int hi = hex_nibble(p[0]), lo = hex_nibble(p[1]);
+	return (hi < 0 || lo < 0) ? -1 : (hi << 4) | lo;
+}
+
+/* Intel HEX records which land right after each other are gathered into runs, so that they're copied as one block */
+static int64_t load_ihex(const image_file_t * f, uint64_t load_address, uint32_t * segments) {
+	static uint8_t run[0x10000];
+	uint64_t run_start = 0;
+	uint32_t run_len = 0;
+	int64_t  written = 0;
+	uint32_t base = 0;
+	uint32_t line = 0;
+	size_t   i = 0;
+
+	*segments = 0;
+	while(i < f->size) {
+		/* Find the next record: */
+		if(f->data[i] != ':') {
+			if(f->data[i++] == '\n') line++;
+			continue;
+		}
+		line++;
+
+		uint8_t rec[5 + 255];
+		int     len = -1;
+		uint8_t sum = 0;
+		const uint8_t * p = f->data + i + 1;
+		size_t avail = (f->size - i - 1) / 2;
+		for(int n = 0; n < 5 + (len < 0 ? 0 : len); n++) {
+			int b = (size_t)n < avail ? hex_byte(p + n * 2) : -1;
+			if(b < 0) {
+				printf("> ERROR: Malformed Intel HEX record on line %u\n", line);
+				return -1;
+			}
+			rec[n] = b;
+			sum += b;
+			if(n == 0)
+				len = b;
+		}
+		if(sum) {
+			printf("> ERROR: Bad checksum on the Intel HEX record of line %u\n", line);
+			return -1;
+		}
+		i += 1 + (5 + len) * 2;
+
+		uint32_t offset = (rec[1] << 8) | rec[2];
+		switch(rec[3]) {
+			case 0x00: { /* Data */
+				uint64_t address = load_address + base + offset;
+				if(run_len && (address != run_start + run_len || run_len + len > sizeof(run))) {
+					if(!bus_write_block(run_start, run, run_len))
+						return -1;
+					written += run_len;
+					run_len  = 0;
+				}
+				if(!run_len) {
+					run_start = address;
+					(*segments)++;
+				}
+				memcpy(run + run_len, rec + 4, len);
+				run_len += len;
+				break;
+			}
+			case 0x01: /* End of file */
+				i = f->size;
+				break;
+			case 0x02: /* Extended segment address */
+				base = ((rec[4] << 8) | rec[5]) << 4;
+				break;
+			case 0x03: /* Start segment address (CS:IP) */
+				loader_entry     = (((rec[4] << 8) | rec[5]) << 4) + ((rec[6] << 8) | rec[7]);
+				loader_has_entry = 1;
+				break;
+			case 0x04: /* Extended linear address */
+				base = ((rec[4] << 8) | rec[5]) << 16;
+				break;
+			case 0x05: /* Start linear address */
+				loader_entry     = ((uint32_t)rec[4] << 24) | (rec[5] << 16) | (rec[6] << 8) | rec[7];
+				loader_has_entry = 1;
+				break;
+			default:
+				printf("> WARNING: Ignoring the Intel HEX record of type %02x on line %u\n", rec[3], line);
+				break;
+		}
+	}
+	if(run_len && !bus_write_block(run_start, run, run_len))
+		return -1;
+	return written + run_len;
+}
+
+static uint64_t elf_rd(const uint8_t * p, int size, char big_endian) {
+	uint64_t v = 0;
+	for(int i = 0; i < size; i++)
+		v |= (uint64_t)p[big_endian ? i : size - 1 - i] << ((size - 1 - i) * 8);
+	return v;
+}
+
+/* Copies every PT_LOAD segment into its physical address, and clears its .bss (the memory past the file's data) */
+static int64_t load_elf(const image_file_t * f, uint32_t * segments) {
+	const uint8_t * d = f->data;
+	char is64 = f->size > 5 && d[4] == 2;
+	char big  = f->size > 5 && d[5] == 2;
+	size_t ehsize = is64 ? 64 : 52;
+	int64_t written = 0;
+
+	if(f->size < ehsize || (d[4] != 1 && d[4] != 2)) {
+		printf("> ERROR: Truncated or unsupported ELF header\n");
+		return -1;
+	}
+
+	uint64_t entry     = elf_rd(d + 24, is64 ? 8 : 4, big);
+	uint64_t phoff     = elf_rd(d + (is64 ? 32 : 28), is64 ? 8 : 4, big);
+	uint16_t phentsize = elf_rd(d + (is64 ? 54 : 42), 2, big);
+	uint16_t phnum     = elf_rd(d + (is64 ? 56 : 44), 2, big);
+
+	/* Each bound is checked on its own, so that no sum of the (untrusted) header's fields can wrap around: */
+	if(phnum && (phentsize < (is64 ? 56 : 32) || phoff > f->size || (uint64_t)phentsize * phnum > f->size - phoff)) {
+		printf("> ERROR: The program headers of the ELF image are out of bounds\n");
+		return -1;
+	}
+
+	*segments = 0;
+	for(uint16_t n = 0; n < phnum; n++) {
+		const uint8_t * ph = d + phoff + (size_t)n * phentsize;
+		if(elf_rd(ph, 4, big) != 1) /* PT_LOAD */
+			continue;
+
+		uint64_t offset = elf_rd(ph + (is64 ? 8  : 4),  is64 ? 8 : 4, big);
+		uint64_t paddr  = elf_rd(ph + (is64 ? 24 : 12), is64 ? 8 : 4, big);
+		uint64_t filesz = elf_rd(ph + (is64 ? 32 : 16), is64 ? 8 : 4, big);
+		uint64_t memsz  = elf_rd(ph + (is64 ? 40 : 20), is64 ? 8 : 4, big);
+
+		if(offset > f->size || filesz > f->size - offset || filesz > memsz || paddr > memory_depth || memory_depth - paddr < memsz) {
+			printf("> ERROR: The segment %d of the ELF image (0x%llx, %llu bytes) does not fit\n",
+				n, (unsigned long long)paddr, (unsigned long long)memsz);
+			return -1;
+		}
+		if(!bus_write_block(paddr, d + offset, filesz) || !bus_write_block(paddr + filesz, 0, memsz - filesz))
+			return -1;
+		written += memsz; /* The .bss counts, since it gets cleared */
+		(*segments)++;
+	}
+
+	loader_entry     = entry;
+	loader_has_entry = 1;
+	return written;
+}
+
+/*********************************/
+/* Loader's interface:           */
+/*********************************/
+char load_image(const char * path, uint64_t load_address) {
+	image_file_t f;
+	if(!image_open(path, &f)) {
+		printf("ERROR: Couldn't open file '%s'!\n", path);
+		return 0;
+	}
+
+	enum IMAGE_FORMAT format = image_detect(&f);
+	uint32_t segments = 0;
+	int64_t  written  = -1;
+	switch(format) {
+		case IMAGE_RAW:        written = load_raw(&f, load_address, &segments);        break;
+		case IMAGE_ASCII_BITS: written = load_ascii_bits(&f, load_address, &segments); break;
+		case IMAGE_IHEX:       written = load_ihex(&f, load_address, &segments);       break;
+		case IMAGE_ELF:        written = load_elf(&f, &segments);                      break;
+	}
+	image_close(&f);
+
+	if(written < 0)
+		printf("ERROR: Couldn't load '%s' (%s) into the Main Memory\n", path, format_names[format]);
+	else if(format == IMAGE_ELF)
+		printf("Loaded '%s' (%s): %llu bytes, %u segment(s), entry point 0x%llx\n",
+			path, format_names[format], (unsigned long long)written, segments, (unsigned long long)loader_entry);
+	else
+		printf("Loaded '%s' (%s) at 0x%llx: %llu bytes, %u segment(s)\n",
+			path, format_names[format], (unsigned long long)load_address, (unsigned long long)written, segments);
+	return written >= 0;
+}
+
+/* Loads a comma separated list of images, each one given as 'path[@address]' */
+char load_memory(const char * images) {
+	char spec[256];
+	int  count = 0;
+
+	loader_entry     = 0;
+	loader_has_entry = 0;
+
+	while(*images) {
+		size_t len = strcspn(images, ",");
+		if(len) {
+			if(len >= sizeof(spec) || ++count > LOADER_MAX_IMAGES) {
+				printf("ERROR: Too many images, or the image name is too long: '%s'\n", images);
+				return 0;
+			}
+			memcpy(spec, images, len);
+			spec[len] = 0;
+
+			uint64_t load_address = MEMORY_LOADLOC;
+			char * at = strrchr(spec, '@');
+			if(at) {
+				*at = 0;
+				load_address = strtoull(at + 1, 0, 0);
+			}
+
+			printf("Loading image '%s' ...\n", spec);
+			if(!load_image(spec, load_address))
+				return 0;
+		}
+		images += len;
+		if(*images == ',')
+			images++;
+	}
+	return 1;
+}
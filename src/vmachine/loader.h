@@ -0,0 +1,39 @@
+/*
+ * loader.h
+ *
+ *  Created on: 11/01/2017
+ *      Author: Miguel
+ */
+
+#ifndef SRC_VMACHINE_LOADER_H_
+#define SRC_VMACHINE_LOADER_H_
+
+#include <stdint.h>
+
+/* Loads program images into the Main Memory. The format is detected from the contents of the file:
+ *  - ELF (32 or 64 bit, either byte order): every PT_LOAD segment goes into its physical address
+ *  - Intel HEX: the data records go into their (extended) addresses, plus the load address
+ *  - ASCII bits: the legacy output of 'flasm -a', one line of '0's and '1's per byte
+ *  - Raw binary: anything else, copied as it is
+ * The whole file is mapped (or read) at once and copied into the memory in blocks.
+ *
+ * An image is named by 'path[@address]'. The address defaults to MEMORY_LOADLOC and is ignored by ELF images.
+ * Several images can be loaded one after the other by separating them with commas */
+
+#define LOADER_ENV_IMAGES "FISC_IMAGES" /* Overrides the images which the RTL simulation loads (default: BOOTLOADER_FILE) */
+#define LOADER_MAX_IMAGES 16
+
+enum IMAGE_FORMAT {
+	IMAGE_RAW,
+	IMAGE_ASCII_BITS,
+	IMAGE_IHEX,
+	IMAGE_ELF
+};
+
+extern uint64_t loader_entry;     /* Entry point of the last ELF image (0 if none was loaded) */
+extern char     loader_has_entry;
+
+char load_image(const char * path, uint64_t load_address);
+char load_memory(const char * images);
+
+#endif /* SRC_VMACHINE_LOADER_H_ */
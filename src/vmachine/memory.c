@@ -4,323 +4,209 @@
  *  Created on: 14/12/2016
  *      Author: Miguel
  */
-#include <mti.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
 #include <inttypes.h>
 #include "address_space.h"
+#include "bus.h"
+#include "cosim.h"
 #include "defines.h"
 #include "io_controller.h"
-#include "signal_conv.h"
+#include "loader.h"
+#include "memory.h"
+#include "trace.h"
 #include "mmu.h"
-
-typedef struct {
-	mtiSignalIdT clk;
-	mtiSignalIdT en;
-	mtiSignalIdT wr;
-	mtiSignalIdT rd;
-	mtiDriverIdT ready;
-	mtiSignalIdT address1;
-	mtiSignalIdT address2;
-	mtiSignalIdT data_in;
-	mtiDriverIdT data_out1;
-	mtiDriverIdT data_out2;
-	mtiSignalIdT access_width;
-	mtiSignalIdT alignment_flag;
-} memory_t;
-
-memory_t * mem_ip;
-
-uint8_t memory_contents[MEMORY_DEPTH]; /* The actual Main Memory */
-
-char read_memory_ret[MAX_INTEGER_SIZE+1];
-
-char write_memory(uint32_t address, uint64_t data, uint8_t access_width) {
-	if(address >= MEMORY_DEPTH) return 0;
-	switch(access_width) {
-		case SZ_8:
-			memory_contents[address]            = (uint8_t)data;
-			break;
-		case SZ_16:
-			memory_contents[address]   = (uint8_t)((data & 0xFF00) >> 8);
-			memory_contents[address+1] = (uint8_t)  data & 0xFF;
-			break;
-		case SZ_32:
-			memory_contents[address]   = (uint8_t)((data & 0xFF000000) >> 24);
-			memory_contents[address+1] = (uint8_t)((data & 0xFF0000)   >> 16);
-			memory_contents[address+2] = (uint8_t)((data & 0xFF00)     >> 8);
-			memory_contents[address+3] = (uint8_t)  data & 0xFF;
-			break;
-		case SZ_64:
-			memory_contents[address]   = (uint8_t)((data & 0xFF00000000000000) >> 56);
-			memory_contents[address+1] = (uint8_t)((data & 0xFF000000000000)   >> 48);
-			memory_contents[address+2] = (uint8_t)((data & 0xFF0000000000)     >> 40);
-			memory_contents[address+3] = (uint8_t)((data & 0xFF00000000)       >> 32);
-			memory_contents[address+4] = (uint8_t)((data & 0xFF000000)         >> 24);
-			memory_contents[address+5] = (uint8_t)((data & 0xFF0000)           >> 16);
-			memory_contents[address+6] = (uint8_t)((data & 0xFF00)             >> 8);
-			memory_contents[address+7] = (uint8_t)  data & 0xFF;
-			break;
-		default: return 0;
-	}
-	return 1;
+#include "irq_queue.h"
+#include "runctl.h"
+#include "scheduler.h"
+#include "snapshot.h"
+
+/* Buffers which hold the encoded std_logic data that is driven into the data out ports */
+char data_out1_sigv[MAX_INTEGER_SIZE];
+char data_out2_sigv[MAX_INTEGER_SIZE];
+char ready_sigv[2];
+
+void vm_cleanup(void) {
+	printf("\n> Closing up the %s interface", SIM_NAME);
+	mmu_print_stats();
+	irq_print_stats();
+#if ENABLE_COSIM == 1
+	cosim_print_stats();
+#endif
+	io_controller_deinit();
+	trace_close();
+	fflush(stdout);
+	SDL_Quit();
 }
 
-char * read_memory(uint32_t address, uint8_t access_width) {
-	/* Zero out the whole memory data out buffer */
-	for(int i = 0; i < MAX_INTEGER_SIZE; i++)
-		read_memory_ret[i] = 2; /* this is a 0 when it's a std_logic variable */
-	read_memory_ret[MAX_INTEGER_SIZE] = '\0'; /* End of the Buffer */
-
-	switch(access_width) {
-		case SZ_8:  if(address   >= MEMORY_DEPTH) return read_memory_ret; break;
-		case SZ_16: if(address+1 >= MEMORY_DEPTH) return read_memory_ret; break;
-		case SZ_32: if(address+3 >= MEMORY_DEPTH) return read_memory_ret; break;
-		case SZ_64: if(address+7 >= MEMORY_DEPTH) return read_memory_ret; break;
-		default: return read_memory_ret;
-	}
-
-	/* Fill the buffer: */
-	switch(access_width) {
-		case SZ_8: {
-			char * val = int_to_sigv(memory_contents[address], 8);
-			memcpy(read_memory_ret + (7*8), val, 8);
-			break;
-		}
-		case SZ_16: {
-			char * val = int_to_sigv(memory_contents[address+1], 8);
-			memcpy(read_memory_ret + (7*8), val, 8);
-			val = int_to_sigv(memory_contents[address], 8);
-			memcpy(read_memory_ret + (6*8), val, 8);
-			break;
-		}
-		case SZ_32: {
-			char * val = int_to_sigv(memory_contents[address+3], 8);
-			memcpy(read_memory_ret + (7*8), val, 8);
-			val = int_to_sigv(memory_contents[address+2], 8);
-			memcpy(read_memory_ret + (6*8), val, 8);
-			val = int_to_sigv(memory_contents[address+1], 8);
-			memcpy(read_memory_ret + (5*8), val, 8);
-			val = int_to_sigv(memory_contents[address], 8);
-			memcpy(read_memory_ret + (4*8), val, 8);
-			break;
-		}
-		case SZ_64: {
-			char * val = int_to_sigv(memory_contents[address+7], 8);
-			memcpy(read_memory_ret + (7*8), val, 8);
-			val = int_to_sigv(memory_contents[address+6], 8);
-			memcpy(read_memory_ret + (6*8), val, 8);
-			val = int_to_sigv(memory_contents[address+5], 8);
-			memcpy(read_memory_ret + (5*8), val, 8);
-			val = int_to_sigv(memory_contents[address+4], 8);
-			memcpy(read_memory_ret + (4*8), val, 8);
-			val = int_to_sigv(memory_contents[address+3], 8);
-			memcpy(read_memory_ret + (3*8), val, 8);
-			val = int_to_sigv(memory_contents[address+2], 8);
-			memcpy(read_memory_ret + (2*8), val, 8);
-			val = int_to_sigv(memory_contents[address+1], 8);
-			memcpy(read_memory_ret + (1*8), val, 8);
-			val = int_to_sigv(memory_contents[address], 8);
-			memcpy(read_memory_ret + (0*8), val, 8);
-			break;
+/* Stops the simulation, or breaks so that the do script takes a checkpoint (see runctl.h) */
+static char run_control(void) {
+	switch(runctl_tick()) {
+		case RUN_STOP:
+			runctl_print_stop();
+			if(runctl.break_on_stop && SIM_CAN_BREAK) {
+				runctl_stop_reason = STOP_NONE;
+				runctl_halt_repeat = 0;
+				sim_break();
+				return 1;
+			}
+			vm_cleanup();
+			sim_quit();
+			return 0;
+		case RUN_CHECKPOINT: {
+			char path[256];
+			runctl_checkpoint_path(path, sizeof(path));
+			if(!sim_checkpoint(path)) {
+				printf("\n> ERROR: %s can not take checkpoints. The checkpoint_interval is ignored\n", SIM_NAME);
+				runctl.checkpoint_interval = 0;
+			}
+			return 1;
 		}
-		default: break;
+		default:
+			return 1;
 	}
-
-	return read_memory_ret;
 }
 
-char load_memory(void) {
-	printf("Loading Bootloader '%s' ...\n", BOOTLOADER_FILE);
+uint64_t clock_ctr = 0; /* Clock edges since the simulation started */
 
-	FILE * fptr = fopen(BOOTLOADER_FILE, "rb");
-	if(fptr == 0) {
-		printf("ERROR: Couldn't open file '%s'!\n", BOOTLOADER_FILE);
-		return 0;
-	}
-
-	char buffer[10] = {0};
-	uint32_t address = 0;
-	while(fgets((char*)buffer, sizeof(buffer), fptr))
-		write_memory(address++, (uint8_t)strtoul(buffer, 0, 2), SZ_8);
-	fclose(fptr);
-	printf("Size of bootloader: %d bytes\n", ALIGN32(address));
-	return 1;
-}
+/* Runs on every edge of the clock */
+void memory_on_clock(memory_t * mem_ip) {
+	trace_now = ++clock_ctr;
 
-enum ADDR_SPACE_T address_decode(uint32_t address) {
-	if(address >= IOSPACE && address < IOSPACE + (uint32_t)(IOSPACE_LEN)) return SPACE_IO;
-	return SPACE_MMEM;
-}
-
-uint64_t address_align(uint32_t address, uint8_t access_width, uint8_t alignment_enabled) {
-	if(!alignment_enabled) return address;
-	switch(access_width) {
-		case SZ_8:  return address;
-		case SZ_16: return ALIGN16(address);
-		case SZ_32: return ALIGN32(address);
-		case SZ_64: return ALIGN64(address);
-		default:    return address;
-	}
-}
-
-void fli_cleanup(void) {
-	printf("\n> Closing up FLI C interface");
-	io_controller_deinit();
-	fflush(stdout);
-	SDL_Quit();
-}
-
-void on_clock(void * param) {
-	static uint64_t clock_ctr = 0;
-	if(clock_ctr++ >= MODELSIM_EXECUTION_TIME) {
-		fli_cleanup();
-		mti_Quit();
-		return;
-	}
-
-	memory_t * mem_ip = (memory_t *) param;
-	_Bool clk = sig_to_int(mem_ip->clk);
-	int en = sigv_to_int(mem_ip->en);
+	_Bool clk = sim_bit(mem_ip->clk);
+	int en = sim_vec(mem_ip->en);
 
 	if(clk) {
-		printf("\n> + ");
+		if(!run_control())
+			return;
+		sched_run(clock_ctr >> 1); /* The devices' events, in clock cycles */
 
 		if(en > 0) {
-			printf("Accessing Memory | ", en);
-
 			/******************************************************************/
 			/* Handle Memory Reads for Channel 1 (used by the fetch stage 1): */
 			/******************************************************************/
-			char * rd = sigv_to_str(mem_ip->rd, 0);
-			if(rd[1] > 0) {
-				uint32_t vaddress = sigv_to_int(mem_ip->address1);
-				uint32_t address = address_translate(vaddress); /* The PC is already 32 bit aligned */
-				char * returned_data;
-				char cpy[65];
+			uint8_t rd = sim_vec(mem_ip->rd);
+			if(rd & 0x1) {
+				uint32_t vaddress = sim_vec(mem_ip->address1);
+				uint64_t address = address_translate(vaddress); /* The PC is already 32 bit aligned */
+				if(mmu_enabled) trace(TRACE_MMU, TR_XLATE, 0, vaddress, address, SZ_32, 0);
+				uint64_t returned_data = 0;
 				enum ADDR_SPACE_T target = address_decode(address);
 
 				if(target == SPACE_MMEM) {
 					returned_data = read_memory(address, SZ_32);
-					strcpy(cpy, returned_data);
-					for(int i = 0; i < MAX_INTEGER_SIZE; i++) cpy[i] = (cpy[i] + '0') - 2;
-					uint64_t to_int = strtoull(cpy, 0, 2);
-
-					printf("RD CH1 (v@0x%x p@0x%x <2>) = 0x%" PRIx64 " ", vaddress, address, to_int);
+					trace(TRACE_MEM, TR_RD_CH1, 0, vaddress, address, SZ_32, returned_data);
 				} else if(target == SPACE_IO) {
-					returned_data = io_rd_dispatch(address, SZ_32);
-					strcpy(cpy, returned_data);
-					for(int i = 0; i < MAX_INTEGER_SIZE; i++) cpy[i] = (cpy[i] + '0') - 2;
-					uint64_t to_int = strtoull(cpy, 0, 2);
-
-					printf("IO RD CH1 (v@0x%x p@0x%x <2>) = 0x%" PRIx64 " ", vaddress, address, to_int);
+					returned_data = io_rd_dispatch((uint32_t)address, SZ_32);
+					trace(TRACE_IO, TR_RD_CH1, 0, vaddress, address, SZ_32, returned_data);
 				}
+				runctl_fetch(vaddress, (uint32_t)returned_data);
 
-				mti_ScheduleDriver(mem_ip->data_out1, (long)returned_data, 1, MTI_INERTIAL);
+				sim_drive_vec(mem_ip->data_out1, returned_data, MAX_INTEGER_SIZE, data_out1_sigv, 1);
 			}
 
 			/*************************/
 			/* Handle Memory Writes: */
 			/*************************/
-			int wr = sig_to_int(mem_ip->wr);
+			int wr = sim_bit(mem_ip->wr);
 			if(wr > 0) {
-				uint8_t  access_width = sigv_to_int(mem_ip->access_width);
-				uint8_t  ae_flag = sig_to_int(mem_ip->alignment_flag);
-				uint32_t vaddress = address_align(sigv_to_int(mem_ip->address2), access_width, ae_flag);
-				uint32_t address = address_translate(vaddress);
-				uint64_t data = sigv_to_int(mem_ip->data_in);
+				uint8_t  access_width = sim_vec(mem_ip->access_width);
+				uint8_t  ae_flag = sim_bit(mem_ip->alignment_flag);
+				uint32_t vaddress = address_align(sim_vec(mem_ip->address2), access_width, ae_flag);
+				uint64_t address = address_translate(vaddress);
+				if(mmu_enabled) trace(TRACE_MMU, TR_XLATE, 0, vaddress, address, access_width, 0);
+				uint64_t data = sim_vec(mem_ip->data_in);
 				enum ADDR_SPACE_T target = address_decode(address);
 				char success = 0;
 
-				if(target == SPACE_MMEM) {
-					printf("WR (ae: %d v@0x%x p@0x%x <%d>) = 0x%" PRIx64 " ", ae_flag, vaddress, address, access_width, data);
+				if(target == SPACE_MMEM)
 					success = write_memory(address, data, access_width);
-				} else if(target == SPACE_IO) {
-					printf("IO WR (ae: %d v@0x%x p@0x%x <%d>) = 0x%" PRIx64 " ", ae_flag, vaddress, address, access_width, data);
-					success = io_wr_dispatch(address, data, access_width);
-				}
+				else if(target == SPACE_IO)
+					success = io_wr_dispatch((uint32_t)address, data, access_width);
+				trace(target == SPACE_IO ? TRACE_IO : TRACE_MEM, TR_WR, (ae_flag ? TRF_ALIGNED : 0) | (success ? 0 : TRF_FAILED),
+					vaddress, address, access_width, data);
 
 				if(!success)
-					printf("ERROR: Could not write to address v@0x%x p@0x%x ", vaddress, address);
+					printf("\n> ERROR: Could not write to address v@0x%x p@0x%" PRIx64 "\n", vaddress, address);
+#if ENABLE_COSIM == 1
+				if(!cosim_rtl_store(address, data, access_width))
+					sim_break();
+#endif
 			}
 
 			/* The Memory has finished the transaction: */
-			mti_ScheduleDriver(mem_ip->ready, (long)int_to_sigv(3,2), 1, MTI_INERTIAL);
+			sim_drive_vec(mem_ip->ready, 3, 2, ready_sigv, 1);
 		}
-
-		printf("\n");
-		fflush(stdout);
 	} else {
 		if(en > 0) {
 			/**************************************************************************/
 			/* Handle Memory Reads for Channel 2 (used by the memory access stage 4): */
 			/**************************************************************************/
-			char * rd = sigv_to_str(mem_ip->rd, 0);
-			if(rd[0] > 0) {
-				printf("\n> - Accessing Memory | ", en);
-				uint8_t  access_width = sigv_to_int(mem_ip->access_width);
-				uint8_t  ae_flag = sig_to_int(mem_ip->alignment_flag);
-				uint32_t vaddress = address_align(sigv_to_int(mem_ip->address2), access_width, ae_flag);
-				uint32_t address = address_translate(vaddress);
-				char * returned_data;
-				char cpy[65];
+			uint8_t rd = sim_vec(mem_ip->rd);
+			if(rd & 0x2) {
+				uint8_t  access_width = sim_vec(mem_ip->access_width);
+				uint8_t  ae_flag = sim_bit(mem_ip->alignment_flag);
+				uint32_t vaddress = address_align(sim_vec(mem_ip->address2), access_width, ae_flag);
+				uint64_t address = address_translate(vaddress);
+				if(mmu_enabled) trace(TRACE_MMU, TR_XLATE, TRF_FALLING_EDGE, vaddress, address, access_width, 0);
+				uint64_t returned_data = 0;
 				enum ADDR_SPACE_T target = address_decode(address);
+				uint8_t flags = TRF_FALLING_EDGE | (ae_flag ? TRF_ALIGNED : 0);
 
 				if(target == SPACE_MMEM) {
 					returned_data = read_memory(address, access_width);
-					strcpy(cpy, returned_data);
-					for(int i = 0; i < MAX_INTEGER_SIZE; i++) cpy[i] = (cpy[i] + '0') - 2;
-					uint64_t to_int = strtoull(cpy, 0, 2);
-
-					printf("RD CH2 (ae: %d v@0x%x p@0x%x <%d>) = 0x%" PRIx64 " ", ae_flag, vaddress, address, access_width, to_int);
+					trace(TRACE_MEM, TR_RD_CH2, flags, vaddress, address, access_width, returned_data);
 				} else if(target == SPACE_IO) {
-					returned_data = io_rd_dispatch(address, access_width);
-					strcpy(cpy, returned_data);
-					for(int i = 0; i < MAX_INTEGER_SIZE; i++) cpy[i] = (cpy[i] + '0') - 2;
-					uint64_t to_int = strtoull(cpy, 0, 2);
-
-					printf("IO RD CH2 (ae: %d v@0x%x p@0x%x <%d>) = 0x%" PRIx64 " ", ae_flag, vaddress, address, access_width, to_int);
+					returned_data = io_rd_dispatch((uint32_t)address, access_width);
+					trace(TRACE_IO, TR_RD_CH2, flags, vaddress, address, access_width, returned_data);
 				}
 
-				mti_ScheduleDriver(mem_ip->data_out2, (long)returned_data, 0,    MTI_INERTIAL);
-				mti_ScheduleDriver(mem_ip->ready,     (long)int_to_sigv(3,2), 1, MTI_INERTIAL);
+#if ENABLE_COSIM == 1
+				if(!cosim_rtl_load(address, returned_data, access_width))
+					sim_break();
+#endif
 
-				printf("\n");
-				fflush(stdout);
+				sim_drive_vec(mem_ip->data_out2, returned_data, MAX_INTEGER_SIZE, data_out2_sigv, 0);
+				sim_drive_vec(mem_ip->ready,     3, 2, ready_sigv, 1);
 			}
 		}
 	}
 }
 
-void memory_init(
-	mtiRegionIdT region,
-	char * param,
-	mtiInterfaceListT * generics,
-	mtiInterfaceListT * ports
-) {
-	load_memory();
+/* Snapshot section of the run control (see snapshot.h) */
+static char runctl_save(snapshot_stream_t * s) {
+	return snapshot_write(s, &clock_ctr,          sizeof(clock_ctr))
+	    && snapshot_write(s, &runctl_cycle,       sizeof(runctl_cycle))
+	    && snapshot_write(s, &runctl_halt_pc,     sizeof(runctl_halt_pc))
+	    && snapshot_write(s, &runctl_halt_repeat, sizeof(runctl_halt_repeat));
+}
+
+static char runctl_restore(snapshot_stream_t * s) {
+	return snapshot_read(s, &clock_ctr,          sizeof(clock_ctr))
+	    && snapshot_read(s, &runctl_cycle,       sizeof(runctl_cycle))
+	    && snapshot_read(s, &runctl_halt_pc,     sizeof(runctl_halt_pc))
+	    && snapshot_read(s, &runctl_halt_repeat, sizeof(runctl_halt_repeat));
+}
 
-	if(SDL_Init(SDL_INIT_EVERYTHING) != 0)
+/* Brings up the virtual machine under the Memory. The backend has already applied the run control of the design */
+void memory_setup(uint64_t depth) {
+	/* The run control can also come from the environment, on top of what the backend gave it: */
+	const char * runctl_env = getenv(RUNCTL_ENV);
+	if(runctl_env && *runctl_env)
+		runctl_parse(runctl_env);
+
+	/* The images which get loaded into the memory can also be overridden. A restored checkpoint already has its contents: */
+	const char * images = getenv(LOADER_ENV_IMAGES);
+	if(bus_init(depth) && !sim_is_restore())
+		load_memory(images && *images ? images : BOOTLOADER_FILE);
+	snapshot_add_section(SNAPSHOT_TAG('R', 'U', 'N', ' '), runctl_save, runctl_restore);
+	trace_init();
+
+	vga_configure();
+	if(SDL_Init(vga_headless ? SDL_INIT_TIMER : SDL_INIT_EVERYTHING) != 0)
 		printf("\n> ERROR: Could not initialize SDL. (%s)\n", SDL_GetError());
 	else
 		io_controller_init();
-
-	mem_ip                 = (memory_t *)mti_Malloc(sizeof(memory_t));
-	mem_ip->clk            = mti_FindPort(ports, "clk");
-	mem_ip->en             = mti_FindPort(ports, "en");
-	mem_ip->wr             = mti_FindPort(ports, "wr");
-	mem_ip->rd             = mti_FindPort(ports, "rd");
-	mem_ip->ready          = mti_CreateDriver(mti_FindPort(ports, "ready"));
-	mem_ip->address1       = mti_FindPort(ports, "address1");
-	mem_ip->address2       = mti_FindPort(ports, "address2");
-	mem_ip->data_in        = mti_FindPort(ports, "data_in");
-	mem_ip->data_out1      = mti_CreateDriver(mti_FindPort(ports, "data_out1"));
-	mem_ip->data_out2      = mti_CreateDriver(mti_FindPort(ports, "data_out2"));
-	mem_ip->access_width   = mti_FindPort(ports, "access_width");
-	mem_ip->alignment_flag = mti_FindPort(ports, "alignment_flag");
-
-	mtiProcessIdT memory_process = mti_CreateProcess("memory_p", on_clock, mem_ip);
-	mti_Sensitize(memory_process, mem_ip->clk, MTI_EVENT);
 }
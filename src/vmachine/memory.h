@@ -0,0 +1,34 @@
+/*
+ * memory.h
+ *
+ *  Created on: 20/01/2017
+ *      Author: Miguel
+ */
+
+#ifndef SRC_VMACHINE_MEMORY_H_
+#define SRC_VMACHINE_MEMORY_H_
+
+#include <stdint.h>
+#include "sim.h"
+
+/* Ports of the Memory entity (rtl/memory.vhd), as the simulator backend sees them: */
+typedef struct {
+	sim_signal_t clk;
+	sim_signal_t en;
+	sim_signal_t wr;
+	sim_signal_t rd;
+	sim_driver_t ready;
+	sim_signal_t address1;
+	sim_signal_t address2;
+	sim_signal_t data_in;
+	sim_driver_t data_out1;
+	sim_driver_t data_out2;
+	sim_signal_t access_width;
+	sim_signal_t alignment_flag;
+} memory_t;
+
+void memory_setup(uint64_t depth);
+void memory_on_clock(memory_t * mem_ip);
+void vm_cleanup(void);
+
+#endif /* SRC_VMACHINE_MEMORY_H_ */
@@ -0,0 +1,246 @@
+/*
+ * memstore.c
+ *
+ *  Created on: 10/01/2017
+ *      Author: Miguel
+ */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* For MAP_ANONYMOUS */
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+#include "memstore.h"
+#include "defines.h"
+
+#if IS_WINDOWS
+#include <windows.h> /* For VirtualAlloc */
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+uint8_t *   memory_contents = 0;
+uint8_t *** memory_pages    = 0;
+uint64_t    memory_depth    = 0;
+
+uint8_t memstore_zero_page[MEMSTORE_PAGE_SIZE];
+
+enum MEM_BACKING memstore_backing = BACKING_ANON;
+char             memstore_image[256];
+uint64_t         memstore_table_count = 0; /* Entries of the sparse backing store's directory */
+
+/* Backing store statistics: */
+uint32_t memstore_pages_allocated = 0;
+
+static const char * backing_names[] = { "anon", "file", "sparse" };
+
+uint8_t * memstore_page_alloc(uint64_t page) {
+	uint8_t ** table = memory_pages[page >> MEMSTORE_LEAF_SHIFT];
+	if(!table && !(table = memory_pages[page >> MEMSTORE_LEAF_SHIFT] = calloc(MEMSTORE_LEAF_SIZE, sizeof(uint8_t *)))) {
+		printf("\n> ERROR: Out of host memory while allocating the page table of the page 0x%" PRIx64 " of the Main Memory\n", page);
+		return 0;
+	}
+
+	uint8_t * p = calloc(1, MEMSTORE_PAGE_SIZE);
+	if(!p) {
+		printf("\n> ERROR: Out of host memory while allocating the page 0x%" PRIx64 " of the Main Memory\n", page);
+		return 0;
+	}
+	memstore_pages_allocated++;
+	return table[page & (MEMSTORE_LEAF_SIZE - 1)] = p;
+}
+
+/* Returns the first page at (or after) 'address' which may hold something other than zeroes, or memory_depth if there's none.
+ * Only the sparse backing store knows which pages were never touched */
+uint64_t memstore_next_page(uint64_t address) {
+	address &= ~(uint64_t)(MEMSTORE_PAGE_SIZE - 1);
+	if(!memory_pages)
+		return address < memory_depth ? address : memory_depth;
+
+	for(uint64_t page = address >> MEMSTORE_PAGE_SHIFT; page << MEMSTORE_PAGE_SHIFT < memory_depth; page++) {
+		if(!memory_pages[page >> MEMSTORE_LEAF_SHIFT]) {
+			page |= MEMSTORE_LEAF_SIZE - 1; /* Skip the whole table */
+			continue;
+		}
+		if(memstore_page(page))
+			return page << MEMSTORE_PAGE_SHIFT;
+	}
+	return memory_depth;
+}
+
+static void free_pages(void) {
+	for(uint64_t i = 0; i < memstore_table_count; i++) {
+		if(!memory_pages[i])
+			continue;
+		for(uint32_t j = 0; j < MEMSTORE_LEAF_SIZE; j++)
+			free(memory_pages[i][j]);
+		free(memory_pages[i]);
+		memory_pages[i] = 0;
+	}
+	memstore_pages_allocated = 0;
+}
+
+#if IS_WINDOWS
+
+/* VirtualAlloc already commits the pages lazily: they only take host memory once they're touched */
+static char map_contiguous(void) {
+	if(memory_depth > SIZE_MAX)
+		return 0;
+	memory_contents = VirtualAlloc(0, (size_t)memory_depth, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	if(!memory_contents)
+		return 0;
+	if(memstore_backing == BACKING_FILE) {
+		/* There's no cheap private file mapping which can grow past the end of the file, so the image is read in */
+		FILE * fptr = fopen(memstore_image, "rb");
+		if(!fptr) {
+			VirtualFree(memory_contents, 0, MEM_RELEASE);
+			memory_contents = 0;
+			return 0;
+		}
+		fread(memory_contents, 1, (size_t)memory_depth, fptr);
+		fclose(fptr);
+	}
+	return 1;
+}
+
+static void unmap_contiguous(void) {
+	VirtualFree(memory_contents, 0, MEM_RELEASE);
+	memory_contents = 0;
+}
+
+#else
+
+static char map_contiguous(void) {
+	if(memory_depth > SIZE_MAX)
+		return 0;
+	memory_contents = mmap(0, (size_t)memory_depth, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if(memory_contents == MAP_FAILED) {
+		memory_contents = 0;
+		return 0;
+	}
+
+	if(memstore_backing == BACKING_FILE) {
+		/* Map the image privately over the start of the memory. Writes go into copies of its pages, never into the file: */
+		int fd = open(memstore_image, O_RDONLY);
+		struct stat st;
+		if(fd < 0 || fstat(fd, &st) < 0) {
+			if(fd >= 0) close(fd);
+			munmap(memory_contents, (size_t)memory_depth);
+			memory_contents = 0;
+			return 0;
+		}
+		size_t len = (size_t)st.st_size < memory_depth ? (size_t)st.st_size : memory_depth;
+		if(len && mmap(memory_contents, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+			close(fd);
+			munmap(memory_contents, (size_t)memory_depth);
+			memory_contents = 0;
+			return 0;
+		}
+		close(fd);
+	}
+	return 1;
+}
+
+static void unmap_contiguous(void) {
+	munmap(memory_contents, (size_t)memory_depth);
+	memory_contents = 0;
+}
+
+#endif
+
+char memstore_open(uint64_t depth, enum MEM_BACKING backing, const char * image) {
+	memstore_close();
+
+	memory_depth     = depth;
+	memstore_backing = backing;
+	memstore_image[0] = 0;
+	if(image)
+		strncat(memstore_image, image, sizeof(memstore_image) - 1);
+
+	if(backing == BACKING_SPARSE) {
+		memstore_table_count = ((depth + MEMSTORE_PAGE_SIZE - 1) >> MEMSTORE_PAGE_SHIFT) / MEMSTORE_LEAF_SIZE + 1;
+		memory_pages = calloc(memstore_table_count, sizeof(uint8_t **));
+		if(!memory_pages) {
+			printf("\n> ERROR: Could not allocate the page directory of the Main Memory (%" PRIu64 " bytes)\n", depth);
+			return 0;
+		}
+	} else if(!map_contiguous()) {
+		printf("\n> ERROR: Could not map the Main Memory (%" PRIu64 " bytes, backing store '%s%s%s')\n",
+			depth, backing_names[backing], image ? ":" : "", image ? image : "");
+		return 0;
+	}
+
+	printf("Main Memory: %" PRIu64 " bytes (%s%s%s)\n", depth, backing_names[backing], image ? ":" : "", image ? image : "");
+	return 1;
+}
+
+void memstore_close(void) {
+	if(memory_contents)
+		unmap_contiguous();
+	if(memory_pages) {
+		free_pages();
+		free(memory_pages);
+		memory_pages = 0;
+	}
+	memstore_pages_allocated = 0;
+}
+
+/* Brings the memory back to its initial contents (all zeroes, or the image) */
+void memstore_reset(void) {
+	if(memory_pages) {
+		free_pages();
+	} else if(memory_contents) {
+		/* Throwing the mapping away is much cheaper than clearing it */
+		unmap_contiguous();
+		if(!map_contiguous())
+			printf("\n> ERROR: Could not map the Main Memory again\n");
+	}
+}
+
+/* Opens the backing store. The defaults can be overridden by the environment variables:
+ *  FISC_MEMORY_DEPTH:   size in bytes (accepts the suffixes K, M, G and T)
+ *  FISC_MEMORY_BACKING: anon, sparse or file:<path of a raw memory image> */
+char memstore_configure(uint64_t default_depth) {
+	uint64_t depth = default_depth;
+	enum MEM_BACKING backing = BACKING_ANON;
+	const char * image = 0;
+
+	const char * env = getenv(MEMSTORE_ENV_DEPTH);
+	if(env && *env) {
+		char * end;
+		int shift = 0;
+		unsigned long long n = strtoull(env, &end, 0);
+		switch(*end) {
+			case 'k': case 'K': shift = 10; end++; break;
+			case 'm': case 'M': shift = 20; end++; break;
+			case 'g': case 'G': shift = 30; end++; break;
+			case 't': case 'T': shift = 40; end++; break;
+		}
+		/* The whole value must parse, and it's range checked before it's scaled so that it can't wrap around: */
+		if(end != env && !*end && n && n <= (MEMSTORE_MAX_DEPTH >> shift))
+			depth = (uint64_t)n << shift;
+		else
+			printf("\n> WARNING: Ignoring %s='%s'\n", MEMSTORE_ENV_DEPTH, env);
+	}
+
+	env = getenv(MEMSTORE_ENV_BACKING);
+	if(env && *env) {
+		if(!strcmp(env, "anon")) {
+			backing = BACKING_ANON;
+		} else if(!strcmp(env, "sparse")) {
+			backing = BACKING_SPARSE;
+		} else if(!strncmp(env, "file:", 5) && env[5]) {
+			backing = BACKING_FILE;
+			image   = env + 5;
+		} else {
+			printf("\n> WARNING: Ignoring %s='%s' (expected anon, sparse or file:<path>)\n", MEMSTORE_ENV_BACKING, env);
+		}
+	}
+
+	return memstore_open(depth, backing, image);
+}
@@ -0,0 +1,79 @@
+/*
+ * memstore.h
+ *
+ *  Created on: 10/01/2017
+ *      Author: Miguel
+ */
+
+#ifndef SRC_VMACHINE_MEMSTORE_H_
+#define SRC_VMACHINE_MEMSTORE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Backing store of the Main Memory. Its size and kind are chosen at startup (see memstore_configure):
+ *  - anon:        one contiguous anonymous mapping. The host only commits the pages which get touched
+ *  - file:<path>: a private (copy on write) mapping of a raw memory image. Resetting it reloads the image for free
+ *  - sparse:      a two level table of 4 KB pages, allocated on the first write. Reads from untouched pages return zero.
+ *                 Only the tables which cover touched pages are allocated, so it can be far larger than the host's memory
+ * Physical addresses are 64 bits wide. The contiguous backing stores are limited by the host's address space */
+
+#define MEMSTORE_PAGE_SHIFT 12
+#define MEMSTORE_PAGE_SIZE  (1 << MEMSTORE_PAGE_SHIFT)
+#define MEMSTORE_LEAF_SHIFT 12 /* Each table of the sparse backing store holds 4096 pages (16 MB) */
+#define MEMSTORE_LEAF_SIZE  (1 << MEMSTORE_LEAF_SHIFT)
+#define MEMSTORE_MAX_DEPTH  (1ULL << 48) /* Keeps the directory of the sparse backing store within 128 MB (of address space) */
+
+/* Environment variables which override the defaults (and the Memory entity's generic) */
+#define MEMSTORE_ENV_DEPTH   "FISC_MEMORY_DEPTH"
+#define MEMSTORE_ENV_BACKING "FISC_MEMORY_BACKING"
+
+enum MEM_BACKING {
+	BACKING_ANON,
+	BACKING_FILE,
+	BACKING_SPARSE
+};
+
+extern enum MEM_BACKING memstore_backing;
+
+extern uint8_t *   memory_contents; /* Base of the Main Memory (0 on the sparse backing store) */
+extern uint8_t *** memory_pages;    /* Directory of page tables of the sparse backing store */
+extern uint64_t    memory_depth;    /* Size of the Main Memory in bytes */
+
+char memstore_open(uint64_t depth, enum MEM_BACKING backing, const char * image);
+void memstore_close(void);
+void memstore_reset(void);
+char memstore_configure(uint64_t default_depth);
+uint8_t * memstore_page_alloc(uint64_t page);
+uint64_t  memstore_next_page(uint64_t address);
+
+extern uint8_t memstore_zero_page[MEMSTORE_PAGE_SIZE];
+
+/* Returns the page of the sparse backing store, or 0 if it was never written to */
+static inline uint8_t * memstore_page(uint64_t page) {
+	uint8_t ** table = memory_pages[page >> MEMSTORE_LEAF_SHIFT];
+	return table ? table[page & (MEMSTORE_LEAF_SIZE - 1)] : 0;
+}
+
+/* Returns where the bytes [address, address+len) live on the host, or 0 if they're split across two sparse pages.
+ * The caller checks the bounds. Untouched sparse pages are only allocated when they're written to */
+static inline uint8_t * memstore_ptr(uint64_t address, uint32_t len, char write) {
+	if(memory_contents)
+		return memory_contents + (size_t)address;
+
+	uint64_t page   = address >> MEMSTORE_PAGE_SHIFT;
+	uint32_t offset = address & (MEMSTORE_PAGE_SIZE - 1);
+	if(offset + len > MEMSTORE_PAGE_SIZE)
+		return 0;
+
+	uint8_t * p = memstore_page(page);
+	if(!p) {
+		if(!write)
+			return memstore_zero_page + offset;
+		if(!(p = memstore_page_alloc(page)))
+			return 0;
+	}
+	return p + offset;
+}
+
+#endif /* SRC_VMACHINE_MEMSTORE_H_ */
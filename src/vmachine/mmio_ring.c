@@ -0,0 +1,83 @@
+/*
+ * mmio_ring.c
+ *
+ *  Created on: 16/01/2017
+ *      Author: Miguel
+ */
+#include "mmio_ring.h"
+#include "tinycthread/tinycthread.h"
+
+/* Waits for a free slot and fills it. Returns the slot's position, or (uint32_t)-1 if the device has stopped */
+static uint32_t mmio_post(mmio_ring_t * r, uint32_t local_ioaddr, uint64_t data, uint8_t access_width, uint8_t rd) {
+	uint32_t head = r->head;
+	while(head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) == MMIO_RING_SIZE) {
+		if(!mmio_is_open(r))
+			return (uint32_t)-1;
+		thrd_yield(); /* The device is behind by a whole ring */
+	}
+
+	mmio_req_t * req = &r->req[head & (MMIO_RING_SIZE - 1)];
+	req->local_ioaddr = local_ioaddr;
+	req->access_width = access_width;
+	req->rd           = rd;
+	req->data         = data;
+	__atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+	return head;
+}
+
+char mmio_post_write(mmio_ring_t * r, uint32_t local_ioaddr, uint64_t data, uint8_t access_width) {
+	if(!mmio_is_open(r))
+		return 1; /* Nobody is looking at the device anymore */
+	mmio_post(r, local_ioaddr, data, access_width, 0);
+	return 1;
+}
+
+uint64_t mmio_read(mmio_ring_t * r, uint32_t local_ioaddr, uint8_t access_width) {
+	if(!mmio_is_open(r))
+		return (uint64_t)-1;
+	uint32_t pos = mmio_post(r, local_ioaddr, 0, access_width, 1);
+	if(pos == (uint32_t)-1)
+		return (uint64_t)-1;
+
+	/* The read has completed once the device has moved past it. Only the producer reuses its slot, so it stays put: */
+	while((int32_t)(__atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) - pos) <= 0) {
+		if(!mmio_is_open(r))
+			return (uint64_t)-1;
+		thrd_yield();
+	}
+	return r->req[pos & (MMIO_RING_SIZE - 1)].data;
+}
+
+/* Executes every transaction which is in the ring. Called by the device's thread. Returns how many it executed */
+uint32_t mmio_drain(mmio_ring_t * r, mmio_write_fn_t write, mmio_read_fn_t read) {
+	uint32_t tail = r->tail;
+	uint32_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+	uint32_t count = head - tail;
+
+	for(; tail != head; tail++) {
+		mmio_req_t * req = &r->req[tail & (MMIO_RING_SIZE - 1)];
+		if(req->rd) {
+			req->data = read(req->local_ioaddr, req->access_width);
+			__atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE); /* Completes the read right away */
+		} else {
+			write(req->local_ioaddr, req->data, req->access_width);
+		}
+	}
+	__atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+	return count;
+}
+
+/* Called before the device starts consuming. Every transaction which was left in the ring is discarded */
+void mmio_open(mmio_ring_t * r) {
+	r->tail = r->head;
+	__atomic_store_n(&r->open, 1, __ATOMIC_RELEASE);
+}
+
+/* Called when the device stops consuming (or never starts), so that the simulator never waits on it again */
+void mmio_close(mmio_ring_t * r) {
+	__atomic_store_n(&r->open, 0, __ATOMIC_RELEASE);
+}
+
+char mmio_is_open(mmio_ring_t * r) {
+	return __atomic_load_n(&r->open, __ATOMIC_ACQUIRE);
+}
@@ -0,0 +1,46 @@
+/*
+ * mmio_ring.h
+ *
+ *  Created on: 16/01/2017
+ *      Author: Miguel
+ */
+
+#ifndef SRC_VMACHINE_MMIO_RING_H_
+#define SRC_VMACHINE_MMIO_RING_H_
+
+#include <stdint.h>
+
+/* Single producer / single consumer ring of MMIO transactions, between the simulator's thread (the producer) and the
+ * thread of a device (the consumer). Writes are posted: they return as soon as they are in the ring. Reads go through
+ * the same ring, so they see every write which was posted before them, and the simulator waits until the device
+ * completes them. The device executes the transactions in order with mmio_drain. A ring starts closed: the device opens it
+ * before it starts consuming, and closes it when it stops */
+
+#define MMIO_RING_SIZE (1 << 16) /* Transactions (must be a power of 2). Holds the writes posted while the device renders a frame */
+
+typedef struct {
+	uint32_t local_ioaddr;
+	uint8_t  access_width;
+	uint8_t  rd;
+	uint64_t data; /* The data of a write, or the result of a read once it completes */
+} mmio_req_t;
+
+typedef struct {
+	mmio_req_t req[MMIO_RING_SIZE];
+	uint32_t   head;        /* Next transaction to post. Only the producer writes it */
+	char       pad[60];     /* Keeps the head and the tail on different cache lines */
+	uint32_t   tail;        /* Next transaction to execute. Only the consumer writes it */
+	uint8_t    open;        /* The device is consuming. Otherwise writes are dropped and reads fail */
+} mmio_ring_t;
+
+typedef char     (*mmio_write_fn_t)(uint32_t local_ioaddr, uint64_t data, uint8_t access_width);
+typedef uint64_t (*mmio_read_fn_t)(uint32_t local_ioaddr, uint8_t access_width);
+
+char     mmio_post_write(mmio_ring_t * r, uint32_t local_ioaddr, uint64_t data, uint8_t access_width);
+uint64_t mmio_read(mmio_ring_t * r, uint32_t local_ioaddr, uint8_t access_width);
+uint32_t mmio_drain(mmio_ring_t * r, mmio_write_fn_t write, mmio_read_fn_t read);
+void     mmio_open(mmio_ring_t * r);
+void     mmio_close(mmio_ring_t * r);
+char     mmio_is_open(mmio_ring_t * r);
+
+#endif /* SRC_VMACHINE_MMIO_RING_H_ */
@@ -4,7 +4,6 @@
  *  Created on: 19/12/2016
  *      Author: Miguel
  */
-#include <mti.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -12,64 +11,109 @@
 #include <inttypes.h>
 #include <bit.h>
 #include "mmu.h"
-#include "signal_conv.h"
 #include "address_space.h"
 
-#define get_pdp() sigv_to_int(mmu_ip->pdp)
+#include "bus.h"
+#include "defines.h"
 
-typedef struct {
-	mtiSignalIdT clk;
-	mtiSignalIdT en;
-	mtiSignalIdT pdp;
-	mtiDriverIdT pfla;
-	mtiDriverIdT pfla_wr;
-} mmu_t;
+/* Decoded copies of the MMU's input wires. These are kept up to date through mmu_set_enabled and mmu_set_pdp: */
+uint8_t  mmu_enabled = 0; /* Is the MMU enabled? */
+uint64_t mmu_pdp     = 0; /* Address of the Paging Directory */
 
-mmu_t * mmu_ip;
+tlb_entry_t tlb[TLB_ENTRIES];
 
-extern uint8_t memory_contents[MEMORY_DEPTH];
+/* TLB statistics: */
+uint64_t tlb_hits    = 0;
+uint64_t tlb_misses  = 0;
+uint64_t tlb_flushes = 0;
 
-/* This function converts a Virtual Address into a Physical Address */
-uint32_t address_translate(uint32_t vaddress) {
-	uint8_t mmu_enabled = sig_to_int(mmu_ip->en);
+void tlb_flush(void) {
+	memset(tlb, 0, sizeof(tlb));
+	bus_clear_tables(); /* No entry is left which was walked from them */
+	tlb_flushes++;
+}
+
+/* The software edited the paging structures behind some translations (bus_init installs this as the bus' table_write_hook).
+ * FISC has no instruction to flush the TLB, so the entries which were walked through that table page are dropped here */
+void mmu_table_write(uint64_t table_page) {
+	for(int i = 0; i < TLB_ENTRIES; i++)
+		for(int w = 0; w < 2 && tlb[i].valid; w++)
+			if(tlb[i].walked[w] >> TABLE_PAGE_SHIFT == table_page || (tlb[i].walked[w] + 3) >> TABLE_PAGE_SHIFT == table_page)
+				tlb[i].valid = 0;
+}
+
+void mmu_print_stats(void) {
+	printf("\n> MMU TLB: %" PRIu64 " hits, %" PRIu64 " misses, %" PRIu64 " flushes", tlb_hits, tlb_misses, tlb_flushes);
+}
+
+/* Reads a 32 bit word which was stored by the host's (little endian) structures. The walker tracks every word it reads,
+ * so that a write into it drops the translation */
+static uint32_t read_le32(uint64_t address) {
+	bus_mark_table(address, 4);
+	uint32_t be = (uint32_t)read_memory(address, SZ_32);
+	return (be >> 24) | ((be >> 8) & 0xFF00) | ((be << 8) & 0xFF0000) | (be << 24);
+}
+
+/* Walks the Paging Directory and returns the Physical Frame Number which maps the Virtual Page Number. The addresses of
+ * the words it read go into 'walked' */
+uint64_t page_walk(uint64_t pdp, uint32_t vpn, uint64_t walked[2]) {
+	/* Calculate indices from the Virtual Page Number: */
+	uint32_t table_idx = INDEX_FROM_BIT(vpn, PAGES_PER_TABLE);
+	uint32_t page_idx  = OFFSET_FROM_BIT(vpn, PAGES_PER_TABLE);
+
+	/* Fetch the directory, table entry and page. The structures were laid out by 32 bit (little endian) code,
+	 * and the table pointers are offsets from the directory. The directory itself may sit anywhere in physical memory: */
+	uint64_t directory = pdp;
+	walked[0] = directory + PD_TABLES_OFFSET + table_idx * PD_POINTER_SIZE;
+	uint64_t table     = directory + read_le32(walked[0]);
+	walked[1] = table + page_idx * sizeof(page_t);
+	uint32_t page      = read_le32(walked[1]);
+
+	/* TODO: Generate exception if this page is not allowed to the current user */
+
+	return page >> 12; /* page_t.phys_addr */
+}
+
+/* This function converts a Virtual Address into a Physical Address. The Paging Directory maps a 32 bit virtual address space */
+uint64_t address_translate(uint64_t vaddress) {
 	if(!mmu_enabled) return vaddress; /* Return the original virtual address in case the MMU is disabled */
 
-	uint32_t ret = (uint32_t)-1; /* Return value */
+	uint64_t ret = (uint64_t)-1; /* Return value */
+	uint64_t pdp = mmu_pdp;
 
-	uint64_t pdp = get_pdp(); /* Read value of the wire PDP (Page Directory Pointer) */
-	if(pdp >= MEMORY_DEPTH) {
+	if(pdp >= memory_depth) {
 		/* The programmer set a pointer outside memory. We'll need to generate an exception whenever the CPU tries to access this value */
 		/* TODO */
 	} else {
-		printf("MMU:1 "); /* Append this to the stdout as part of the debug message */
-
-		/* Calculate indices from the Virtual Address: */
-		uint32_t table_idx = INDEX_FROM_BIT((vaddress)/PAGE_SIZE, PAGES_PER_TABLE);
-		uint32_t page_idx  = OFFSET_FROM_BIT((vaddress)/PAGE_SIZE, PAGES_PER_TABLE);
+		uint32_t vpn = (uint32_t)vaddress / PAGE_SIZE;
+		tlb_entry_t * entry = &tlb[vpn & (TLB_ENTRIES-1)];
 
-		/* Fetch the directory, table entry and page: */
-		paging_directory_t * directory = (paging_directory_t*)((uint32_t)memory_contents + (uint32_t)pdp);
-		page_table_t * table = (page_table_t*)((uint32_t)directory + (uint32_t)directory->tables[table_idx]);
-		page_t * page = (page_t*)((uint32_t)&table->pages[page_idx]);
-
-		/* TODO: Generate exception if this page is not allowed to the current user */
+		if(entry->valid && entry->vpn == vpn && entry->pdp == pdp) {
+			tlb_hits++;
+		} else {
+			tlb_misses++;
+			entry->pdp   = pdp;
+			entry->vpn   = vpn;
+			entry->pfn   = page_walk(pdp, vpn, entry->walked);
+			entry->valid = 1;
+		}
 
 		/* Return physical address: */
-		ret = (page->phys_addr << 12) | (vaddress & 0xFFF);
+		ret = (entry->pfn << 12) | (vaddress & 0xFFF);
 	}
 	return ret;
 }
 
-void mmu_init(
-	mtiRegionIdT region,
-	char * param,
-	mtiInterfaceListT * generics,
-	mtiInterfaceListT * ports
-) {
-	mmu_ip          = (mmu_t *)mti_Malloc(sizeof(mmu_t));
-	mmu_ip->clk     = mti_FindPort(ports, "clk");
-	mmu_ip->en      = mti_FindPort(ports, "en");
-	mmu_ip->pdp     = mti_FindPort(ports, "pdp");
-	mmu_ip->pfla    = mti_CreateDriver(mti_FindPort(ports, "pfla"));
-	mmu_ip->pfla_wr = mti_CreateDriver(mti_FindPort(ports, "pfla_wr"));
+/* Called whenever paging is toggled (through the CPSR) */
+void mmu_set_enabled(uint8_t en) {
+	if(en != mmu_enabled) {
+		mmu_enabled = en;
+		tlb_flush();
+	}
+}
+
+/* Called whenever the Paging Directory Pointer changes (LPDP instruction). The TLB keeps the other directories' entries
+ * (they are tagged with their directory), so switching back and forth between processes does not walk again */
+void mmu_set_pdp(uint64_t pdp) {
+	mmu_pdp = pdp;
 }
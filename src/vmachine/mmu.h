@@ -15,6 +15,12 @@
 #define TABLES_PER_DIR 1024
 #define PAGE_SIZE 0x1000
 
+/* Layout of paging_directory_t as built by the (32 bit) software: the table pointers follow the table entries */
+#define PD_TABLES_OFFSET (TABLES_PER_DIR * sizeof(page_table_entry_t))
+#define PD_POINTER_SIZE  4
+
+#define TLB_ENTRIES 256 /* Number of entries of the (direct mapped) Software TLB. Must be a power of 2 */
+
 /* Page definition: */
 typedef struct page {
 	unsigned int present:1; /* 0: NOT PRESENT 1: PRESENT */
@@ -55,6 +61,24 @@ typedef struct page_directory {
 	page_table_t       * tables[TABLES_PER_DIR]; /* Array of page tables, covers entire memory space */
 } paging_directory_t;
 
-uint32_t address_translate(uint32_t vaddress);
+/* Software TLB entry definition. The entries of several Page Directories live side by side (switching directories does not
+ * flush them), and an entry is dropped once its walk's words are written (see mmu_table_write): */
+typedef struct tlb_entry {
+	uint64_t pdp;        /* Tag: Page Directory this translation was walked from */
+	uint64_t pfn;        /* Physical Frame Number */
+	uint64_t walked[2];  /* Physical addresses of the table pointer and of the page which the walk read */
+	uint32_t vpn;        /* Tag: Virtual Page Number */
+	uint8_t  valid;      /* 0: EMPTY 1: VALID */
+} tlb_entry_t;
+
+extern uint8_t  mmu_enabled;
+extern uint64_t mmu_pdp;
+
+uint64_t address_translate(uint64_t vaddress);
+void tlb_flush(void);
+void mmu_table_write(uint64_t table_page);
+void mmu_print_stats(void);
+void mmu_set_enabled(uint8_t en);
+void mmu_set_pdp(uint64_t pdp);
 
 #endif /* SRC_VMACHINE_MMU_H_ */
@@ -0,0 +1,98 @@
+/*
+ * runctl.c
+ *
+ *  Created on: 13/01/2017
+ *      Author: Miguel
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+#include "runctl.h"
+
+runctl_config_t runctl = {
+	0,                        /* max_cycles */
+	1,                        /* stop_on_halt */
+	0, 0,                     /* stop_pc */
+	0,                        /* checkpoint_interval */
+	RUNCTL_DEFAULT_CHECKPOINT,
+	0                         /* break_on_stop */
+};
+
+uint64_t                runctl_cycle       = 0;
+enum RUNCTL_STOP_REASON runctl_stop_reason = STOP_NONE;
+uint32_t                runctl_halt_pc     = 0;
+uint32_t                runctl_halt_repeat = 0;
+
+static const char * stop_reasons[] = { "none", "reached max_cycles", "halted", "reached stop_pc" };
+
+/* Sets one parameter. Returns 0 if the parameter is unknown or its value is invalid */
+char runctl_set(const char * name, const char * value) {
+	char * end;
+	long long n = strtoll(value, &end, 0);
+	char is_number = *value && !*end;
+
+	if(!strcmp(name, "max_cycles") && is_number && n >= 0) {
+		runctl.max_cycles = n;
+	} else if(!strcmp(name, "stop_on_halt") && is_number) {
+		runctl.stop_on_halt = n != 0;
+	} else if(!strcmp(name, "stop_pc") && is_number) {
+		runctl.stop_on_pc = n >= 0;
+		runctl.stop_pc    = (uint32_t)n;
+	} else if(!strcmp(name, "checkpoint_interval") && is_number && n >= 0) {
+		runctl.checkpoint_interval = n;
+	} else if(!strcmp(name, "checkpoint_file") && *value) {
+		runctl.checkpoint_file[0] = 0;
+		strncat(runctl.checkpoint_file, value, sizeof(runctl.checkpoint_file) - 1);
+	} else if(!strcmp(name, "on_stop") && (!strcmp(value, "quit") || !strcmp(value, "break"))) {
+		runctl.break_on_stop = !strcmp(value, "break");
+	} else {
+		return 0;
+	}
+	return 1;
+}
+
+/* Parses a list of 'name=value' separated by spaces or commas */
+char runctl_parse(const char * params) {
+	char param[300];
+	char ret = 1;
+
+	while(params && *params) {
+		params += strspn(params, " \t,");
+		size_t len = strcspn(params, " \t,");
+		if(!len)
+			break;
+		if(len < sizeof(param)) {
+			memcpy(param, params, len);
+			param[len] = 0;
+			char * value = strchr(param, '=');
+			if(value)
+				*value++ = 0;
+			if(!value || !runctl_set(param, value)) {
+				printf("\n> WARNING: Ignoring the run control parameter '%s'\n", param);
+				ret = 0;
+			}
+		}
+		params += len;
+	}
+	return ret;
+}
+
+/* Path of the checkpoint at the current cycle */
+void runctl_checkpoint_path(char * path, uint32_t size) {
+	const char * token = strstr(runctl.checkpoint_file, "%llu");
+	if(!token) {
+		snprintf(path, size, "%s", runctl.checkpoint_file);
+		return;
+	}
+	snprintf(path, size, "%.*s%" PRIu64 "%s", (int)(token - runctl.checkpoint_file), runctl.checkpoint_file,
+		runctl_cycle, token + 4);
+}
+
+void runctl_print_stop(void) {
+	printf("\n> Run control: stopped after %" PRIu64 " cycles (%s)", runctl_cycle, stop_reasons[runctl_stop_reason]);
+	if(runctl_stop_reason == STOP_HALT || runctl_stop_reason == STOP_PC)
+		printf(" at PC 0x%x", runctl_stop_reason == STOP_HALT ? runctl_halt_pc : runctl.stop_pc);
+	printf("\n");
+}
@@ -0,0 +1,97 @@
+/*
+ * runctl.h
+ *
+ *  Created on: 13/01/2017
+ *      Author: Miguel
+ */
+
+#ifndef SRC_VMACHINE_RUNCTL_H_
+#define SRC_VMACHINE_RUNCTL_H_
+
+#include <stdint.h>
+#include "../iss/iss.h"
+
+/* Run control of the RTL simulation: when to stop, and when to take a checkpoint.
+ * It is configured by the generics of the Memory entity (rtl/memory.vhd), which 'vsim -g<name>=<value>' can override,
+ * then by the parameters of its foreign attribute ("memory_init " & VM_LIBRARY & " <name>=<value> ...") and last by the
+ * environment variable FISC_RUNCTL, which takes the same list (GHDL has no foreign attribute, see sim.h):
+ *  max_cycles:          stop after this many clock cycles (0: no limit)
+ *  stop_on_halt:        stop once the core spins on a HALT instruction (0 or 1)
+ *  stop_pc:             stop when the core fetches this (virtual) address (-1: never)
+ *  checkpoint_interval: break every this many cycles, so that the do script takes a checkpoint (0: never)
+ *  checkpoint_file:     path of the checkpoints. A '%llu' in it is replaced by the cycle count
+ *  on_stop:             'quit' the simulator or 'break' back into the vsim prompt */
+
+#define RUNCTL_HALT_REPEAT        4 /* Fetches of a HALT from the same address, with only its shadow in between, which count as halted */
+#define RUNCTL_HALT_SHADOW        8 /* Bytes past a HALT which the core fetches before the branch takes it back (B resolves in decode) */
+#define RUNCTL_DEFAULT_CHECKPOINT "waves/fisc_%llu.cpt"
+#define RUNCTL_CHECKPOINT_VAR     "fisc_checkpoint" /* Tcl variable which tells the do script where to checkpoint */
+#define RUNCTL_ENV                "FISC_RUNCTL"
+
+enum RUNCTL_ACTION {
+	RUN_CONTINUE,
+	RUN_STOP,
+	RUN_CHECKPOINT
+};
+
+enum RUNCTL_STOP_REASON {
+	STOP_NONE,
+	STOP_MAX_CYCLES,
+	STOP_HALT,
+	STOP_PC
+};
+
+typedef struct {
+	uint64_t max_cycles;
+	char     stop_on_halt;
+	char     stop_on_pc;
+	uint32_t stop_pc;
+	uint64_t checkpoint_interval;
+	char     checkpoint_file[256];
+	char     break_on_stop;
+} runctl_config_t;
+
+extern runctl_config_t         runctl;
+extern uint64_t                runctl_cycle;
+extern enum RUNCTL_STOP_REASON runctl_stop_reason;
+extern uint32_t                runctl_halt_pc;
+extern uint32_t                runctl_halt_repeat;
+
+char runctl_set(const char * name, const char * value);
+char runctl_parse(const char * params);
+void runctl_checkpoint_path(char * path, uint32_t size);
+void runctl_print_stop(void);
+
+/* Called on every rising edge of the clock */
+static inline enum RUNCTL_ACTION runctl_tick(void) {
+	runctl_cycle++;
+	if(runctl.max_cycles && runctl_cycle == runctl.max_cycles)
+		runctl_stop_reason = STOP_MAX_CYCLES;
+	if(runctl_stop_reason != STOP_NONE)
+		return RUN_STOP;
+	if(runctl.checkpoint_interval && runctl_cycle % runctl.checkpoint_interval == 0)
+		return RUN_CHECKPOINT;
+	return RUN_CONTINUE;
+}
+
+/* Called on every instruction fetch. HALT is a branch into itself, so the core keeps fetching it from the same address.
+ * The fetches of its shadow (the fall-through, until the branch resolves) are skipped. Any other fetch means the HALT was
+ * only fetched on the way past it, such as right after the taken branch of a loop */
+static inline void runctl_fetch(uint32_t pc, uint32_t instruction) {
+	if(runctl.stop_on_pc && pc == runctl.stop_pc)
+		runctl_stop_reason = STOP_PC;
+
+	if(!runctl.stop_on_halt)
+		return;
+	if(instruction != ISS_HALT_INSTRUCTION) {
+		if(pc - runctl_halt_pc - 4 >= RUNCTL_HALT_SHADOW)
+			runctl_halt_repeat = 0;
+	} else if(pc != runctl_halt_pc || !runctl_halt_repeat) {
+		runctl_halt_pc     = pc;
+		runctl_halt_repeat = 1;
+	} else if(++runctl_halt_repeat == RUNCTL_HALT_REPEAT) {
+		runctl_stop_reason = STOP_HALT;
+	}
+}
+
+#endif /* SRC_VMACHINE_RUNCTL_H_ */
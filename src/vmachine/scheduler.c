@@ -0,0 +1,66 @@
+/*
+ * scheduler.c
+ *
+ *  Created on: 17/01/2017
+ *      Author: Miguel
+ */
+#include <stdio.h>
+#include "scheduler.h"
+
+typedef struct {
+	uint64_t   when;
+	sched_fn_t fn; /* 0: free slot */
+	void     * arg;
+} sched_event_t;
+
+/* There are only a handful of events, so a scan over the slots does on every change. sched_run only compares with sched_next */
+static sched_event_t events[SCHED_MAX_EVENTS];
+
+uint64_t sched_now  = 0;
+uint64_t sched_next = SCHED_NEVER;
+
+static void sched_update_next(void) {
+	sched_next = SCHED_NEVER;
+	for(int i = 0; i < SCHED_MAX_EVENTS; i++)
+		if(events[i].fn && events[i].when < sched_next)
+			sched_next = events[i].when;
+}
+
+/* Schedules fn(arg) on the cycle 'when'. Returns the event's handle, or -1 if there are too many events */
+int sched_add(uint64_t when, sched_fn_t fn, void * arg) {
+	for(int i = 0; i < SCHED_MAX_EVENTS; i++) {
+		if(events[i].fn)
+			continue;
+		events[i].when = when;
+		events[i].fn   = fn;
+		events[i].arg  = arg;
+		if(when < sched_next)
+			sched_next = when;
+		return i;
+	}
+	printf("\n> ERROR: Too many scheduled events (%d)\n", SCHED_MAX_EVENTS);
+	return -1;
+}
+
+void sched_cancel(int event) {
+	if(event < 0 || event >= SCHED_MAX_EVENTS || !events[event].fn)
+		return;
+	events[event].fn = 0;
+	sched_update_next();
+}
+
+/* Fires every event which is due, in the order of their cycles. An event may schedule others (even due ones) */
+void sched_dispatch(uint64_t now) {
+	while(sched_next <= now) {
+		int first = -1;
+		for(int i = 0; i < SCHED_MAX_EVENTS; i++)
+			if(events[i].fn && events[i].when <= now && (first < 0 || events[i].when < events[first].when))
+				first = i;
+		if(first < 0)
+			break;
+		sched_event_t event = events[first];
+		events[first].fn = 0;
+		event.fn(event.arg, event.when);
+		sched_update_next();
+	}
+}
@@ -0,0 +1,42 @@
+/*
+ * scheduler.h
+ *
+ *  Created on: 17/01/2017
+ *      Author: Miguel
+ */
+
+#ifndef SRC_VMACHINE_SCHEDULER_H_
+#define SRC_VMACHINE_SCHEDULER_H_
+
+#include <stdint.h>
+
+/* Discrete event scheduler, in simulated clock cycles. The devices schedule their events on it instead of running on a
+ * host thread, so they behave the same no matter how fast the host is. The front-end owns the clock: the FLI memory
+ * model runs it on every rising edge, and the Instruction Set Simulator on its cycle counter between blocks (which it
+ * stops once the next event is due, so an event fires at most one instruction late). Everything runs on the simulator's thread */
+
+#define SCHED_MAX_EVENTS 16
+#define SCHED_NEVER      UINT64_MAX
+
+typedef void (*sched_fn_t)(void * arg, uint64_t now);
+
+extern uint64_t sched_now;  /* Cycle of the last sched_run */
+extern uint64_t sched_next; /* Cycle of the earliest event (SCHED_NEVER if there is none) */
+
+int  sched_add(uint64_t when, sched_fn_t fn, void * arg);
+void sched_cancel(int event);
+void sched_dispatch(uint64_t now);
+
+/* Fires the events which are due by the cycle 'now' */
+static inline void sched_run(uint64_t now) {
+	sched_now = now;
+	if(now >= sched_next)
+		sched_dispatch(now);
+}
+
+/* Cycles until the next event */
+static inline uint64_t sched_until_next(uint64_t now) {
+	return sched_next > now ? sched_next - now : 0;
+}
+
+#endif /* SRC_VMACHINE_SCHEDULER_H_ */
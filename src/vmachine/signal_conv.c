@@ -0,0 +1,58 @@
+/*
+ * signal_conv.c
+ *
+ *  Created on: 17/12/2016
+ *      Author: Miguel
+ */
+#include <string.h>
+#include "signal_conv.h"
+
+/* Lookup table which converts a byte into its 8 std_logic values (MSB first): */
+#define SIGV_LUT1(b)  { SIGV_0 + (((b) >> 7) & 1), SIGV_0 + (((b) >> 6) & 1), SIGV_0 + (((b) >> 5) & 1), SIGV_0 + (((b) >> 4) & 1), \
+                        SIGV_0 + (((b) >> 3) & 1), SIGV_0 + (((b) >> 2) & 1), SIGV_0 + (((b) >> 1) & 1), SIGV_0 + ((b) & 1) }
+#define SIGV_LUT4(b)  SIGV_LUT1(b),  SIGV_LUT1((b)+1),  SIGV_LUT1((b)+2),  SIGV_LUT1((b)+3)
+#define SIGV_LUT16(b) SIGV_LUT4(b),  SIGV_LUT4((b)+4),  SIGV_LUT4((b)+8),  SIGV_LUT4((b)+12)
+#define SIGV_LUT64(b) SIGV_LUT16(b), SIGV_LUT16((b)+16), SIGV_LUT16((b)+32), SIGV_LUT16((b)+48)
+
+static const char sigv_lut[256][8] = {
+	SIGV_LUT64(0), SIGV_LUT64(64), SIGV_LUT64(128), SIGV_LUT64(192)
+};
+
+/* Gathers the lowest bit of each of the 8 bytes of a word into a single byte (the first byte in memory becomes the MSB): */
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define SIGV_GATHER_MAGIC 0x0102040810204080ULL
+#else
+#define SIGV_GATHER_MAGIC 0x8040201008040201ULL
+#endif
+
+static inline uint8_t sigv_gather8(const char * sigv) {
+	uint64_t word;
+	memcpy(&word, sigv, 8);
+	return (uint8_t)(((word & 0x0101010101010101ULL) * SIGV_GATHER_MAGIC) >> 56);
+}
+
+/* Converts 'size' std_logic values (MSB first) into an integer. Only the lowest bit of each value is used, so 'U'/'Z'/'L' read as 0 and 'X'/'W'/'H' read as 1 */
+uint64_t sigv_decode(const char * sigv, uint32_t size) {
+	uint64_t ret = 0;
+	uint32_t head = size % 8;
+
+	for(uint32_t i = 0; i < head; i++)
+		ret = (ret << 1) | (sigv[i] & 0x1);
+	for(uint32_t i = head; i < size; i += 8)
+		ret = (ret << 8) | sigv_gather8(sigv + i);
+	return ret;
+}
+
+/* Converts the lowest 'size' bits of an integer into std_logic values (MSB first). The buffer is provided by the caller */
+char * sigv_encode(uint64_t n, uint32_t size, char * sigv) {
+	uint32_t head = size % 8;
+	char * ptr = sigv;
+
+	if(head) {
+		memcpy(ptr, &sigv_lut[(n >> (size - head)) & 0xFF][8 - head], head);
+		ptr += head;
+	}
+	for(int shift = (int)(size - head) - 8; shift >= 0; shift -= 8, ptr += 8)
+		memcpy(ptr, sigv_lut[(n >> shift) & 0xFF], 8);
+	return sigv;
+}
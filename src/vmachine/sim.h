@@ -0,0 +1,169 @@
+/*
+ * sim.h
+ *
+ *  Created on: 20/01/2017
+ *      Author: Miguel
+ */
+
+#ifndef SRC_VMACHINE_SIM_H_
+#define SRC_VMACHINE_SIM_H_
+
+#include <stdint.h>
+#include "defines.h"
+#include "signal_conv.h"
+
+/* The HDL simulator under the Memory, MMU and IO Controller of the RTL. The C side only reads their input ports and
+ * drives their output ports through these, so the same code runs on either backend (chosen when building libvm):
+ *  SIM_FLI:  ModelSim's Foreign Language Interface. The architectures of rtl/ are foreign, see sim_fli.c
+ *  SIM_GHDL: GHDL's VHPIDIRECT. The architectures of rtl/ghdl/ pass their ports on every call, see sim_ghdl.c
+ *  SIM_VERILATOR: the core compiled by Verilator. The DPI-C shells of rtl/verilator/ do the same, see sim_verilator.c
+ * A delay of 0 drives the port on the next delta cycle, and a delay of 1 drives it one tick of the resolution later */
+
+#define SIM_FLI       0
+#define SIM_GHDL      1
+#define SIM_VERILATOR 2
+
+#ifndef SIM_BACKEND
+#define SIM_BACKEND SIM_FLI
+#endif
+
+#if SIM_BACKEND == SIM_FLI
+/*********************************/
+/* ModelSim FLI:                 */
+/*********************************/
+#include <mti.h>
+
+#define SIM_NAME      "ModelSim FLI"
+#define SIM_CAN_BREAK 1 /* Has a prompt to break into */
+
+typedef mtiSignalIdT sim_signal_t;
+typedef mtiDriverIdT sim_driver_t;
+
+uint64_t sim_vec(sim_signal_t sig);
+
+static inline int sim_bit(sim_signal_t sig) {
+	return mti_GetSignalValue(sig) & 0x1;
+}
+
+static inline void sim_drive_bit(sim_driver_t drv, int bit, int delay) {
+	mti_ScheduleDriver(drv, SIGV_0 + (bit & 0x1), delay, MTI_INERTIAL);
+}
+
+/* The FLI reads the encoded value from 'sigv' when the driver fires, so the buffer must outlive the call */
+static inline void sim_drive_vec(sim_driver_t drv, uint64_t value, uint32_t size, char * sigv, int delay) {
+	mti_ScheduleDriver(drv, (mtiLongT)sigv_encode(value, size, sigv), delay, MTI_INERTIAL);
+}
+
+#define sim_break()      mti_Break()
+#define sim_is_restore() mti_IsRestore()
+
+#else
+/*********************************/
+/* Backends which call into C:   */
+/*********************************/
+#if ENABLE_COSIM == 1
+#error "The co-simulation probes the RTL's internal signals, which only the FLI backend can do"
+#endif
+
+#define SIM_CAN_BREAK 0 /* Runs in batch: a break stops the simulation */
+
+/* The HDL side assigns an output into its port only if its flags ask for it (two bits per output, in the order of the ports) */
+#define SIM_DRIVE_EN    1
+#define SIM_DRIVE_DELAY 2
+
+static inline void sim_drive_flags(int32_t * flags, uint32_t index, int delay) {
+	*flags = (*flags & ~(3 << (index * 2))) | ((SIM_DRIVE_EN | (delay ? SIM_DRIVE_DELAY : 0)) << (index * 2));
+}
+
+void sim_break(void);
+#define sim_is_restore() 0
+
+#if SIM_BACKEND == SIM_GHDL
+/*********************************/
+/* GHDL VHPIDIRECT:              */
+/*********************************/
+#define SIM_NAME "GHDL VHPIDIRECT"
+
+/* The architecture passes its ports as arguments. An input points at the std_logic values it was given, and an output
+ * at the variable which the architecture assigns into its port (see rtl/ghdl/vhpi.vhd) */
+typedef struct {
+	const char * sigv;
+	uint32_t     size;
+} sim_ghdl_signal_t;
+
+typedef struct {
+	char     * sigv;
+	int32_t  * flags;
+	uint32_t   index; /* Of the output, in the flags */
+} sim_ghdl_driver_t;
+
+typedef sim_ghdl_signal_t * sim_signal_t;
+typedef sim_ghdl_driver_t * sim_driver_t;
+
+static inline uint64_t sim_vec(sim_signal_t sig) {
+	return sigv_decode(sig->sigv, sig->size);
+}
+
+static inline int sim_bit(sim_signal_t sig) {
+	return sig->sigv[0] & 0x1;
+}
+
+static inline void sim_drive_bit(sim_driver_t drv, int bit, int delay) {
+	drv->sigv[0] = SIGV_0 + (bit & 0x1);
+	sim_drive_flags(drv->flags, drv->index, delay);
+}
+
+/* The value is encoded straight into the architecture's variable, so 'sigv' is not needed */
+static inline void sim_drive_vec(sim_driver_t drv, uint64_t value, uint32_t size, char * sigv, int delay) {
+	sigv_encode(value, size, drv->sigv);
+	sim_drive_flags(drv->flags, drv->index, delay);
+}
+
+#elif SIM_BACKEND == SIM_VERILATOR
+/*********************************/
+/* Verilator DPI-C:              */
+/*********************************/
+#define SIM_NAME "Verilator"
+
+/* The shell passes its ports as integers. Verilator is cycle based: the outputs driven with no delay are assigned on
+ * the same edge, and the delayed ones right before the next edge (see sim_verilator_main.cpp) */
+typedef struct {
+	uint64_t value;
+} sim_verilator_signal_t;
+
+typedef struct {
+	uint64_t   value;
+	int32_t  * flags;
+	uint32_t   index; /* Of the output, in the flags */
+} sim_verilator_driver_t;
+
+typedef sim_verilator_signal_t * sim_signal_t;
+typedef sim_verilator_driver_t * sim_driver_t;
+
+static inline uint64_t sim_vec(sim_signal_t sig) {
+	return sig->value;
+}
+
+static inline int sim_bit(sim_signal_t sig) {
+	return sig->value & 0x1;
+}
+
+static inline void sim_drive_bit(sim_driver_t drv, int bit, int delay) {
+	drv->value = bit & 0x1;
+	sim_drive_flags(drv->flags, drv->index, delay);
+}
+
+static inline void sim_drive_vec(sim_driver_t drv, uint64_t value, uint32_t size, char * sigv, int delay) {
+	drv->value = size < 64 ? value & ((1ULL << size) - 1) : value;
+	sim_drive_flags(drv->flags, drv->index, delay);
+}
+
+#else
+#error "Unknown SIM_BACKEND"
+#endif
+#endif
+
+void sim_quit(void);
+char sim_checkpoint(const char * path); /* Returns 0 if the simulator can not take checkpoints */
+
+#endif /* SRC_VMACHINE_SIM_H_ */
@@ -0,0 +1,186 @@
+/*
+ * sim_fli.c
+ *
+ *  Created on: 19/12/2016
+ *      Author: Miguel
+ */
+#include <mti.h>
+#include <stdio.h>
+#include <string.h>
+#include "sim.h"
+#include "cosim.h"
+#include "io_controller.h"
+#include "io_controller_rtl.h"
+#include "memory.h"
+#include "mmu.h"
+#include "runctl.h"
+#include "snapshot.h"
+
+/* ModelSim backend (see sim.h). The foreign architectures of rtl/memory.vhd, rtl/mmu.vhd and rtl/io_controller.vhd
+ * are elaborated by memory_init, mmu_init and io_controller_init_vhd */
+
+/*********************************/
+/* Simulator:                    */
+/*********************************/
+uint64_t sim_vec(sim_signal_t sig) {
+	char sigv[SIGV_MAX_SZ];
+	uint32_t size = mti_TickLength(mti_GetSignalType(sig));
+	if(size > SIGV_MAX_SZ) size = SIGV_MAX_SZ;
+	mti_GetArraySignalValue(sig, sigv);
+	return sigv_decode(sigv, size);
+}
+
+void sim_quit(void) {
+	mti_Quit();
+}
+
+/* Breaks so that the do script takes the checkpoint (see runctl.h) */
+char sim_checkpoint(const char * path) {
+	char command[300];
+	snprintf(command, sizeof(command), "set " RUNCTL_CHECKPOINT_VAR " {%s}", path);
+	mti_Command(command);
+	mti_Break();
+	return 1;
+}
+
+/*********************************/
+/* Memory:                       */
+/*********************************/
+memory_t * mem_ip;
+
+static void memory_on_clock_fli(void * param) {
+	memory_on_clock((memory_t *) param);
+}
+
+void memory_init(
+	mtiRegionIdT region,
+	char * param,
+	mtiInterfaceListT * generics,
+	mtiInterfaceListT * ports
+) {
+	/* The size of the memory comes from the entity's generic 'depth' (unless the environment overrides it): */
+	uint64_t depth = MEMORY_DEPTH;
+	for(mtiInterfaceListT * generic = generics; generic; generic = generic->nxt)
+		if(!strcmp(generic->name, "depth") && generic->u.generic_value > 0)
+			depth = generic->u.generic_value;
+
+	/* The run control comes from the other generics, and then from the foreign attribute's parameters (see runctl.h): */
+	for(mtiInterfaceListT * generic = generics; generic; generic = generic->nxt) {
+		char value[24];
+		snprintf(value, sizeof(value), "%ld", (long)generic->u.generic_value);
+		if(strcmp(generic->name, "depth"))
+			runctl_set(generic->name, value);
+	}
+	runctl_parse(param);
+
+	memory_setup(depth);
+	snapshot_fli_init();
+#if ENABLE_COSIM == 1
+	cosim_fli_init();
+#endif
+
+	mem_ip                 = (memory_t *)mti_Malloc(sizeof(memory_t));
+	mem_ip->clk            = mti_FindPort(ports, "clk");
+	mem_ip->en             = mti_FindPort(ports, "en");
+	mem_ip->wr             = mti_FindPort(ports, "wr");
+	mem_ip->rd             = mti_FindPort(ports, "rd");
+	mem_ip->ready          = mti_CreateDriver(mti_FindPort(ports, "ready"));
+	mem_ip->address1       = mti_FindPort(ports, "address1");
+	mem_ip->address2       = mti_FindPort(ports, "address2");
+	mem_ip->data_in        = mti_FindPort(ports, "data_in");
+	mem_ip->data_out1      = mti_CreateDriver(mti_FindPort(ports, "data_out1"));
+	mem_ip->data_out2      = mti_CreateDriver(mti_FindPort(ports, "data_out2"));
+	mem_ip->access_width   = mti_FindPort(ports, "access_width");
+	mem_ip->alignment_flag = mti_FindPort(ports, "alignment_flag");
+
+	mtiProcessIdT memory_process = mti_CreateProcess("memory_p", memory_on_clock_fli, mem_ip);
+	mti_Sensitize(memory_process, mem_ip->clk, MTI_EVENT);
+}
+
+/*********************************/
+/* MMU:                          */
+/*********************************/
+typedef struct {
+	mtiSignalIdT clk;
+	mtiSignalIdT en;
+	mtiSignalIdT pdp;
+	mtiDriverIdT pfla;
+	mtiDriverIdT pfla_wr;
+} mmu_t;
+
+mmu_t * mmu_ip;
+
+/* Runs whenever the wire EN changes (paging toggled through the CPSR) */
+void mmu_on_en(void * param) {
+	mmu_t * mmu_ip = (mmu_t *) param;
+	mmu_set_enabled(sim_bit(mmu_ip->en));
+}
+
+/* Runs whenever the wire PDP changes (LPDP instruction) */
+void mmu_on_pdp(void * param) {
+	mmu_t * mmu_ip = (mmu_t *) param;
+	mmu_set_pdp(sim_vec(mmu_ip->pdp));
+}
+
+void mmu_init(
+	mtiRegionIdT region,
+	char * param,
+	mtiInterfaceListT * generics,
+	mtiInterfaceListT * ports
+) {
+	mmu_ip          = (mmu_t *)mti_Malloc(sizeof(mmu_t));
+	mmu_ip->clk     = mti_FindPort(ports, "clk");
+	mmu_ip->en      = mti_FindPort(ports, "en");
+	mmu_ip->pdp     = mti_FindPort(ports, "pdp");
+	mmu_ip->pfla    = mti_CreateDriver(mti_FindPort(ports, "pfla"));
+	mmu_ip->pfla_wr = mti_CreateDriver(mti_FindPort(ports, "pfla_wr"));
+
+	/* These processes are immediate so that the decoded copies are updated before the memory process runs on the same delta */
+	mtiProcessIdT en_process  = mti_CreateProcessWithPriority("mmu_en_p", mmu_on_en, mmu_ip, MTI_PROC_IMMEDIATE);
+	mtiProcessIdT pdp_process = mti_CreateProcessWithPriority("mmu_pdp_p", mmu_on_pdp, mmu_ip, MTI_PROC_IMMEDIATE);
+	mti_Sensitize(en_process,  mmu_ip->en,  MTI_EVENT);
+	mti_Sensitize(pdp_process, mmu_ip->pdp, MTI_EVENT);
+}
+
+/*********************************/
+/* IO Controller:                */
+/*********************************/
+ioctrl_t * ioctrl_ip;
+
+static void io_controller_on_clk_fli(void * param) {
+	io_controller_on_clk((ioctrl_t *) param);
+}
+
+/* vsim command 'fisc_vga_dump <path>': dumps the VGA framebuffer into a PPM (see vga.h) */
+static void io_cmd_vga_dump(void * param) {
+	const char * path = (const char *)param;
+	path += strcspn(path, " \t");
+	path += strspn(path, " \t");
+	if(!*path)
+		printf("\n> Usage: fisc_vga_dump <path of the PPM>\n");
+	else
+		vga_dump(path);
+}
+
+void io_controller_init_vhd(
+	mtiRegionIdT region,
+	char * param,
+	mtiInterfaceListT * generics,
+	mtiInterfaceListT * ports
+) {
+	ioctrl_ip              = (ioctrl_t *)mti_Malloc(sizeof(ioctrl_t));
+	ioctrl_ip->clk         = mti_FindPort(ports, "clk");
+	ioctrl_ip->int_en      = mti_CreateDriver(mti_FindPort(ports, "int_en"));
+	ioctrl_ip->int_id      = mti_CreateDriver(mti_FindPort(ports, "int_id"));
+	ioctrl_ip->int_type    = mti_CreateDriver(mti_FindPort(ports, "int_type"));
+	ioctrl_ip->int_ack     = mti_FindPort(ports, "int_ack");
+	ioctrl_ip->int_ack_id  = mti_FindPort(ports, "int_ack_id");
+	ioctrl_ip->ex_enabled  = mti_FindPort(ports, "ex_enabled");
+	ioctrl_ip->int_enabled = mti_FindPort(ports, "int_enabled");
+
+	io_controller_setup();
+	mti_AddCommand("fisc_vga_dump", io_cmd_vga_dump);
+
+	mtiProcessIdT io_proc_onclk = mti_CreateProcess("ioctrl_p_onclk", io_controller_on_clk_fli, ioctrl_ip);
+	mti_Sensitize(io_proc_onclk, ioctrl_ip->clk, MTI_EVENT);
+}
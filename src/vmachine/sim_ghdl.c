@@ -0,0 +1,181 @@
+/*
+ * sim_ghdl.c
+ *
+ *  Created on: 20/01/2017
+ *      Author: Miguel
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sim.h"
+#include "io_controller.h"
+#include "io_controller_rtl.h"
+#include "memory.h"
+#include "mmu.h"
+#include "runctl.h"
+
+/* GHDL backend (see sim.h). The architectures of rtl/ghdl/ call these through VHPIDIRECT (rtl/ghdl/vhpi.vhd).
+ * GHDL passes an input std_logic by value, a constrained std_logic_vector as a pointer to its values, and an output
+ * as a pointer to the variable which the architecture assigns into the port afterwards. The vm_* entry points only
+ * repoint the ports at these before running the same code as the FLI backend */
+
+#if SIM_BACKEND == SIM_GHDL
+
+/* Widths of the ports, as declared by the entities: */
+#define GHDL_MEM_ADDRESS_SZ 23
+#define GHDL_INTEGER_SZ     64 /* FISC_INTEGER_SZ */
+
+/*********************************/
+/* Simulator:                    */
+/*********************************/
+
+/* GHDL can not be told to finish from a foreign subprogram, so the simulation ends here (the devices are already down).
+ * The exit status is 0 when the run control stopped it */
+void sim_quit(void) {
+	fflush(stdout);
+	exit(runctl_stop_reason == STOP_NONE);
+}
+
+/* There is no prompt to break back into */
+void sim_break(void) {
+	vm_cleanup();
+	sim_quit();
+}
+
+/* The RTL's state lives in GHDL, which can not save it */
+char sim_checkpoint(const char * path) {
+	return 0;
+}
+
+static inline sim_signal_t ghdl_signal(sim_ghdl_signal_t * sig, uint32_t size) {
+	sig->size = size;
+	return sig;
+}
+
+static inline sim_driver_t ghdl_driver(sim_ghdl_driver_t * drv, uint32_t index) {
+	drv->index = index;
+	return drv;
+}
+
+/*********************************/
+/* Memory:                       */
+/*********************************/
+static memory_t          mem_ports;
+static sim_ghdl_signal_t mem_in[9];
+static sim_ghdl_driver_t mem_out[3];
+static char              mem_bits[3]; /* The scalar inputs */
+
+void vm_memory_init(int32_t depth, int32_t max_cycles, int32_t stop_on_halt, int32_t stop_pc, int32_t checkpoint_interval) {
+	const char * names[]  = { "max_cycles", "stop_on_halt", "stop_pc", "checkpoint_interval" };
+	const int32_t values[] = { max_cycles, stop_on_halt, stop_pc, checkpoint_interval };
+
+	/* The generics of the Memory entity, as the FLI backend takes them (see runctl.h): */
+	for(uint32_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+		char value[24];
+		snprintf(value, sizeof(value), "%ld", (long)values[i]);
+		runctl_set(names[i], value);
+	}
+	memory_setup(depth > 0 ? (uint64_t)depth : MEMORY_DEPTH);
+
+	mem_ports.clk            = ghdl_signal(&mem_in[0], 1);
+	mem_ports.en             = ghdl_signal(&mem_in[1], 2);
+	mem_ports.wr             = ghdl_signal(&mem_in[2], 1);
+	mem_ports.rd             = ghdl_signal(&mem_in[3], 2);
+	mem_ports.address1       = ghdl_signal(&mem_in[4], GHDL_MEM_ADDRESS_SZ);
+	mem_ports.address2       = ghdl_signal(&mem_in[5], GHDL_MEM_ADDRESS_SZ);
+	mem_ports.data_in        = ghdl_signal(&mem_in[6], GHDL_INTEGER_SZ);
+	mem_ports.access_width   = ghdl_signal(&mem_in[7], 2);
+	mem_ports.alignment_flag = ghdl_signal(&mem_in[8], 1);
+	mem_ports.data_out1      = ghdl_driver(&mem_out[0], 0);
+	mem_ports.data_out2      = ghdl_driver(&mem_out[1], 1);
+	mem_ports.ready          = ghdl_driver(&mem_out[2], 2);
+
+	mem_in[0].sigv = &mem_bits[0];
+	mem_in[2].sigv = &mem_bits[1];
+	mem_in[8].sigv = &mem_bits[2];
+}
+
+void vm_memory_on_clk(
+	uint8_t clk, const char * en, uint8_t wr, const char * rd, char * ready,
+	const char * address1, const char * address2, const char * data_in, char * data_out1, char * data_out2,
+	const char * access_width, uint8_t alignment_flag, int32_t * drive
+) {
+	mem_bits[0] = clk;
+	mem_bits[1] = wr;
+	mem_bits[2] = alignment_flag;
+	mem_in[1].sigv = en;
+	mem_in[3].sigv = rd;
+	mem_in[4].sigv = address1;
+	mem_in[5].sigv = address2;
+	mem_in[6].sigv = data_in;
+	mem_in[7].sigv = access_width;
+
+	*drive = 0;
+	mem_out[0].sigv = data_out1;
+	mem_out[1].sigv = data_out2;
+	mem_out[2].sigv = ready;
+	mem_out[0].flags = mem_out[1].flags = mem_out[2].flags = drive;
+
+	memory_on_clock(&mem_ports);
+}
+
+/*********************************/
+/* MMU:                          */
+/*********************************/
+
+/* Runs whenever the wire EN changes (paging toggled through the CPSR) */
+void vm_mmu_on_en(uint8_t en) {
+	mmu_set_enabled(en & 0x1);
+}
+
+/* Runs whenever the wire PDP changes (LPDP instruction) */
+void vm_mmu_on_pdp(const char * pdp) {
+	mmu_set_pdp(sigv_decode(pdp, GHDL_INTEGER_SZ));
+}
+
+/*********************************/
+/* IO Controller:                */
+/*********************************/
+static ioctrl_t          ioctrl_ports;
+static sim_ghdl_signal_t ioctrl_in[5];
+static sim_ghdl_driver_t ioctrl_out[3];
+static char              ioctrl_bits[4]; /* The scalar inputs */
+
+void vm_io_controller_init(void) {
+	ioctrl_ports.clk         = ghdl_signal(&ioctrl_in[0], 1);
+	ioctrl_ports.int_ack     = ghdl_signal(&ioctrl_in[1], 1);
+	ioctrl_ports.int_ack_id  = ghdl_signal(&ioctrl_in[2], 8);
+	ioctrl_ports.ex_enabled  = ghdl_signal(&ioctrl_in[3], 1);
+	ioctrl_ports.int_enabled = ghdl_signal(&ioctrl_in[4], 1);
+	ioctrl_ports.int_en      = ghdl_driver(&ioctrl_out[0], 0);
+	ioctrl_ports.int_id      = ghdl_driver(&ioctrl_out[1], 1);
+	ioctrl_ports.int_type    = ghdl_driver(&ioctrl_out[2], 2);
+
+	ioctrl_in[0].sigv = &ioctrl_bits[0];
+	ioctrl_in[1].sigv = &ioctrl_bits[1];
+	ioctrl_in[3].sigv = &ioctrl_bits[2];
+	ioctrl_in[4].sigv = &ioctrl_bits[3];
+
+	io_controller_setup();
+}
+
+void vm_io_controller_on_clk(
+	uint8_t clk, char * int_en, char * int_id, char * int_type, uint8_t int_ack, const char * int_ack_id,
+	uint8_t ex_enabled, uint8_t int_enabled, int32_t * drive
+) {
+	ioctrl_bits[0] = clk;
+	ioctrl_bits[1] = int_ack;
+	ioctrl_bits[2] = ex_enabled;
+	ioctrl_bits[3] = int_enabled;
+	ioctrl_in[2].sigv = int_ack_id;
+
+	*drive = 0;
+	ioctrl_out[0].sigv = int_en;
+	ioctrl_out[1].sigv = int_id;
+	ioctrl_out[2].sigv = int_type;
+	ioctrl_out[0].flags = ioctrl_out[1].flags = ioctrl_out[2].flags = drive;
+
+	io_controller_on_clk(&ioctrl_ports);
+}
+
+#endif
@@ -0,0 +1,220 @@
+/*
+ * sim_verilator.c
+ *
+ *  Created on: 21/01/2017
+ *      Author: Miguel
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sim.h"
+#include "io_controller.h"
+#include "io_controller_rtl.h"
+#include "memory.h"
+#include "mmu.h"
+#include "runctl.h"
+
+/* Verilator backend (see sim.h). The core is compiled into a C++ model by Verilator, and the DPI-C shells of
+ * rtl/verilator/ call these on both edges of the clock. The harness (sim_verilator_main.cpp) runs the clock, and right
+ * before each edge it assigns the outputs which were delayed into it through vm_verilator_apply */
+
+#if SIM_BACKEND == SIM_VERILATOR
+#include "svdpi.h"
+
+/* Exported by the shells (rtl/verilator/memory.sv and rtl/verilator/io_controller.sv): */
+extern void vm_memory_apply(long long data_out1, long long data_out2, int ready, int drive);
+extern void vm_io_controller_apply(svBit int_en, int int_id, int int_type, int drive);
+
+static char vm_stopped = 0;
+
+/*********************************/
+/* Simulator:                    */
+/*********************************/
+
+/* The harness ends the simulation after the current edge (the devices are already down) */
+void sim_quit(void) {
+	fflush(stdout);
+	vm_stopped = 1;
+}
+
+/* There is no prompt to break back into */
+void sim_break(void) {
+	vm_cleanup();
+	sim_quit();
+}
+
+/* The core's state lives in the C++ model, which can not save it */
+char sim_checkpoint(const char * path) {
+	return 0;
+}
+
+/* Returns 1 once the simulation should end. The exit status is 0 when the run control stopped it */
+int vm_verilator_stopped(int * status) {
+	*status = runctl_stop_reason == STOP_NONE;
+	return vm_stopped;
+}
+
+/* Splits what the C side drove into the outputs of this edge, and the ones delayed into the next edge */
+static int32_t split_drive(int32_t drive, int32_t * pending) {
+	int32_t now = 0;
+	for(uint32_t index = 0; index < 16; index++) {
+		if(!((drive >> (index * 2)) & SIM_DRIVE_EN))
+			continue;
+		if((drive >> (index * 2)) & SIM_DRIVE_DELAY)
+			*pending |= SIM_DRIVE_EN << (index * 2);
+		else
+			now |= SIM_DRIVE_EN << (index * 2);
+	}
+	return now;
+}
+
+/*********************************/
+/* Memory:                       */
+/*********************************/
+static memory_t               mem_ports;
+static sim_verilator_signal_t mem_in[9];
+static sim_verilator_driver_t mem_out[3];
+static int32_t                mem_drive;
+static int32_t                mem_pending;
+static svScope                mem_scope;
+
+void vm_memory_init(int depth, int max_cycles, int stop_on_halt, int stop_pc, int checkpoint_interval) {
+	const char * names[]  = { "max_cycles", "stop_on_halt", "stop_pc", "checkpoint_interval" };
+	const int32_t values[] = { max_cycles, stop_on_halt, stop_pc, checkpoint_interval };
+
+	/* The parameters of the shell, which are the generics of the Memory entity (see runctl.h): */
+	for(uint32_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+		char value[24];
+		snprintf(value, sizeof(value), "%ld", (long)values[i]);
+		runctl_set(names[i], value);
+	}
+	memory_setup(depth > 0 ? (uint64_t)depth : MEMORY_DEPTH);
+	mem_scope = svGetScope();
+
+	mem_ports.clk            = &mem_in[0];
+	mem_ports.en             = &mem_in[1];
+	mem_ports.wr             = &mem_in[2];
+	mem_ports.rd             = &mem_in[3];
+	mem_ports.address1       = &mem_in[4];
+	mem_ports.address2       = &mem_in[5];
+	mem_ports.data_in        = &mem_in[6];
+	mem_ports.access_width   = &mem_in[7];
+	mem_ports.alignment_flag = &mem_in[8];
+	mem_ports.data_out1      = &mem_out[0];
+	mem_ports.data_out2      = &mem_out[1];
+	mem_ports.ready          = &mem_out[2];
+	for(uint32_t i = 0; i < 3; i++) {
+		mem_out[i].flags = &mem_drive;
+		mem_out[i].index = i;
+	}
+}
+
+/* Returns the outputs which the shell assigns on this edge */
+int vm_memory_on_clk(
+	svBit clk, int en, svBit wr, int rd, long long address1, long long address2, long long data_in,
+	int access_width, svBit alignment_flag, long long * data_out1, long long * data_out2, int * ready
+) {
+	if(vm_stopped)
+		return 0;
+	mem_in[0].value = clk;
+	mem_in[1].value = (uint32_t)en;
+	mem_in[2].value = wr;
+	mem_in[3].value = (uint32_t)rd;
+	mem_in[4].value = (uint64_t)address1;
+	mem_in[5].value = (uint64_t)address2;
+	mem_in[6].value = (uint64_t)data_in;
+	mem_in[7].value = (uint32_t)access_width;
+	mem_in[8].value = alignment_flag;
+
+	mem_drive = 0;
+	memory_on_clock(&mem_ports);
+
+	*data_out1 = (long long)mem_out[0].value;
+	*data_out2 = (long long)mem_out[1].value;
+	*ready     = (int)mem_out[2].value;
+	return split_drive(mem_drive, &mem_pending);
+}
+
+/*********************************/
+/* MMU:                          */
+/*********************************/
+
+/* Runs whenever the wire EN changes (paging toggled through the CPSR) */
+void vm_mmu_on_en(svBit en) {
+	mmu_set_enabled(en & 0x1);
+}
+
+/* Runs whenever the wire PDP changes (LPDP instruction) */
+void vm_mmu_on_pdp(long long pdp) {
+	mmu_set_pdp((uint64_t)pdp);
+}
+
+/*********************************/
+/* IO Controller:                */
+/*********************************/
+static ioctrl_t               ioctrl_ports;
+static sim_verilator_signal_t ioctrl_in[5];
+static sim_verilator_driver_t ioctrl_out[3];
+static int32_t                ioctrl_drive;
+static int32_t                ioctrl_pending;
+static svScope                ioctrl_scope;
+
+void vm_io_controller_init(void) {
+	ioctrl_scope = svGetScope();
+
+	ioctrl_ports.clk         = &ioctrl_in[0];
+	ioctrl_ports.int_ack     = &ioctrl_in[1];
+	ioctrl_ports.int_ack_id  = &ioctrl_in[2];
+	ioctrl_ports.ex_enabled  = &ioctrl_in[3];
+	ioctrl_ports.int_enabled = &ioctrl_in[4];
+	ioctrl_ports.int_en      = &ioctrl_out[0];
+	ioctrl_ports.int_id      = &ioctrl_out[1];
+	ioctrl_ports.int_type    = &ioctrl_out[2];
+	for(uint32_t i = 0; i < 3; i++) {
+		ioctrl_out[i].flags = &ioctrl_drive;
+		ioctrl_out[i].index = i;
+	}
+
+	io_controller_setup();
+}
+
+int vm_io_controller_on_clk(
+	svBit clk, svBit int_ack, int int_ack_id, svBit ex_enabled, svBit int_enabled,
+	svBit * int_en, int * int_id, int * int_type
+) {
+	if(vm_stopped)
+		return 0;
+	ioctrl_in[0].value = clk;
+	ioctrl_in[1].value = int_ack;
+	ioctrl_in[2].value = (uint32_t)int_ack_id;
+	ioctrl_in[3].value = ex_enabled;
+	ioctrl_in[4].value = int_enabled;
+
+	ioctrl_drive = 0;
+	io_controller_on_clk(&ioctrl_ports);
+
+	*int_en   = (svBit)ioctrl_out[0].value;
+	*int_id   = (int)ioctrl_out[1].value;
+	*int_type = (int)ioctrl_out[2].value;
+	return split_drive(ioctrl_drive, &ioctrl_pending);
+}
+
+/*********************************/
+/* Harness:                      */
+/*********************************/
+
+/* Assigns the outputs which were delayed into the coming edge, so the core sees them together with the clock */
+void vm_verilator_apply(void) {
+	if(mem_pending) {
+		svSetScope(mem_scope);
+		vm_memory_apply((long long)mem_out[0].value, (long long)mem_out[1].value, (int)mem_out[2].value, mem_pending);
+		mem_pending = 0;
+	}
+	if(ioctrl_pending) {
+		svSetScope(ioctrl_scope);
+		vm_io_controller_apply((svBit)ioctrl_out[0].value, (int)ioctrl_out[1].value, (int)ioctrl_out[2].value, ioctrl_pending);
+		ioctrl_pending = 0;
+	}
+}
+
+#endif
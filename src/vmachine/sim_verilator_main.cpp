@@ -0,0 +1,42 @@
+/*
+ * sim_verilator_main.cpp
+ *
+ *  Created on: 21/01/2017
+ *      Author: Miguel
+ */
+#include <stdio.h>
+#include "verilated.h"
+#include "Vfisc.h"
+
+/* Harness of the core compiled by Verilator. It stands in for rtl/top.vhd: it runs the clock and kickstarts the CPU,
+ * while the Memory, IO Controller and MMU call into the virtual machine through their DPI-C shells (see sim_verilator.c) */
+
+extern "C" {
+	int  vm_verilator_stopped(int * status);
+	void vm_verilator_apply(void);
+}
+
+int main(int argc, char ** argv) {
+	Verilated::commandArgs(argc, argv);
+	Vfisc * core = new Vfisc;
+	int status = 0;
+
+	/* The initial blocks of the shells bring up the virtual machine: */
+	core->clk         = 0;
+	core->restart_cpu = 0;
+	core->pause       = 1;
+	core->eval();
+
+	/* Go! */
+	core->pause = 0;
+	while(!vm_verilator_stopped(&status) && !Verilated::gotFinish()) {
+		/* Every edge of rtl/top.vhd's clock. The outputs which the C side delayed into this edge change together with it: */
+		vm_verilator_apply();
+		core->clk = !core->clk;
+		core->eval();
+	}
+
+	core->final();
+	delete core;
+	return status;
+}
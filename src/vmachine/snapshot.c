@@ -0,0 +1,205 @@
+/*
+ * snapshot.c
+ *
+ *  Created on: 14/01/2017
+ *      Author: Miguel
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+#include "snapshot.h"
+#include "bus.h"
+#include "io_controller.h"
+#include "irq_queue.h"
+#include "memstore.h"
+#include "mmu.h"
+#include "../iss/iss.h"
+#include "../iss/block_cache.h"
+
+/*********************************/
+/* Built-in sections:            */
+/*********************************/
+
+/* Main Memory: its size, then every page which is not all zeroes (the untouched sparse pages are skipped without looking) */
+static char mem_save(snapshot_stream_t * s) {
+	uint64_t end = SNAPSHOT_END;
+	if(!snapshot_write(s, &memory_depth, sizeof(memory_depth)))
+		return 0;
+	for(uint64_t address = memstore_next_page(0); address < memory_depth; address = memstore_next_page(address + MEMSTORE_PAGE_SIZE)) {
+		uint32_t len = memory_depth - address < MEMSTORE_PAGE_SIZE ? memory_depth - address : MEMSTORE_PAGE_SIZE;
+		const uint8_t * page = memstore_ptr(address, len, 0);
+		if(!memcmp(page, memstore_zero_page, len))
+			continue;
+		if(!snapshot_write(s, &address, sizeof(address)) || !snapshot_write(s, page, len))
+			return 0;
+	}
+	return snapshot_write(s, &end, sizeof(end));
+}
+
+static char mem_restore(snapshot_stream_t * s) {
+	static uint8_t page[MEMSTORE_PAGE_SIZE];
+	uint64_t depth, address = 0;
+
+	if(!snapshot_read(s, &depth, sizeof(depth)))
+		return 0;
+	if(depth != memory_depth) {
+		printf("\n> ERROR: The snapshot holds %" PRIu64 " bytes of Main Memory, but the Main Memory is %" PRIu64 " bytes long\n",
+			depth, memory_depth);
+		return 0;
+	}
+
+	/* The pages which were all zeroes were not saved, so start from a clear memory: */
+	memstore_reset();
+	if(memstore_backing == BACKING_FILE)
+		bus_write_block(0, 0, memory_depth);
+
+	while(snapshot_read(s, &address, sizeof(address)) && address != SNAPSHOT_END) {
+		uint32_t len = memory_depth - address < MEMSTORE_PAGE_SIZE ? memory_depth - address : MEMSTORE_PAGE_SIZE;
+		if(address >= memory_depth || !snapshot_read(s, page, len) || !bus_write_block(address, page, len))
+			return 0;
+	}
+	return address == SNAPSHOT_END;
+}
+
+/* MMU: its input wires (the TLB is simply flushed) */
+static char mmu_save(snapshot_stream_t * s) {
+	return snapshot_write(s, &mmu_enabled, sizeof(mmu_enabled)) && snapshot_write(s, &mmu_pdp, sizeof(mmu_pdp));
+}
+
+static char mmu_restore(snapshot_stream_t * s) {
+	uint8_t  enabled;
+	uint64_t pdp;
+	if(!snapshot_read(s, &enabled, sizeof(enabled)) || !snapshot_read(s, &pdp, sizeof(pdp)))
+		return 0;
+	mmu_set_enabled(enabled);
+	mmu_set_pdp(pdp);
+	tlb_flush(); /* The page tables may have changed along with the memory */
+	return 1;
+}
+
+/* Instruction Set Simulator: its architectural state. The pre-decoded blocks are dropped */
+static char iss_save(snapshot_stream_t * s) {
+	uint32_t size = sizeof(fisc_cpu_t);
+	iss_flags_sync(&cpu);
+	return snapshot_write(s, &size, sizeof(size)) && snapshot_write(s, &cpu, size);
+}
+
+static char iss_restore(snapshot_stream_t * s) {
+	uint32_t size;
+	if(!snapshot_read(s, &size, sizeof(size)) || size != sizeof(fisc_cpu_t) || !snapshot_read(s, &cpu, size))
+		return 0;
+	/* Interrupt requests belong to the devices of the process which took the snapshot: */
+	irq_clear();
+	cpu.irq_pending = 0;
+	block_cache_flush();
+	return 1;
+}
+
+/*********************************/
+/* Sections and streams:         */
+/*********************************/
+typedef struct {
+	uint32_t      tag;
+	snapshot_fn_t save;
+	snapshot_fn_t restore;
+} snapshot_section_t;
+
+static snapshot_section_t sections[SNAPSHOT_MAX_SECTIONS] = {
+	{ SNAPSHOT_TAG('M', 'E', 'M', ' '), mem_save,         mem_restore         },
+	{ SNAPSHOT_TAG('M', 'M', 'U', ' '), mmu_save,         mmu_restore         },
+	{ SNAPSHOT_TAG('I', 'O', 'D', 'V'), io_snapshot_save, io_snapshot_restore },
+	{ SNAPSHOT_TAG('I', 'S', 'S', ' '), iss_save,         iss_restore         },
+};
+static uint32_t section_count = 4;
+
+/* Adds (or replaces) a section of the front-end */
+char snapshot_add_section(uint32_t tag, snapshot_fn_t save, snapshot_fn_t restore) {
+	uint32_t i;
+	for(i = 0; i < section_count && sections[i].tag != tag; i++);
+	if(i == SNAPSHOT_MAX_SECTIONS)
+		return 0;
+	sections[i].tag     = tag;
+	sections[i].save    = save;
+	sections[i].restore = restore;
+	if(i == section_count)
+		section_count++;
+	return 1;
+}
+
+char snapshot_save_stream(snapshot_stream_t * s) {
+	uint32_t version = SNAPSHOT_VERSION;
+	uint32_t end     = SNAPSHOT_TAG_END;
+	if(!snapshot_write(s, SNAPSHOT_MAGIC, 8) || !snapshot_write(s, &version, sizeof(version)))
+		return 0;
+	for(uint32_t i = 0; i < section_count; i++)
+		if(!snapshot_write(s, &sections[i].tag, sizeof(uint32_t)) || !sections[i].save(s))
+			return 0;
+	return snapshot_write(s, &end, sizeof(end));
+}
+
+char snapshot_restore_stream(snapshot_stream_t * s) {
+	char     magic[8];
+	uint32_t version, tag;
+
+	if(!snapshot_read(s, magic, sizeof(magic)) || memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic))
+		|| !snapshot_read(s, &version, sizeof(version)) || version != SNAPSHOT_VERSION)
+	{
+		printf("\n> ERROR: Not a snapshot, or it was taken by another version\n");
+		return 0;
+	}
+
+	while(snapshot_read(s, &tag, sizeof(tag))) {
+		if(tag == SNAPSHOT_TAG_END)
+			return 1;
+		uint32_t i;
+		for(i = 0; i < section_count && sections[i].tag != tag; i++);
+		if(i == section_count) {
+			printf("\n> ERROR: The snapshot has the unknown section '%c%c%c%c'\n", tag >> 24, (tag >> 16) & 0xFF, (tag >> 8) & 0xFF, tag & 0xFF);
+			return 0;
+		}
+		if(!sections[i].restore(s)) {
+			printf("\n> ERROR: Could not restore the section '%c%c%c%c' of the snapshot\n", tag >> 24, (tag >> 16) & 0xFF, (tag >> 8) & 0xFF, tag & 0xFF);
+			return 0;
+		}
+	}
+	printf("\n> ERROR: The snapshot is truncated\n");
+	return 0;
+}
+
+static char file_write(snapshot_stream_t * s, const void * data, uint32_t len) {
+	return fwrite(data, 1, len, (FILE *)s->handle) == len;
+}
+
+static char file_read(snapshot_stream_t * s, void * data, uint32_t len) {
+	return fread(data, 1, len, (FILE *)s->handle) == len;
+}
+
+char snapshot_save(const char * path) {
+	snapshot_stream_t s = { file_write, file_read, fopen(path, "wb") };
+	if(!s.handle) {
+		printf("\n> ERROR: Could not create the snapshot '%s'\n", path);
+		return 0;
+	}
+	char ret = snapshot_save_stream(&s);
+	if(fclose((FILE *)s.handle) || !ret) {
+		printf("\n> ERROR: Could not write the snapshot '%s'\n", path);
+		return 0;
+	}
+	printf("\n> Saved the snapshot '%s'\n", path);
+	return 1;
+}
+
+char snapshot_restore(const char * path) {
+	snapshot_stream_t s = { file_write, file_read, fopen(path, "rb") };
+	if(!s.handle) {
+		printf("\n> ERROR: Could not open the snapshot '%s'\n", path);
+		return 0;
+	}
+	char ret = snapshot_restore_stream(&s);
+	fclose((FILE *)s.handle);
+	if(ret)
+		printf("\n> Restored the snapshot '%s'\n", path);
+	return ret;
+}
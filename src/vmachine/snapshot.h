@@ -0,0 +1,53 @@
+/*
+ * snapshot.h
+ *
+ *  Created on: 14/01/2017
+ *      Author: Miguel
+ */
+
+#ifndef SRC_VMACHINE_SNAPSHOT_H_
+#define SRC_VMACHINE_SNAPSHOT_H_
+
+#include <stdint.h>
+
+/* Snapshots of the whole virtual machine: the Main Memory (only its non zero pages), the MMU's inputs, the devices,
+ * the architectural state of the Instruction Set Simulator, plus any section which a front-end adds (snapshot_add_section).
+ *
+ * A snapshot is a header followed by tagged sections, each one written and read back by its owner. The sections are not
+ * self describing, so a snapshot can only be restored by a build which has the same sections (SNAPSHOT_VERSION).
+ * The same sections go into snapshot files (snapshot_save / snapshot_restore, 'fiscsim -S / -R' and the vsim commands of
+ * snapshot_fli.c) and into vsim's own checkpoints */
+
+#define SNAPSHOT_MAGIC        "FISCSNP1"
+#define SNAPSHOT_VERSION      6
+#define SNAPSHOT_MAX_SECTIONS 16
+#define SNAPSHOT_END          0xFFFFFFFF /* Ends a list of pages (or rows) inside a section */
+
+#define SNAPSHOT_TAG(a, b, c, d) (((uint32_t)(a) << 24) | ((uint32_t)(b) << 16) | ((uint32_t)(c) << 8) | (uint32_t)(d))
+#define SNAPSHOT_TAG_END          SNAPSHOT_TAG('E', 'N', 'D', ' ')
+
+/* Where a snapshot goes to (or comes from). Every read must mirror the write which stored it */
+typedef struct snapshot_stream {
+	char (*write)(struct snapshot_stream * s, const void * data, uint32_t len);
+	char (*read) (struct snapshot_stream * s, void * data, uint32_t len);
+	void * handle;
+} snapshot_stream_t;
+
+typedef char (*snapshot_fn_t)(snapshot_stream_t * s);
+
+char snapshot_add_section(uint32_t tag, snapshot_fn_t save, snapshot_fn_t restore);
+char snapshot_save_stream(snapshot_stream_t * s);
+char snapshot_restore_stream(snapshot_stream_t * s);
+char snapshot_save(const char * path);
+char snapshot_restore(const char * path);
+void snapshot_fli_init(void); /* Provided by snapshot_fli.c */
+
+static inline char snapshot_write(snapshot_stream_t * s, const void * data, uint32_t len) {
+	return s->write(s, data, len);
+}
+
+static inline char snapshot_read(snapshot_stream_t * s, void * data, uint32_t len) {
+	return s->read(s, data, len);
+}
+
+#endif /* SRC_VMACHINE_SNAPSHOT_H_ */
@@ -0,0 +1,67 @@
+/*
+ * snapshot_fli.c
+ *
+ *  Created on: 14/01/2017
+ *      Author: Miguel
+ */
+#include <mti.h>
+#include <stdio.h>
+#include <string.h>
+#include "snapshot.h"
+
+/* Snapshots from vsim:
+ *  fisc_save <path>:    saves the virtual machine into a snapshot file
+ *  fisc_restore <path>: restores the virtual machine from a snapshot file. The RTL keeps its own state, so this is meant
+ *                       for a design which was just loaded (or restarted)
+ * vsim's 'checkpoint' and 'restore' commands carry the same snapshot, together with the RTL's state */
+
+static char mti_write(snapshot_stream_t * s, const void * data, uint32_t len) {
+	mti_SaveBlock((char *)data, len);
+	return 1;
+}
+
+static char mti_read(snapshot_stream_t * s, void * data, uint32_t len) {
+	mti_RestoreBlock((char *)data);
+	return 1;
+}
+
+static snapshot_stream_t mti_stream = { mti_write, mti_read, 0 };
+
+static void snapshot_on_checkpoint(void * param) {
+	snapshot_save_stream(&mti_stream);
+}
+
+static void snapshot_on_restore(void * param) {
+	if(!snapshot_restore_stream(&mti_stream))
+		mti_Break();
+}
+
+/* The callback gets the whole command line. Returns the argument which follows the command */
+static const char * command_argument(const char * command_line) {
+	const char * arg = command_line + strcspn(command_line, " \t");
+	arg += strspn(arg, " \t");
+	return *arg ? arg : 0;
+}
+
+static void snapshot_cmd_save(void * param) {
+	const char * path = command_argument((const char *)param);
+	if(!path)
+		printf("\n> Usage: fisc_save <path of the snapshot>\n");
+	else
+		snapshot_save(path);
+}
+
+static void snapshot_cmd_restore(void * param) {
+	const char * path = command_argument((const char *)param);
+	if(!path)
+		printf("\n> Usage: fisc_restore <path of the snapshot>\n");
+	else
+		snapshot_restore(path);
+}
+
+void snapshot_fli_init(void) {
+	mti_AddCommand("fisc_save",    snapshot_cmd_save);
+	mti_AddCommand("fisc_restore", snapshot_cmd_restore);
+	mti_AddSaveCB(snapshot_on_checkpoint, 0);
+	mti_AddRestoreCB(snapshot_on_restore, 0);
+}
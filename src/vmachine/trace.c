@@ -0,0 +1,185 @@
+/*
+ * trace.c
+ *
+ *  Created on: 12/01/2017
+ *      Author: Miguel
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+#include "trace.h"
+
+#if ENABLE_TRACE == 1
+uint8_t trace_mask = 0;
+#endif
+uint64_t trace_now = 0;
+
+/* Bounded lock-free ring. Several threads may produce (the simulator and the devices which raise interrupts),
+ * and the writer thread is the only consumer. Each slot carries a sequence number which tells whose turn it is:
+ *  seq == pos:     free, for the producer which claims the position 'pos'
+ *  seq == pos + 1: full, for the consumer */
+typedef struct {
+	uint64_t       seq;
+	trace_record_t record;
+} trace_slot_t;
+
+static trace_slot_t * ring = 0;
+static uint64_t       ring_head = 0; /* Next position to produce into */
+static uint64_t       ring_tail = 0; /* Next position to consume (only touched by the writer) */
+
+static FILE *   trace_file = 0;
+static thrd_t   trace_writer;
+static char     trace_running = 0;
+static char     trace_path[256];
+
+/* Trace statistics: */
+static uint64_t trace_records = 0;
+static uint64_t trace_dropped = 0;
+
+void trace_emit(const trace_record_t * record) {
+	if(!ring)
+		return;
+
+	uint64_t pos = __atomic_load_n(&ring_head, __ATOMIC_RELAXED);
+	for(;;) {
+		trace_slot_t * slot = &ring[pos & (TRACE_RING_SIZE - 1)];
+		int64_t dif = (int64_t)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - pos);
+		if(dif == 0) {
+			if(__atomic_compare_exchange_n(&ring_head, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				slot->record = *record;
+				__atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+				return;
+			}
+		} else if(dif < 0) {
+			/* The ring is full: the writer fell behind */
+			__atomic_add_fetch(&trace_dropped, 1, __ATOMIC_RELAXED);
+			return;
+		} else {
+			pos = __atomic_load_n(&ring_head, __ATOMIC_RELAXED);
+		}
+	}
+}
+
+/* Moves every record which is ready out of the ring and into the file */
+static uint32_t trace_drain(void) {
+	static trace_record_t batch[TRACE_BATCH_SIZE];
+	uint32_t total = 0;
+
+	for(;;) {
+		uint32_t count = 0;
+		while(count < TRACE_BATCH_SIZE) {
+			trace_slot_t * slot = &ring[ring_tail & (TRACE_RING_SIZE - 1)];
+			if(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != ring_tail + 1)
+				break;
+			batch[count++] = slot->record;
+			__atomic_store_n(&slot->seq, ring_tail + TRACE_RING_SIZE, __ATOMIC_RELEASE);
+			ring_tail++;
+		}
+		if(!count)
+			return total;
+		fwrite(batch, sizeof(trace_record_t), count, trace_file);
+		total += count;
+	}
+}
+
+static int trace_writer_thread(void * arg) {
+	const struct timespec idle = { 0, 1000000 }; /* 1 ms */
+	while(__atomic_load_n(&trace_running, __ATOMIC_ACQUIRE)) {
+		uint32_t count = trace_drain();
+		trace_records += count;
+		if(!count)
+			thrd_sleep(&idle, 0);
+	}
+	trace_records += trace_drain();
+	return 0;
+}
+
+static uint8_t trace_parse_categories(const char * list) {
+	static const struct { const char * name; uint8_t mask; } names[] = {
+		{ "mem", TRACE_MEM }, { "mmu", TRACE_MMU }, { "io", TRACE_IO }, { "irq", TRACE_IRQ },
+		{ "all", TRACE_MEM | TRACE_MMU | TRACE_IO | TRACE_IRQ }
+	};
+	uint8_t mask = 0;
+
+	while(*list) {
+		size_t len = strcspn(list, ",");
+		size_t i;
+		for(i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+			if(strlen(names[i].name) == len && !strncmp(list, names[i].name, len))
+				break;
+		if(i < sizeof(names) / sizeof(names[0]))
+			mask |= names[i].mask;
+		else if(len)
+			printf("\n> WARNING: Unknown trace category '%.*s' on %s\n", (int)len, list, TRACE_ENV_CATEGORIES);
+		list += len;
+		if(*list == ',')
+			list++;
+	}
+	return mask;
+}
+
+/* Opens the trace file and starts the writer thread, if any category was enabled */
+void trace_init(void) {
+#if ENABLE_TRACE == 1
+	const char * env = getenv(TRACE_ENV_CATEGORIES);
+	uint8_t mask = env ? trace_parse_categories(env) : 0;
+	if(!mask)
+		return;
+
+	env = getenv(TRACE_ENV_FILE);
+	trace_path[0] = 0;
+	strncat(trace_path, env && *env ? env : TRACE_DEFAULT_FILE, sizeof(trace_path) - 1);
+
+	trace_file = fopen(trace_path, "wb");
+	ring = calloc(TRACE_RING_SIZE, sizeof(trace_slot_t));
+	if(!trace_file || !ring) {
+		printf("\n> ERROR: Could not open the trace file '%s'. Tracing is disabled\n", trace_path);
+		if(trace_file) fclose(trace_file);
+		free(ring);
+		trace_file = 0;
+		ring = 0;
+		return;
+	}
+
+	trace_header_t header = { TRACE_MAGIC, sizeof(trace_record_t), 0 };
+	fwrite(&header, sizeof(header), 1, trace_file);
+
+	for(uint32_t i = 0; i < TRACE_RING_SIZE; i++)
+		ring[i].seq = i;
+	ring_head = ring_tail = 0;
+	trace_records = trace_dropped = 0;
+
+	trace_running = 1;
+	if(thrd_create(&trace_writer, trace_writer_thread, 0) != thrd_success) {
+		printf("\n> ERROR: Could not start the trace writer. Tracing is disabled\n");
+		trace_running = 0;
+		fclose(trace_file);
+		free(ring);
+		trace_file = 0;
+		ring = 0;
+		return;
+	}
+
+	trace_mask = mask;
+	printf("\n> Tracing into '%s' (%s='%s')\n", trace_path, TRACE_ENV_CATEGORIES, getenv(TRACE_ENV_CATEGORIES));
+#endif
+}
+
+/* Stops the writer after it has drained the ring, and closes the trace file */
+void trace_close(void) {
+	if(!trace_running)
+		return;
+#if ENABLE_TRACE == 1
+	trace_mask = 0;
+#endif
+	__atomic_store_n(&trace_running, 0, __ATOMIC_RELEASE);
+	thrd_join(trace_writer, 0);
+	fclose(trace_file);
+	free(ring);
+	trace_file = 0;
+	ring = 0;
+
+	printf("\n> Trace: %" PRIu64 " records written into '%s', %" PRIu64 " dropped", trace_records, trace_path, trace_dropped);
+}
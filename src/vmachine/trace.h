@@ -0,0 +1,93 @@
+/*
+ * trace.h
+ *
+ *  Created on: 12/01/2017
+ *      Author: Miguel
+ */
+
+#ifndef SRC_VMACHINE_TRACE_H_
+#define SRC_VMACHINE_TRACE_H_
+
+#include <stdint.h>
+#include "defines.h"
+
+/* Binary trace of the simulation. The simulator only copies a fixed size record into a lock-free ring, and a background
+ * thread writes the ring into the trace file. When the writer falls behind, the records which don't fit are dropped
+ * (and counted) instead of stalling the simulation. 'fisctrace' (trace_decode.c) turns the file back into text.
+ *
+ * Every category starts disabled, so by default the only cost is one test of trace_mask per event. Enable them with:
+ *  FISC_TRACE:      comma separated list of categories (mem, mmu, io, irq or all)
+ *  FISC_TRACE_FILE: path of the trace file (default: TRACE_DEFAULT_FILE) */
+
+#define TRACE_ENV_CATEGORIES "FISC_TRACE"
+#define TRACE_ENV_FILE       "FISC_TRACE_FILE"
+#define TRACE_DEFAULT_FILE   "bin/fisc.trace"
+
+#define TRACE_MAGIC      "FISCTRC1"
+#define TRACE_RING_SIZE  (1 << 16) /* Records (must be a power of 2) */
+#define TRACE_BATCH_SIZE 1024      /* Records which the writer thread hands to fwrite at once */
+
+enum TRACE_CATEGORY {
+	TRACE_MEM = 1 << 0, /* Main Memory accesses */
+	TRACE_MMU = 1 << 1, /* Address translations */
+	TRACE_IO  = 1 << 2, /* IO space accesses */
+	TRACE_IRQ = 1 << 3  /* Interrupt requests from the devices */
+};
+
+enum TRACE_KIND {
+	TR_RD_CH1,   /* Memory read from the fetch stage */
+	TR_RD_CH2,   /* Memory read from the memory access stage */
+	TR_WR,       /* Memory write */
+	TR_XLATE,    /* Virtual to physical translation */
+	TR_IRQ,      /* Interrupt request raised */
+	TR_IRQ_DROP  /* Interrupt request dropped because it is disabled */
+};
+
+enum TRACE_FLAGS {
+	TRF_FALLING_EDGE = 1 << 0, /* The event happened on the falling edge of the clock */
+	TRF_ALIGNED      = 1 << 1, /* Alignment was enabled on the access */
+	TRF_FAILED       = 1 << 2  /* The access did not complete */
+};
+
+/* One record of the trace file (stored in the host's byte order, after the file header) */
+typedef struct {
+	uint64_t cycle;        /* Clock edges since the simulation started */
+	uint64_t data;         /* Data of the access / device id of the interrupt */
+	uint64_t vaddress;
+	uint64_t paddress;
+	uint8_t  category;
+	uint8_t  kind;
+	uint8_t  access_width; /* Access width / type of the interrupt */
+	uint8_t  flags;
+	uint32_t reserved;
+} trace_record_t;
+
+typedef struct {
+	char     magic[8];
+	uint32_t record_size;
+	uint32_t reserved;
+} trace_header_t;
+
+#if ENABLE_TRACE == 1
+extern uint8_t trace_mask;
+#else
+#define trace_mask 0
+#endif
+
+extern uint64_t trace_now; /* Clock edges since the simulation started (kept up to date by the Memory's on_clock) */
+
+void trace_init(void);
+void trace_close(void);
+void trace_emit(const trace_record_t * record);
+
+/* The check is inlined, so a disabled category costs a single test */
+static inline void trace(uint8_t category, uint8_t kind, uint8_t flags,
+                         uint64_t vaddress, uint64_t paddress, uint8_t access_width, uint64_t data)
+{
+	if(!(trace_mask & category))
+		return;
+	trace_record_t record = { trace_now, data, vaddress, paddress, category, kind, access_width, flags, 0 };
+	trace_emit(&record);
+}
+
+#endif /* SRC_VMACHINE_TRACE_H_ */
@@ -0,0 +1,126 @@
+/*
+ * trace_decode.c
+ *
+ *  Created on: 12/01/2017
+ *      Author: Miguel
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "io_controller.h"
+#include "trace.h"
+
+/* fisctrace: prints a binary trace file (see trace.h) in the same text format as the old debug messages of the Memory */
+
+#define DECODE_BATCH_SIZE 4096
+
+static void print_access(const trace_record_t * r) {
+	const char * io = r->category == TRACE_IO ? "IO " : "";
+	int ae = (r->flags & TRF_ALIGNED) != 0;
+
+	switch(r->kind) {
+		case TR_XLATE:
+			printf("MMU:1 ");
+			break;
+		case TR_RD_CH1:
+			printf("%sRD CH1 (v@0x%llx p@0x%llx <%d>) = 0x%llx ", io, (unsigned long long)r->vaddress, (unsigned long long)r->paddress, r->access_width, (unsigned long long)r->data);
+			break;
+		case TR_RD_CH2:
+			printf("%sRD CH2 (ae: %d v@0x%llx p@0x%llx <%d>) = 0x%llx ", io, ae, (unsigned long long)r->vaddress, (unsigned long long)r->paddress, r->access_width, (unsigned long long)r->data);
+			break;
+		case TR_WR:
+			printf("%sWR (ae: %d v@0x%llx p@0x%llx <%d>) = 0x%llx ", io, ae, (unsigned long long)r->vaddress, (unsigned long long)r->paddress, r->access_width, (unsigned long long)r->data);
+			if(r->flags & TRF_FAILED)
+				printf("ERROR: Could not write to address v@0x%llx p@0x%llx ", (unsigned long long)r->vaddress, (unsigned long long)r->paddress);
+			break;
+	}
+}
+
+static void print_irq(const trace_record_t * r) {
+	/* The access width holds the type of the interrupt, and the data holds the device id */
+	if(r->kind == TR_IRQ)
+		printf("\n**** NOTICE: INTERRUPT (%s, devid: %d) ****\n", r->access_width == INT_ERR ? "EXC" : "IRQ", (int)r->data);
+	else if(r->access_width == INT_ERR)
+		printf("**** ERROR: Exceptions are disabled! Dropping the EX request... ****\n");
+	else
+		printf("**** ERROR: Interrupts are disabled! Dropping the IRQ request... ****\n");
+}
+
+static void usage(const char * prog) {
+	printf("Usage: %s [-c categories] [trace file]\n", prog);
+	printf("  -c  Only print these categories (comma separated list of mem, mmu, io and irq)\n");
+	printf("  trace file defaults to '%s'\n", TRACE_DEFAULT_FILE);
+}
+
+int main(int argc, char * argv[]) {
+	const char * path = TRACE_DEFAULT_FILE;
+	uint8_t mask = TRACE_MEM | TRACE_MMU | TRACE_IO | TRACE_IRQ;
+
+	for(int i = 1; i < argc; i++) {
+		if(!strcmp(argv[i], "-c") && i + 1 < argc) {
+			const char * list = argv[++i];
+			mask = 0;
+			if(strstr(list, "mem")) mask |= TRACE_MEM;
+			if(strstr(list, "mmu")) mask |= TRACE_MMU;
+			if(strstr(list, "io"))  mask |= TRACE_IO;
+			if(strstr(list, "irq")) mask |= TRACE_IRQ;
+		} else if(argv[i][0] == '-') {
+			usage(argv[0]);
+			return 1;
+		} else {
+			path = argv[i];
+		}
+	}
+
+	FILE * fptr = fopen(path, "rb");
+	if(!fptr) {
+		printf("ERROR: Couldn't open file '%s'!\n", path);
+		return 1;
+	}
+
+	trace_header_t header;
+	if(fread(&header, sizeof(header), 1, fptr) != 1 || memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic))
+		|| header.record_size != sizeof(trace_record_t))
+	{
+		printf("ERROR: '%s' is not a trace file (or it was written by another version)\n", path);
+		fclose(fptr);
+		return 1;
+	}
+
+	/* The accesses of the same clock edge go into the same line: */
+	static trace_record_t batch[DECODE_BATCH_SIZE];
+	uint64_t cycle = UINT64_MAX;
+	char     line_open = 0;
+	size_t   count;
+
+	while((count = fread(batch, sizeof(trace_record_t), DECODE_BATCH_SIZE, fptr))) {
+		for(size_t i = 0; i < count; i++) {
+			const trace_record_t * r = &batch[i];
+			if(!(r->category & mask))
+				continue;
+
+			if(line_open && (r->category == TRACE_IRQ || r->cycle != cycle)) {
+				printf("\n");
+				line_open = 0;
+			}
+
+			if(r->category == TRACE_IRQ) {
+				print_irq(r);
+				continue;
+			}
+
+			if(!line_open) {
+				printf("\n> %c Accessing Memory | ", (r->flags & TRF_FALLING_EDGE) ? '-' : '+');
+				cycle     = r->cycle;
+				line_open = 1;
+			}
+			print_access(r);
+		}
+	}
+	if(line_open)
+		printf("\n");
+
+	fclose(fptr);
+	return 0;
+}
@@ -0,0 +1,10 @@
+#!/bin/bash
+cd `dirname $0`
+clear
+
+cd ../..
+
+printf "***** Building Makefile (GHDL)... *****\n\n"
+make -f toolchain/makefile.mak ghdl
+
+printf "\n***** Done *****\n\n"
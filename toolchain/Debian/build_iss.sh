@@ -0,0 +1,10 @@
+#!/bin/bash
+cd `dirname $0`
+clear
+
+cd ../..
+
+printf "***** Building the Instruction Set Simulator... *****\n\n"
+make -f toolchain/makefile.mak iss
+
+printf "\n***** Done *****\n\n"
@@ -0,0 +1,10 @@
+#!/bin/bash
+cd `dirname $0`
+clear
+
+cd ../..
+
+printf "***** Building Makefile (Verilator)... *****\n\n"
+make -f toolchain/makefile.mak verilator
+
+printf "\n***** Done *****\n\n"
@@ -0,0 +1,6 @@
+#!/bin/bash
+cd `dirname $0`
+
+cd ../..
+
+make -f toolchain/makefile.mak verilator_run
@@ -0,0 +1,9 @@
+@cd "%~dp0"
+@echo off
+cls
+
+cd ..\..
+
+printf "\n>> Building the Instruction Set Simulator... <<\n"
+make -f toolchain/makefile.mak iss
+printf "\n"
@@ -1,17 +1,41 @@
-MODELSIM_PATH = C:\MentorGraphics
-MODELSIM_EXE_PATH = $(MODELSIM_PATH)/win32
-FLI_LIB_PATH = $(MODELSIM_EXE_PATH)/mtipli.dll
+# Host dependent settings. Windows builds a 32 bit libvm.dll for the Windows version of ModelSim, while Linux builds a
+# 64 bit libvm.so (position independent, and with the FLI resolved by vsim when it loads the library):
+ifeq ($(OS),Windows_NT)
+	PLATFORM = windows
+	MODELSIM_PATH ?= C:\MentorGraphics
+	MODELSIM_EXE_PATH = $(MODELSIM_PATH)/win32
+	FLI_LIB_PATH = $(MODELSIM_EXE_PATH)/mtipli.dll
+	SDL_CFLAGS =
+	SDL_LIB_PATH = -Llib/c_libs/SDL/i686-w64-mingw32/lib -lmingw32 -lSDL2 -lSDL2main
+	SDL_DLL = lib\c_libs\SDL\i686-w64-mingw32\bin\SDL2.dll
+	ARCHFLAGS = -m32
+	LIBVM = $(BIN)/libvm.dll
+	LIBVMFLAGS = -shared -Wl,-Bsymbolic -Wl,-export-all-symbols
+else
+	PLATFORM = linux
+	MODELSIM_PATH ?= /opt/modelsim
+	MODELSIM_EXE_PATH = $(MODELSIM_PATH)/bin
+	FLI_LIB_PATH =
+	SDL_CFLAGS = $(shell sdl2-config --cflags)
+	SDL_LIB_PATH = $(shell sdl2-config --libs) -lpthread
+	SDL_DLL =
+	ARCHFLAGS = -fPIC
+	LIBVM = $(BIN)/libvm.so
+	LIBVMFLAGS = -shared -Wl,-Bsymbolic
+endif
 VCOM = $(MODELSIM_EXE_PATH)/vcom
 VDEL = $(MODELSIM_EXE_PATH)/vdel
 VLIB = $(MODELSIM_EXE_PATH)/vlib
 VMAP = $(MODELSIM_EXE_PATH)/vmap
 VSIM = $(MODELSIM_EXE_PATH)/vsim
-VSIMCOMMANDS = log -r top/*; run 60000ms; quit -sim
+# Runs until the run control (src/vmachine/runctl.h) stops the simulation, taking the checkpoints which it asks for:
+VSIMCOMMANDS = log -r top/*; onbreak {resume}; while {1} {run -all; if {![info exists fisc_checkpoint]} break; checkpoint [set fisc_checkpoint]; unset fisc_checkpoint}; quit -sim
 
-ifeq ($(OS),Windows_NT)
-	SDL_LIB_PATH = -Llib/c_libs/SDL/i686-w64-mingw32/lib -lmingw32 -lSDL2 -lSDL2main
+# 'make FAST=1' builds for this host only, with link time optimization:
+ifeq ($(FAST),1)
+	OPTFLAGS = -O3 -march=native -flto
 else
-	SDL_LIB_PATH = -lSDL2 -lSDL2main
+	OPTFLAGS = -O2
 endif
 
 BIN = bin
@@ -20,46 +44,182 @@ WAVE = toolchain/Windows/Tools/gtkwave/bin/gtkwave
 WAVESPATH = waves
 LIBPATH = lib
 FLASM = toolchain/Windows/Tools/flasm
-CFLAGS = -I. -Ilib/c_libs -Ilib/c_libs/include -Ilib/c_libs/SDL -I$(MODELSIM_PATH)/include -g -O2 -Wall -std=c99
+CFLAGS = -I. -Ilib/c_libs -Ilib/c_libs/include -Ilib/c_libs/SDL $(SDL_CFLAGS) -I$(MODELSIM_PATH)/include -g $(OPTFLAGS) $(ARCHFLAGS) -Wall -std=c99
 
 # Virtual Machine's object files:
-VMOBJS = $(OBJ)/memory.o $(OBJ)/mmu.o $(OBJ)/utils.o $(OBJ)/tinycthread.o $(OBJ)/io_controller.o $(OBJ)/vga.o $(OBJ)/timer.o
+VMOBJS = $(OBJ)/memory.o $(OBJ)/bus.o $(OBJ)/memstore.o $(OBJ)/loader.o $(OBJ)/trace.o $(OBJ)/runctl.o $(OBJ)/scheduler.o $(OBJ)/snapshot.o $(OBJ)/snapshot_fli.o $(OBJ)/cosim.o $(OBJ)/cosim_fli.o $(OBJ)/iss.o $(OBJ)/block_cache.o $(OBJ)/jit.o $(OBJ)/mmu.o $(OBJ)/signal_conv.o $(OBJ)/sim_fli.o $(OBJ)/utils.o $(OBJ)/tinycthread.o $(OBJ)/io_controller.o $(OBJ)/io_controller_rtl.o $(OBJ)/irq_queue.o $(OBJ)/mmio_ring.o $(OBJ)/vga.o $(OBJ)/timer.o
+
+# The same for GHDL (see src/vmachine/sim.h). These are built for the host, into their own directory:
+GHDLOBJS = $(addprefix $(OBJ)/ghdl/, memory.o bus.o memstore.o loader.o trace.o runctl.o scheduler.o snapshot.o iss.o block_cache.o jit.o mmu.o signal_conv.o sim_ghdl.o utils.o tinycthread.o io_controller.o io_controller_rtl.o irq_queue.o mmio_ring.o vga.o timer.o)
+GHDLCFLAGS = $(filter-out -flto,$(CFLAGS)) -DSIM_BACKEND=SIM_GHDL
+
+# GHDL (LLVM or GCC backend, which link the foreign subprograms in). The architectures of rtl/ghdl replace the foreign ones:
+GHDL = ghdl
+GHDLFLAGS = --std=02 --ieee=synopsys -fexplicit --workdir=$(OBJ)/ghdl
+GHDLSIM = $(BIN)/fisc_ghdl
+comma := ,
+
+# And for Verilator, which compiles the core (converted into Verilog by GHDL's synthesis) into a cycle based C++ model:
+VLTOBJS = $(addprefix $(OBJ)/verilator/, $(subst sim_ghdl.o,sim_verilator.o,$(notdir $(GHDLOBJS))))
+VERILATOR = verilator
+VERILATOR_ROOT ?= /usr/share/verilator
+VLTCFLAGS = $(filter-out -flto,$(CFLAGS)) -DSIM_BACKEND=SIM_VERILATOR -I$(VERILATOR_ROOT)/include/vltstd
+GHDLSYNTHFLAGS = --std=08 -fsynopsys --workdir=$(OBJ)/verilator
+VLTSIM = $(BIN)/fisc_verilator
+
+# Instruction Set Simulator's object files (the same host side bus and devices, without the FLI):
+ISSOBJS = $(OBJ)/iss.o $(OBJ)/iss_main.o $(OBJ)/block_cache.o $(OBJ)/fanout.o $(OBJ)/jit.o $(OBJ)/bus.o $(OBJ)/irq_queue.o $(OBJ)/memstore.o $(OBJ)/loader.o $(OBJ)/scheduler.o $(OBJ)/snapshot.o $(OBJ)/mmu.o $(OBJ)/utils.o $(OBJ)/tinycthread.o $(OBJ)/io_controller.o $(OBJ)/mmio_ring.o $(OBJ)/vga.o $(OBJ)/timer.o
 
 BOOTLOADER:
 	@printf "> Compiling Bootloader: "
-	$(FLASM) ./src/boot/bootloader.fc -o $(BIN)/bootloader.bin -a
+	$(FLASM) ./src/boot/bootloader.fc -o $(BIN)/bootloader.bin
 
 ##### Compilation rules and objects: #####
 #__GENMAKE__
-BINS = $(OBJ)/foo.o \
+BINS = $(OBJ)/block_cache.o \
+	$(OBJ)/fanout.o \
+	$(OBJ)/iss.o \
+	$(OBJ)/iss_main.o \
+	$(OBJ)/jit.o \
+	$(OBJ)/foo.o \
+	$(OBJ)/bus.o \
+	$(OBJ)/cosim.o \
+	$(OBJ)/cosim_fli.o \
 	$(OBJ)/io_controller.o \
+	$(OBJ)/io_controller_rtl.o \
+	$(OBJ)/irq_queue.o \
+	$(OBJ)/loader.o \
 	$(OBJ)/memory.o \
+	$(OBJ)/memstore.o \
+	$(OBJ)/mmio_ring.o \
 	$(OBJ)/mmu.o \
+	$(OBJ)/runctl.o \
+	$(OBJ)/scheduler.o \
+	$(OBJ)/signal_conv.o \
+	$(OBJ)/sim_fli.o \
+	$(OBJ)/sim_ghdl.o \
+	$(OBJ)/sim_verilator.o \
+	$(OBJ)/snapshot.o \
+	$(OBJ)/snapshot_fli.o \
 	$(OBJ)/utils.o \
 	$(OBJ)/timer.o \
 	$(OBJ)/vga.o \
+	$(OBJ)/trace.o \
+	$(OBJ)/trace_decode.o \
 	$(OBJ)/tinycthread.o 
 
+$(OBJ)/block_cache.o: ./src/iss/block_cache.c
+	@printf "> Compiling C file 'src/iss/block_cache.c': "
+	gcc $(CFLAGS) -c $< -o $@
+
+$(OBJ)/fanout.o: ./src/iss/fanout.c
+	@printf "> Compiling C file 'src/iss/fanout.c': "
+	gcc $(CFLAGS) -c $< -o $@
+
+$(OBJ)/iss.o: ./src/iss/iss.c
+	@printf "> Compiling C file 'src/iss/iss.c': "
+	gcc $(CFLAGS) -c $< -o $@
+
+$(OBJ)/iss_main.o: ./src/iss/iss_main.c
+	@printf "> Compiling C file 'src/iss/iss_main.c': "
+	gcc $(CFLAGS) -c $< -o $@
+
+$(OBJ)/jit.o: ./src/iss/jit.c
+	@printf "> Compiling C file 'src/iss/jit.c': "
+	gcc $(CFLAGS) -c $< -o $@
+
 $(OBJ)/foo.o: ./src/userapps/foo.c
 	@printf "> Compiling C file 'src/userapps/foo.c': "
 	gcc $(CFLAGS) -c $< -o $@
 
+$(OBJ)/bus.o: ./src/vmachine/bus.c
+	@printf "> Compiling C file 'src/vmachine/bus.c': "
+	gcc $(CFLAGS) -c $< -o $@
+
+$(OBJ)/cosim.o: ./src/vmachine/cosim.c
+	@printf "> Compiling C file 'src/vmachine/cosim.c': "
+	gcc $(CFLAGS) -c $< -o $@
+
+$(OBJ)/cosim_fli.o: ./src/vmachine/cosim_fli.c
+	@printf "> Compiling C file 'src/vmachine/cosim_fli.c': "
+	gcc $(CFLAGS) -c $< -o $@
+
 $(OBJ)/io_controller.o: ./src/vmachine/io_controller.c
 	@printf "> Compiling C file 'src/vmachine/io_controller.c': "
 	gcc $(CFLAGS) -c $< -o $@
 
+$(OBJ)/io_controller_rtl.o: ./src/vmachine/io_controller_rtl.c
+	@printf "> Compiling C file 'src/vmachine/io_controller_rtl.c': "
+	gcc $(CFLAGS) -c $< -o $@
+
+$(OBJ)/irq_queue.o: ./src/vmachine/irq_queue.c
+	@printf "> Compiling C file 'src/vmachine/irq_queue.c': "
+	gcc $(CFLAGS) -c $< -o $@
+
+$(OBJ)/loader.o: ./src/vmachine/loader.c
+	@printf "> Compiling C file 'src/vmachine/loader.c': "
+	gcc $(CFLAGS) -c $< -o $@
+
 $(OBJ)/memory.o: ./src/vmachine/memory.c
 	@printf "> Compiling C file 'src/vmachine/memory.c': "
 	gcc $(CFLAGS) -c $< -o $@
 
+$(OBJ)/memstore.o: ./src/vmachine/memstore.c
+	@printf "> Compiling C file 'src/vmachine/memstore.c': "
+	gcc $(CFLAGS) -c $< -o $@
+
+$(OBJ)/mmio_ring.o: ./src/vmachine/mmio_ring.c
+	@printf "> Compiling C file 'src/vmachine/mmio_ring.c': "
+	gcc $(CFLAGS) -c $< -o $@
+
 $(OBJ)/mmu.o: ./src/vmachine/mmu.c
 	@printf "> Compiling C file 'src/vmachine/mmu.c': "
 	gcc $(CFLAGS) -c $< -o $@
 
+$(OBJ)/runctl.o: ./src/vmachine/runctl.c
+	@printf "> Compiling C file 'src/vmachine/runctl.c': "
+	gcc $(CFLAGS) -c $< -o $@
+
+$(OBJ)/scheduler.o: ./src/vmachine/scheduler.c
+	@printf "> Compiling C file 'src/vmachine/scheduler.c': "
+	gcc $(CFLAGS) -c $< -o $@
+
+$(OBJ)/signal_conv.o: ./src/vmachine/signal_conv.c
+	@printf "> Compiling C file 'src/vmachine/signal_conv.c': "
+	gcc $(CFLAGS) -c $< -o $@
+
+$(OBJ)/sim_fli.o: ./src/vmachine/sim_fli.c
+	@printf "> Compiling C file 'src/vmachine/sim_fli.c': "
+	gcc $(CFLAGS) -c $< -o $@
+
+$(OBJ)/sim_ghdl.o: ./src/vmachine/sim_ghdl.c
+	@printf "> Compiling C file 'src/vmachine/sim_ghdl.c': "
+	gcc $(CFLAGS) -c $< -o $@
+
+$(OBJ)/sim_verilator.o: ./src/vmachine/sim_verilator.c
+	@printf "> Compiling C file 'src/vmachine/sim_verilator.c': "
+	gcc $(CFLAGS) -c $< -o $@
+
+$(OBJ)/snapshot.o: ./src/vmachine/snapshot.c
+	@printf "> Compiling C file 'src/vmachine/snapshot.c': "
+	gcc $(CFLAGS) -c $< -o $@
+
+$(OBJ)/snapshot_fli.o: ./src/vmachine/snapshot_fli.c
+	@printf "> Compiling C file 'src/vmachine/snapshot_fli.c': "
+	gcc $(CFLAGS) -c $< -o $@
+
 $(OBJ)/utils.o: ./src/vmachine/utils.c
 	@printf "> Compiling C file 'src/vmachine/utils.c': "
 	gcc $(CFLAGS) -c $< -o $@
 
+$(OBJ)/trace.o: ./src/vmachine/trace.c
+	@printf "> Compiling C file 'src/vmachine/trace.c': "
+	gcc $(CFLAGS) -c $< -o $@
+
+$(OBJ)/trace_decode.o: ./src/vmachine/trace_decode.c
+	@printf "> Compiling C file 'src/vmachine/trace_decode.c': "
+	gcc $(CFLAGS) -c $< -o $@
+
 $(OBJ)/timer.o: ./src/vmachine/iodevices/timer.c
 	@printf "> Compiling C file 'src/vmachine/iodevices/timer.c': "
 	gcc $(CFLAGS) -c $< -o $@
@@ -76,13 +236,16 @@ $(OBJ)/tinycthread.o: ./src/vmachine/tinycthread/tinycthread.c
 
 ##### Main rules:
 
-all: BOOTLOADER $(BINS)
+# The Virtual Machine's shared library, which the foreign architectures load (see rtl/platform):
+libvm: $(VMOBJS)
 	@printf "> Linking the Virtual Machine's object files into a shared library: "
-	gcc -shared -Wl,-Bsymbolic -Wl,-export-all-symbols -std=c99 -m32 -o $(BIN)/libvm.dll $(VMOBJS) $(FLI_LIB_PATH) $(SDL_LIB_PATH)
+	gcc $(LIBVMFLAGS) -std=c99 $(OPTFLAGS) $(ARCHFLAGS) -o $(LIBVM) $(VMOBJS) $(FLI_LIB_PATH) $(SDL_LIB_PATH)
 
+all: BOOTLOADER $(BINS) libvm
 	@printf "\n> Compiling VHDL code:\n"
 
 	$(VCOM) -2002 -quiet rtl/defines.vhd
+	$(VCOM) -2002 -quiet rtl/platform/$(PLATFORM).vhd
 	$(VCOM) -2002 -quiet rtl/memory.vhd
 	$(VCOM) -2002 -quiet rtl/io_controller.vhd
 	$(VCOM) -2002 -quiet rtl/mmu.vhd
@@ -101,17 +264,79 @@ all: BOOTLOADER $(BINS)
 	@$(RM) modelsim.ini
 	@printf "\n>> DONE COMPILING <<"
 
+# GHDL and Verilator objects of the Virtual Machine:
+vpath %.c src/vmachine src/vmachine/iodevices src/vmachine/tinycthread src/iss
+
+$(OBJ)/ghdl/%.o: %.c
+	@mkdir -p $(OBJ)/ghdl
+	@printf "> Compiling C file '$<' for GHDL: "
+	gcc $(GHDLCFLAGS) -c $< -o $@
+
+$(OBJ)/verilator/%.o: %.c
+	@mkdir -p $(OBJ)/verilator
+	@printf "> Compiling C file '$<' for Verilator: "
+	gcc $(VLTCFLAGS) -c $< -o $@
+
+# RTL simulation on GHDL, without ModelSim. Each run of $(GHDLSIM) is a whole simulation, so many can run in parallel:
+ghdl: BOOTLOADER $(GHDLOBJS)
+	@printf "\n> Compiling VHDL code for GHDL:\n"
+	@mkdir -p $(OBJ)/ghdl
+	$(GHDL) -a $(GHDLFLAGS) rtl/defines.vhd rtl/platform/$(PLATFORM).vhd rtl/memory.vhd rtl/io_controller.vhd rtl/mmu.vhd
+	$(GHDL) -a $(GHDLFLAGS) rtl/ghdl/vhpi.vhd rtl/ghdl/memory.vhd rtl/ghdl/io_controller.vhd rtl/ghdl/mmu.vhd
+	$(GHDL) -a $(GHDLFLAGS) rtl/alu.vhd rtl/cpsr.vhd rtl/microcode.vhd rtl/registers.vhd
+	$(GHDL) -a $(GHDLFLAGS) rtl/stage1_fetch.vhd rtl/stage2_decode.vhd rtl/stage3_execute.vhd rtl/stage4_memory_access.vhd rtl/stage5_writeback.vhd
+	$(GHDL) -a $(GHDLFLAGS) rtl/fisc.vhd rtl/top.vhd
+	@printf "> Elaborating the design with the Virtual Machine linked in: "
+	$(GHDL) -e $(GHDLFLAGS) $(addprefix -Wl$(comma),$(GHDLOBJS)) -Wl,-lSDL2 -Wl,-lpthread -o $(GHDLSIM) top
+	@printf "\n>> DONE COMPILING <<"
+
+# Simulate on GHDL (the run control comes from FISC_RUNCTL, see src/vmachine/runctl.h):
+ghdl_run:
+	@printf "\n>> Simulating Top Module on GHDL and producing GTKWave GHW file <<\n"
+	@$(GHDLSIM) --wave=$(WAVESPATH)/top.ghw
+	@printf "\n>> END OF SIMULATION <<\n"
+
+# RTL simulation on Verilator. The Memory, IO Controller and MMU are left as black boxes by the conversion, and
+# rtl/verilator fills them in with shells which call into the Virtual Machine:
+verilator: BOOTLOADER $(VLTOBJS)
+	@printf "\n> Converting the core's VHDL code into Verilog:\n"
+	$(GHDL) -a $(GHDLSYNTHFLAGS) rtl/defines.vhd rtl/alu.vhd rtl/cpsr.vhd rtl/microcode.vhd rtl/registers.vhd
+	$(GHDL) -a $(GHDLSYNTHFLAGS) rtl/stage1_fetch.vhd rtl/stage2_decode.vhd rtl/stage3_execute.vhd rtl/stage4_memory_access.vhd rtl/stage5_writeback.vhd
+	$(GHDL) -a $(GHDLSYNTHFLAGS) rtl/fisc.vhd
+	$(GHDL) --synth $(GHDLSYNTHFLAGS) --out=verilog fisc > $(OBJ)/verilator/fisc.v
+	@printf "> Compiling the core with Verilator: "
+	$(VERILATOR) --cc --exe --build -O3 -Wno-fatal --top-module fisc -Mdir $(OBJ)/verilator/model \
+		$(OBJ)/verilator/fisc.v rtl/verilator/memory.sv rtl/verilator/io_controller.sv rtl/verilator/mmu.sv src/vmachine/sim_verilator_main.cpp \
+		-LDFLAGS "$(addprefix $(CURDIR)/,$(VLTOBJS)) -lSDL2 -lpthread" -o $(CURDIR)/$(VLTSIM)
+	@printf "\n>> DONE COMPILING <<"
+
+# Simulate on Verilator (the run control comes from FISC_RUNCTL, see src/vmachine/runctl.h):
+verilator_run:
+	@printf "\n>> Simulating the FISC core on Verilator <<\n"
+	@$(VLTSIM)
+	@printf "\n>> END OF SIMULATION <<\n"
+
+# Instruction Set Simulator (runs FISC images natively, without ModelSim):
+iss: $(ISSOBJS)
+	@printf "> Linking the Instruction Set Simulator: "
+	gcc -std=c99 $(OPTFLAGS) $(ARCHFLAGS) -o $(BIN)/fiscsim $(ISSOBJS) $(SDL_LIB_PATH)
+
+# Trace decoder (prints the trace files written with FISC_TRACE, see src/vmachine/trace.h):
+tracedump: $(OBJ)/trace_decode.o
+	@printf "> Linking the trace decoder: "
+	gcc -std=c99 -o $(BIN)/fisctrace $(OBJ)/trace_decode.o
+
 # Simulate:
 %:
 	@printf "\n>> Simulating Top Module and producing GTKWave VCD file <<\n"
-	@cp lib\c_libs\SDL\i686-w64-mingw32\bin\SDL2.dll .
+	@$(if $(SDL_DLL),cp $(SDL_DLL) .)
 	@$(VSIM) -c -do "$(VSIMCOMMANDS)" -wlf top.wlf top
 	@printf "\n>> END OF SIMULATION <<\n"
 	@wlf2vcd top.wlf -o top.vcd
 	@mv top.wlf $(WAVESPATH)
 	@mv top.vcd $(WAVESPATH)
 	@$(RM) transcript
-	@$(RM) SDL2.dll
+	@$(if $(SDL_DLL),$(RM) SDL2.dll)
 	
 # GTKWave:
 w%:
@@ -121,6 +346,8 @@ w%:
 clean:
 	@printf "\n>> Cleaning built files <<\n"
 	$(RM) $(BIN)/*
+	$(RM) -r $(OBJ)/ghdl
+	$(RM) -r $(OBJ)/verilator
 	$(RM) $(OBJ)/*
 	$(RM) transcript
 	$(RM) modelsim.ini